@@ -12,6 +12,7 @@
     #include <omp.h>
 #endif
 #include <exception>
+#include <cmath>
 
 #define GRIDPP_VERSION "0.7.0.dev1"
 #define __version__ GRIDPP_VERSION
@@ -66,6 +67,12 @@ namespace gridpp {
     class Nearest;
     class StructureFunction;
     class Transform;
+    class View2;
+    class View3;
+    class Field2D;
+    class Field3D;
+    class Interpolator;
+    class SummedAreaTable;
 
     /** Methods for extrapolating outside a curve */
     enum Extrapolation {
@@ -359,6 +366,13 @@ namespace gridpp {
     */
     vec2 neighbourhood(const vec2& input, int halfwidth, Statistic statistic);
 
+    /** Spatial neighbourhood filter, computing a statistic for a sliding square window
+      * @param input 2D field of values
+      * @param halfwidth Filter halfwidth in number of gridpoints
+      * @param statistic Statistic to compute
+    */
+    Field2D neighbourhood(const Field2D& input, int halfwidth, Statistic statistic);
+
     /** Spatial neighbourhood filter for an ensemble of fields
       * @param input 3D grid of values with dimensions (Y, X, E)
       * @param halfwidth Filter halfwidth in number of gridpoints
@@ -366,6 +380,13 @@ namespace gridpp {
     */
     vec2 neighbourhood(const vec3& input, int halfwidth, Statistic statistic);
 
+    /** Spatial neighbourhood filter for an ensemble of fields stored in external memory
+      * @param input 3D view of values with dimensions (Y, X, E)
+      * @param halfwidth Filter halfwidth in number of gridpoints
+      * @param statistic Statistic to compute
+    */
+    Field2D neighbourhood(const View3& input, int halfwidth, Statistic statistic);
+
     /** Computes a quantile in a sliding square neighbourhood
       * @param input 2D grid of values
       * @param quantile Quantile to compute (between 0 and 1)
@@ -944,18 +965,56 @@ namespace gridpp {
     void warning(std::string string);
     void error(std::string string);
     void future_deprecation_warning(std::string function, std::string other="");
-    bool is_valid(float value);
+    /** Check if a value is valid, i.e. not missing, NaN, or infinite. Defined inline, so that loops
+     *  using it can be inlined and vectorized */
+    inline bool is_valid(float value) {
+        return std::isfinite(value) && value != gridpp::MV;
+    }
     float calc_statistic(const vec& array, Statistic statistic);
     float calc_quantile(const vec& array, float quantile);
     vec calc_statistic(const vec2& array, Statistic statistic);
     vec calc_quantile(const vec2& array, float quantile=MV);
 
+    /** Check if calc_statistic can compute a statistic. Quantiles are computed by calc_quantile.
+      * @param statistic Statistic to check
+      * @return True if the statistic is supported
+    */
+    bool is_supported_statistic(Statistic statistic);
+
+    /** Compute a statistic over the last dimension of an array, in parallel over gridpoints
+      * @param input Array with dimensions (Y, X, E)
+      * @param statistic Statistic to compute. Use calc_quantile for quantiles.
+      * @return Statistic with dimensions (Y, X)
+    */
+    Field2D calc_statistic(const View3& input, Statistic statistic);
+
+    /** Compute a quantile over the last dimension of an array, in parallel over gridpoints
+      * @param input Array with dimensions (Y, X, E)
+      * @param quantile Quantile to compute (between 0 and 1)
+      * @return Quantile with dimensions (Y, X)
+    */
+    Field2D calc_quantile(const View3& input, float quantile);
+
     /** Compute quantile with 2D varying quantile
       * @param array Input array with dimensions (T, Y, X)
       * @param quantile Quantile array with dimensions (Y, X)
       * @return Extracted quantile with dimensions (Y, X)
     */
     vec2 calc_quantile(const vec3& array, const vec2& quantile);
+
+    /** Compute several quantiles of an array, selecting the needed values only once
+      * @param array Input array. Missing values are ignored.
+      * @param quantiles Quantiles to compute (between 0 and 1)
+      * @return The same as calling calc_quantile for each quantile
+    */
+    vec calc_quantiles(const vec& array, const vec& quantiles);
+
+    /** Compute several quantiles for each row of an array
+      * @param array Input array with dimensions (N, T)
+      * @param quantiles Quantiles to compute (between 0 and 1)
+      * @return Quantiles with dimensions (N, Q)
+    */
+    vec2 calc_quantiles(const vec2& array, const vec& quantiles);
     int num_missing_values(const vec2& iArray);
 
     /** Find the index in a vector that is equal or just below a value
@@ -1011,6 +1070,16 @@ namespace gridpp {
      *  @param default_gradient Use this gradient if minimum number is not met
     */
     vec2 calc_gradient(const vec2& base, const vec2& values, GradientType gradient_type, int halfwidth, int min_num=2, float min_range=gridpp::MV, float default_gradient=0);
+
+    /** Computes gradients for several fields with respect to the same base. For MinMax, the
+     *  location of the min and max of base is only searched for once when the fields have
+     *  missing values in the same places.
+     *  @param base Dependent variable with dimensions (Y, X). Missing values are not used.
+     *  @param values Independent variables with dimensions (Y, X, T), with time last like other 3D
+     *  arrays. Missing values are not used.
+     *  @return Gradients with dimensions (Y, X, T)
+    */
+    vec3 calc_gradient(const vec2& base, const vec3& values, GradientType gradient_type, int halfwidth, int min_num=2, float min_range=gridpp::MV, float default_gradient=0);
     /** Find suitable value in neighbourhood based on a search criteria. If search value is within a
     * criteria range, then the most suitable point is used. This is the nearest value of any point
     * within the search_target range; or if no point fulfills this, the point with the highest
@@ -1036,6 +1105,21 @@ namespace gridpp {
 
     vec2 window(const vec2& array, int length, gridpp::Statistic statistic, bool before=false, bool keep_missing=false, bool missing_edges=true);
 
+    /** Compute window statistics, writing to an existing output array. The memory of output is
+    *  reused when it already has the size of array. See gridpp::window for the arguments.
+    */
+    void window(const vec2& array, int length, gridpp::Statistic statistic, vec2& output, bool before=false, bool keep_missing=false, bool missing_edges=true);
+
+    /** Compute a quantile in a window
+    *  @param array input array with dimensions (case, time)
+    *  @param length window length in number of timesteps
+    *  @param quantile quantile to compute (between 0 and 1)
+    *  @param before if true, make the window end at the particular time. If false, centre it.
+    *  @param keep_missing if true, window value will be missing if one or more values in window are missing
+    *  @param missing_edges if true put missing values at the edges, where window overshoots the edge
+    */
+    vec2 window_quantile(const vec2& array, int length, float quantile, bool before=false, bool keep_missing=false, bool missing_edges=true);
+
     /** Check if the grid is the same size as the 2D vector. If True, they are compatible, if false
     * they are incompatible */
     bool compatible_size(const Grid& grid, const vec2& v);
@@ -1071,6 +1155,10 @@ namespace gridpp {
     float test_vec2_input(const vec2& input);
     /** Testing function for 3D input vector */
     float test_vec3_input(const vec3& input);
+    /** Testing function for 2D input view */
+    float test_view2_input(const View2& input);
+    /** Testing function for 3D input view */
+    float test_view3_input(const View3& input);
     /** Testing function for 1D output vector */
     vec test_vec_output();
     ivec test_ivec_output();
@@ -1112,6 +1200,8 @@ namespace gridpp {
     };
 
     /** Helper class for Grid and Points */
+    /** Static KD-tree for finding points near a location. The tree is built once, by recursively
+      * splitting the points at the median, and is stored in flat arrays. */
     class KDTree {
         public:
             KDTree(vec lats, vec lons, CoordinateType type=Geodetic);
@@ -1154,6 +1244,23 @@ namespace gridpp {
              * */
             ivec get_closest_neighbours(float lat, float lon, int num, bool include_match=true) const;
 
+            /** Find the single nearest point for each of a set of lookup-points
+             *  @param lats Latitudes of lookup-points
+             *  @param lons Longitudes of lookup-points
+             *  @param output Vector to store the index of the nearest point (-1 if none is found)
+             * */
+            void get_nearest_neighbours(const vec& lats, const vec& lons, ivec& output, bool include_match=true) const;
+
+            /** Find all points within a radius for each of a set of lookup-points. The neighbours
+             *  are stored in compressed sparse row format, such that the neighbours of lookup-point
+             *  i are indices[offsets[i]], ..., indices[offsets[i+1] - 1].
+             *  @param lats Latitudes of lookup-points
+             *  @param lons Longitudes of lookup-points
+             *  @param radius Lookup radius [m]
+             *  @param offsets Vector to store the start of each lookup-point's neighbours (size + 1 elements)
+             *  @param indices Vector to store the neighbours of all lookup-points
+             * */
+            void get_neighbours(const vec& lats, const vec& lons, float radius, ivec& offsets, ivec& indices, bool include_match=true) const;
 
             /** Convert lat/lons to 3D cartesian coordinates with the centre of the earth as the origin
              *  @param lats vector of latitudes [deg]
@@ -1183,30 +1290,23 @@ namespace gridpp {
             int size() const;
             CoordinateType get_coordinate_type() const;
         protected:
-            typedef boost::geometry::model::point<float, 3, boost::geometry::cs::cartesian> point;
-            typedef std::pair<point, unsigned> value;
-            typedef boost::geometry::model::box<point> box;
-            boost::geometry::index::rtree< value, boost::geometry::index::quadratic<16> > mTree;
+            typedef std::pair<float, int> candidate;
             vec mLats;
             vec mLons;
             CoordinateType mType;
 
-            struct within_radius {
-                public:
-                    within_radius(point p, float radius, bool include_match);
-                    bool operator()(value const& v) const;
-                private:
-                    float radius;
-                    point p;
-                    bool include_match;
-            };
-            struct is_not_equal {
-                public:
-                    is_not_equal(point p);
-                    bool operator()(value const& v) const;
-                private:
-                    point p;
-            };
+            /** x, y, z coordinates of the points in tree order. Points with missing coordinates
+             *  are not part of the tree. */
+            vec mCoords;
+            /** Index of the points (in tree order) into mLats/mLons */
+            ivec mIndices;
+            /** The dimension that the node with the median at a given position splits */
+            std::vector<unsigned char> mSplitDims;
+
+            void build();
+            void build(int start, int end, ivec& order, const vec& coords);
+            void search_radius(int start, int end, const float* p, float radius, bool include_match, ivec& output) const;
+            void search_nearest(int start, int end, const float* p, int num, bool include_match, std::vector<candidate>& heap) const;
     };
 
     /** Represents a vector of locations and their metadata */
@@ -1231,6 +1331,11 @@ namespace gridpp {
             int get_num_neighbours(float lat, float lon, float radius, bool include_match=true) const;
             ivec get_closest_neighbours(float lat, float lon, int num, bool include_match=true) const;
 
+            /** Find the nearest point for each lookup-point. See KDTree::get_nearest_neighbours */
+            void get_nearest_neighbours(const vec& lats, const vec& lons, ivec& output, bool include_match=true) const;
+            /** Find all points within a radius of each lookup-point. See KDTree::get_neighbours */
+            void get_neighbours(const vec& lats, const vec& lons, float radius, ivec& offsets, ivec& indices, bool include_match=true) const;
+
             vec get_lats() const;
             vec get_lons() const;
             vec get_elevs() const;
@@ -1268,8 +1373,35 @@ namespace gridpp {
             int get_num_neighbours(float lat, float lon, float radius, bool include_match=true) const;
             ivec2 get_closest_neighbours(float lat, float lon, int num, bool include_match=true) const;
 
+            /** Find the nearest gridpoint for each lookup-point
+             *  @param lats Latitudes of lookup-points
+             *  @param lons Longitudes of lookup-points
+             *  @param y_indices Vector to store the y-index of the nearest gridpoint (-1 if none is found)
+             *  @param x_indices Vector to store the x-index of the nearest gridpoint (-1 if none is found)
+            */
+            void get_nearest_neighbours(const vec& lats, const vec& lons, ivec& y_indices, ivec& x_indices, bool include_match=true) const;
+
+            /** Find all gridpoints within a radius of each lookup-point, in compressed sparse row
+             *  format. See KDTree::get_neighbours.
+             *  @param lats Latitudes of lookup-points
+             *  @param lons Longitudes of lookup-points
+             *  @param radius Lookup radius [m]
+             *  @param offsets Vector to store the start of each lookup-point's neighbours (size + 1 elements)
+             *  @param y_indices Vector to store the y-index of the neighbours
+             *  @param x_indices Vector to store the x-index of the neighbours
+            */
+            void get_neighbours(const vec& lats, const vec& lons, float radius, ivec& offsets, ivec& y_indices, ivec& x_indices, bool include_match=true) const;
+
             bool get_box(float lat, float lon, int& Y1_out, int& X1_out, int& Y2_out, int& X2_out) const;
 
+            /** Check if the latitudes only vary along the first dimension and the longitudes only
+             *  along the second (e.g. a regular lat/lon grid, or a projected grid with Cartesian
+             *  coordinates). For these grids, nearest neighbour and box lookups are computed from
+             *  the grid axes instead of searching the tree.
+             *  @returns True if the grid is rectilinear
+            */
+            bool is_rectilinear() const;
+
             /** Convert grid to a vector of points */
             Points to_points() const;
 
@@ -1290,7 +1422,382 @@ namespace gridpp {
             vec2 mLons;
             vec2 mElevs;
             vec2 mLafs;
+
+            // Axes of rectilinear grids, and the sin/cos of the axes for geodetic grids
+            bool mRectilinear;
+            vec mAxisLats;
+            vec mAxisLons;
+            dvec mCosLats;
+            dvec mSinLats;
+            dvec mCosLons;
+            dvec mSinLons;
+            void set_rectilinear();
+            /** Find the flat index of the nearest gridpoint using the grid axes. Returns -1 if the
+              * tree must be searched instead. */
+            int get_nearest_rectilinear(float lat, float lon) const;
+    };
+
+    /** Precomputed interpolation weights from an input grid to an output grid or a set of points.
+      * Creating the interpolator does all neighbour searches, such that interpolating a field is a
+      * gather of the input values. This is useful when many fields are interpolated between the same
+      * pair of grids. Elevation and land area fraction gradients can be applied like in
+      * gridpp::full_gradient. The weights can be stored on disk and read back in a later run. */
+    class Interpolator {
+        public:
+            Interpolator();
+
+            /** Create an interpolator from a grid to another grid
+             *  @param igrid Input grid
+             *  @param ogrid Output grid
+             *  @param downscaler Interpolation method
+            */
+            Interpolator(const Grid& igrid, const Grid& ogrid, Downscaler downscaler);
+
+            /** Create an interpolator from a grid to points
+             *  @param igrid Input grid
+             *  @param opoints Output points
+             *  @param downscaler Interpolation method
+            */
+            Interpolator(const Grid& igrid, const Points& opoints, Downscaler downscaler);
+
+            /** Read an interpolator from a file written by Interpolator::write
+             *  @param filename Filename
+            */
+            Interpolator(const std::string& filename);
+
+            /** Interpolate a field to the output grid. Gives the same results as gridpp::downscaling
+             *  @param ivalues 2D vector of values on the input grid (Y, X)
+             *  @returns Values on the output grid
+            */
+            vec2 apply(const vec2& ivalues) const;
+
+            /** Interpolate a 3D field (T, Y, X) to the output grid */
+            vec3 apply(const vec3& ivalues) const;
+
+            /** Interpolate a field to the output points. Gives the same results as gridpp::downscaling
+             *  @param ivalues 2D vector of values on the input grid (Y, X)
+             *  @returns Values on the output points
+            */
+            vec apply_points(const vec2& ivalues) const;
+
+            /** Interpolate a 3D field (T, Y, X) to the output points */
+            vec2 apply_points(const vec3& ivalues) const;
+
+            /** Downscale a field using elevation and land area fraction gradients. Gives the same
+             *  results as gridpp::full_gradient
+             *  @param ivalues 2D vector of values on the input grid (Y, X)
+             *  @param elev_gradient Elevation gradient on the input grid (Y, X), or empty to skip
+             *  @param laf_gradient Land area fraction gradient on the input grid (Y, X), or empty to skip
+             *  @returns Values on the output grid
+            */
+            vec2 apply_full_gradient(const vec2& ivalues, const vec2& elev_gradient, const vec2& laf_gradient=vec2()) const;
+
+            /** Downscale a 3D field (T, Y, X) using gradients with the same dimensions */
+            vec3 apply_full_gradient(const vec3& ivalues, const vec3& elev_gradient, const vec3& laf_gradient) const;
+
+            /** Downscale a field to the output points using elevation and land area fraction gradients.
+             *  Gives the same results as gridpp::full_gradient
+             *  @param ivalues 2D vector of values on the input grid (Y, X)
+             *  @param elev_gradient Elevation gradient on the input grid (Y, X), or empty to skip
+             *  @param laf_gradient Land area fraction gradient on the input grid (Y, X), or empty to skip
+             *  @returns Values on the output points
+            */
+            vec apply_full_gradient_points(const vec2& ivalues, const vec2& elev_gradient, const vec2& laf_gradient=vec2()) const;
+
+            /** Downscale a 3D field (T, Y, X) to the output points using gradients with the same dimensions */
+            vec2 apply_full_gradient_points(const vec3& ivalues, const vec3& elev_gradient, const vec3& laf_gradient) const;
+
+            /** Write the interpolator to a binary file
+             *  @param filename Filename
+            */
+            void write(const std::string& filename) const;
+
+            Downscaler get_downscaler() const;
+            /** Size of the input grid (Y, X) */
+            ivec get_input_size() const;
+            /** Size of the output grid (Y, X), or the number of output points (N) */
+            ivec get_output_size() const;
+        private:
+            Downscaler mDownscaler;
+            bool mToPoints;
+            int mInputY;
+            int mInputX;
+            int mOutputY;
+            int mOutputX;
+            // Each output location uses mNumWeights input gridpoints, stored in mRows, mCols, and
+            // mWeights. The nearest gridpoint is used instead when any of these input values are
+            // missing. A row of -1 means that no input gridpoint is available.
+            int mNumWeights;
+            ivec mRows;
+            ivec mCols;
+            vec mWeights;
+            ivec mNearestRows;
+            ivec mNearestCols;
+            // Output elevation and land area fraction minus the interpolated input elevation and land
+            // area fraction, used for the gradient corrections. Missing if either value is missing.
+            vec mElevDiffs;
+            vec mLafDiffs;
+            void init(const Grid& igrid, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs);
+            /** Set the bilinear weights. Defined in bilinear.cpp */
+            void set_bilinear_weights(const Grid& igrid, const vec& lats, const vec& lons);
+            /** Check that the weights are consistent with the sizes. Used when reading files. */
+            bool is_valid_plan() const;
+            float calc(const vec2& ivalues, int index) const;
+            float calc_full_gradient(const vec2& ivalues, const vec2& elev_gradient, const vec2& laf_gradient, int index) const;
+    };
+
+    /** Read-only view of a 2D array of floats stored in memory owned by someone else (e.g. a numpy
+      * array). The view does not copy the data and must not outlive the memory it points to. */
+    class View2 {
+        public:
+            View2();
+
+            /** Create a view
+             *  @param data: Pointer to the first element
+             *  @param Y: Size of the first dimension
+             *  @param X: Size of the second dimension
+             *  @param stride_y: Distance between consecutive elements in the first dimension [number of elements]
+             *  @param stride_x: Distance between consecutive elements in the second dimension [number of elements]
+            */
+            View2(const float* data, int Y, int X, long stride_y, long stride_x);
+
+            /** Create a view of a contiguous row-major array with dimensions (Y, X) */
+            View2(const float* data, int Y, int X);
+
+            float operator()(int y, int x) const { return mData[y * mStrideY + x * mStrideX]; };
+            int size_y() const { return mY; };
+            int size_x() const { return mX; };
+            const float* data() const { return mData; };
+            bool is_contiguous() const;
+
+            /** Copy the values into a 2D vector */
+            vec2 to_vec2() const;
+        private:
+            const float* mData;
+            int mY;
+            int mX;
+            long mStrideY;
+            long mStrideX;
+    };
+
+    /** Read-only view of a 3D array of floats stored in memory owned by someone else (e.g. a numpy
+      * array). The view does not copy the data and must not outlive the memory it points to. */
+    class View3 {
+        public:
+            View3();
+
+            /** Create a view
+             *  @param data: Pointer to the first element
+             *  @param Y: Size of the first dimension
+             *  @param X: Size of the second dimension
+             *  @param E: Size of the third dimension
+             *  @param stride_y: Distance between consecutive elements in the first dimension [number of elements]
+             *  @param stride_x: Distance between consecutive elements in the second dimension [number of elements]
+             *  @param stride_e: Distance between consecutive elements in the third dimension [number of elements]
+            */
+            View3(const float* data, int Y, int X, int E, long stride_y, long stride_x, long stride_e);
+
+            /** Create a view of a contiguous row-major array with dimensions (Y, X, E) */
+            View3(const float* data, int Y, int X, int E);
+
+            float operator()(int y, int x, int e) const { return mData[y * mStrideY + x * mStrideX + e * mStrideE]; };
+            int size_y() const { return mY; };
+            int size_x() const { return mX; };
+            int size_e() const { return mE; };
+            long stride_y() const { return mStrideY; };
+            long stride_x() const { return mStrideX; };
+            long stride_e() const { return mStrideE; };
+            const float* data() const { return mData; };
+            bool is_contiguous() const;
+
+            /** Copy the values into a 3D vector */
+            vec3 to_vec3() const;
+        private:
+            const float* mData;
+            int mY;
+            int mX;
+            int mE;
+            long mStrideY;
+            long mStrideX;
+            long mStrideE;
+    };
+
+    /** 2D field of floats stored contiguously in row-major order. Use this instead of vec2 when
+      * the values are passed between functions, to avoid one allocation per row. */
+    class Field2D {
+        public:
+            Field2D();
+
+            /** Create a field filled with a value
+             *  @param Y: Size of the first dimension
+             *  @param X: Size of the second dimension
+             *  @param value: Initial value of all elements
+            */
+            Field2D(int Y, int X, float value=MV);
+
+            /** Create a field that takes over a vector of row-major values, without copying
+             *  @param Y: Size of the first dimension
+             *  @param X: Size of the second dimension
+             *  @param values: Vector with Y * X values, which is moved from
+            */
+            Field2D(int Y, int X, vec&& values);
+
+            /** Copy the values of a 2D vector, which must have rows of equal length */
+            explicit Field2D(const vec2& input);
+
+            /** Copy the values of a view */
+            explicit Field2D(const View2& input);
+
+            float& operator()(int y, int x) { reset_missing(); return mValues[y * mX + x]; };
+            float operator()(int y, int x) const { return mValues[y * mX + x]; };
+            int size_y() const { return mY; };
+            int size_x() const { return mX; };
+            /** Total number of values */
+            size_t size() const { return mValues.size(); };
+            float* data() { reset_missing(); return mValues.data(); };
+            const float* data() const { return mValues.data(); };
+
+            /** The values in row-major order */
+            vec& values() { reset_missing(); return mValues; };
+            const vec& values() const { return mValues; };
+
+            /** Get a view of the values, which is valid as long as the field is not resized */
+            View2 view() const;
+
+            /** True if any value is missing. The result is kept until the field is accessed through
+             *  one of the non-const accessors, so kernels can check this instead of testing each
+             *  value. References and pointers from earlier non-const accesses must therefore not be
+             *  used to modify the field afterwards. Must not be called while another thread modifies
+             *  the field.
+            */
+            bool has_missing() const;
+
+            /** Copy the values into a 2D vector */
+            vec2 to_vec2() const;
+        private:
+            int mY;
+            int mX;
+            vec mValues;
+            // Cached result of has_missing, valid if mKnowsMissing is true
+            mutable bool mKnowsMissing;
+            mutable bool mHasMissing;
+            // Only writes when needed, so that threads writing to different values do not all
+            // write to the flag
+            void reset_missing() { if(mKnowsMissing) mKnowsMissing = false; };
+    };
+
+    /** 3D field of floats stored contiguously in row-major order */
+    class Field3D {
+        public:
+            Field3D();
+
+            /** Create a field filled with a value
+             *  @param Y: Size of the first dimension
+             *  @param X: Size of the second dimension
+             *  @param E: Size of the third dimension
+             *  @param value: Initial value of all elements
+            */
+            Field3D(int Y, int X, int E, float value=MV);
+
+            /** Create a field that takes over a vector of row-major values, without copying
+             *  @param Y: Size of the first dimension
+             *  @param X: Size of the second dimension
+             *  @param E: Size of the third dimension
+             *  @param values: Vector with Y * X * E values, which is moved from
+            */
+            Field3D(int Y, int X, int E, vec&& values);
+
+            /** Copy the values of a 3D vector, which must have rows of equal length */
+            explicit Field3D(const vec3& input);
+
+            /** Copy the values of a view */
+            explicit Field3D(const View3& input);
+
+            float& operator()(int y, int x, int e) { reset_missing(); return mValues[(y * mX + x) * mE + e]; };
+            float operator()(int y, int x, int e) const { return mValues[(y * mX + x) * mE + e]; };
+            int size_y() const { return mY; };
+            int size_x() const { return mX; };
+            int size_e() const { return mE; };
+            /** Total number of values */
+            size_t size() const { return mValues.size(); };
+            float* data() { reset_missing(); return mValues.data(); };
+            const float* data() const { return mValues.data(); };
+
+            /** The values in row-major order */
+            vec& values() { reset_missing(); return mValues; };
+            const vec& values() const { return mValues; };
+
+            /** Get a view of the values, which is valid as long as the field is not resized */
+            View3 view() const;
+
+            /** True if any value is missing. The result is kept in the same way as for
+             *  Field2D::has_missing. */
+            bool has_missing() const;
+
+            /** Copy the values into a 3D vector */
+            vec3 to_vec3() const;
+        private:
+            int mY;
+            int mX;
+            int mE;
+            vec mValues;
+            mutable bool mKnowsMissing;
+            mutable bool mHasMissing;
+            void reset_missing() { if(mKnowsMissing) mKnowsMissing = false; };
+    };
+
+    /** Summed area table (integral image) of a 2D field. Gives the sum, the number of valid values,
+      * and optionally the sum of squares, within any rectangle in constant time. Missing values are
+      * ignored. Build the table once when several neighbourhood statistics of the same field are
+      * needed. */
+    class SummedAreaTable {
+        public:
+            SummedAreaTable();
+
+            /** Create a table
+             *  @param input 2D field
+             *  @param compute_squares Also accumulate the sum of squares, needed for Std and Variance
+            */
+            SummedAreaTable(const Field2D& input, bool compute_squares=false);
+            SummedAreaTable(const vec2& input, bool compute_squares=false);
+
+            /** Sum of valid values in the rectangle with corners (y0, x0) and (y1, x1), both
+             *  inclusive. The rectangle is clipped to the field.
+            */
+            double sum(int y0, int x0, int y1, int x1) const;
+
+            /** Number of valid values in a rectangle. See SummedAreaTable::sum */
+            int count(int y0, int x0, int y1, int x1) const;
+
+            /** Sum of squared valid values in a rectangle. See SummedAreaTable::sum */
+            double sum_squares(int y0, int x0, int y1, int x1) const;
+
+            /** Compute a statistic in a sliding square window. Gives the same result as
+             *  gridpp::neighbourhood.
+             *  @param halfwidth Filter halfwidth in number of gridpoints
+             *  @param statistic Mean, Sum, Count, Std, or Variance (the latter two require compute_squares)
+            */
+            Field2D neighbourhood(int halfwidth, Statistic statistic) const;
+
+            int size_y() const { return mY; };
+            int size_x() const { return mX; };
+        private:
+            int mY;
+            int mX;
+            bool mHasSquares;
+            // Tables in row-major order, where each element is the total of all values above and
+            // to the left of it (inclusive)
+            dvec mSums;
+            ivec mCounts;
+            dvec mSquares;
+            /** Fill the tables
+             *  @param rows Pointers to the first value of each row of the input
+             *  @param all_valid True if the input has no missing values, which skips the validity tests
+            */
+            void build(const std::vector<const float*>& rows, bool all_valid);
+            bool clip(int& y0, int& x0, int& y1, int& x1) const;
     };
+
     class not_implemented_exception: public std::logic_error
     {
         public:
@@ -1309,6 +1816,57 @@ namespace gridpp {
             */
             virtual float localization_distance(const Point& p) const;
             virtual StructureFunction* clone() const = 0;
+
+            /** Look up where each point is in the structure function's parameter fields, so that
+              * the *_indexed functions can skip this search. Call this once per set of points.
+              * @param points Points to look up
+              * @return Parameter index for each point. -1 means that no index is available.
+            */
+            virtual ivec get_parameter_indices(const Points& points) const;
+            /** Parameter index of a single point
+              * @param p Point to look up
+              * @return Parameter index. -1 means that no index is available.
+            */
+            virtual int get_parameter_index(const Point& p) const;
+            /** Correlation between two points, where p1 has a parameter index
+              * @param p1 First point
+              * @param p2 Second point
+              * @param index1 Parameter index of p1 from get_parameter_indices
+            */
+            virtual float corr_indexed(const Point& p1, const Point& p2, int index1) const;
+            /** Background correlation between two points, where p1 has a parameter index. The
+              * default uses corr_indexed, so structures that override corr_background must also
+              * override this.
+            */
+            virtual float corr_background_indexed(const Point& p1, const Point& p2, int index1) const;
+            /** Localization distance for a point with a parameter index
+              * @param p Point
+              * @param index Parameter index of p from get_parameter_indices
+              * @return Distance [m]
+            */
+            virtual float localization_distance_indexed(const Point& p, int index) const;
+
+            /** Correlations between one point and a set of points. Faster than calling corr for
+              * each pair.
+              * @param p1 First point
+              * @param index1 Parameter index of p1 from get_parameter_indices
+              * @param lats Latitudes (or y-coordinates) of the other points
+              * @param lons Longitudes (or x-coordinates) of the other points
+              * @param elevs Elevations of the other points
+              * @param lafs Land area fractions of the other points
+              * @param output Correlation for each point. Resized to the number of points.
+            */
+            virtual void corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const;
+            /** Correlations between all pairs of points in a set
+              * @param lats Latitudes (or y-coordinates) of the points
+              * @param lons Longitudes (or x-coordinates) of the points
+              * @param elevs Elevations of the points
+              * @param lafs Land area fractions of the points
+              * @param type Coordinate type of the points
+              * @param indices Parameter index of each point from get_parameter_indices
+              * @param output Correlations [point][point]. Resized to the number of points.
+            */
+            virtual void corr_matrix(const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, CoordinateType type, const ivec& indices, vec2& output) const;
             static const float default_min_rho;
         protected:
             /** Barnes correlation function
@@ -1334,6 +1892,11 @@ namespace gridpp {
             */
             MultipleStructure(const StructureFunction& structure_h, const StructureFunction& structure_v, const StructureFunction& structure_w);
             float corr(const Point& p1, const Point& p2) const;
+            /** Parameter indices of the horizontal structure */
+            ivec get_parameter_indices(const Points& points) const;
+            int get_parameter_index(const Point& p) const;
+            float localization_distance_indexed(const Point& p, int index) const;
+            void corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const;
             StructureFunction* clone() const;
             float localization_distance(const Point& p) const;
         private:
@@ -1362,6 +1925,13 @@ namespace gridpp {
             float corr(const Point& p1, const Point& p2) const;
             StructureFunction* clone() const;
             float localization_distance(const Point& p) const;
+            ivec get_parameter_indices(const Points& points) const;
+            /** Flattened index of the nearest gridpoint in the parameter fields */
+            int get_parameter_index(const Point& p) const;
+            float corr_indexed(const Point& p1, const Point& p2, int index1) const;
+            float localization_distance_indexed(const Point& p, int index) const;
+            void corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const;
+            void corr_matrix(const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, CoordinateType type, const ivec& indices, vec2& output) const;
         private:
             Grid m_grid;
             vec2 mH;
@@ -1376,6 +1946,7 @@ namespace gridpp {
         public:
             CressmanStructure(float h, float v=0, float w=0);
             float corr(const Point& p1, const Point& p2) const;
+            void corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const;
             StructureFunction* clone() const;
         private:
             float mH;
@@ -1394,6 +1965,13 @@ namespace gridpp {
             float corr_background(const Point& p1, const Point& p2) const;
             StructureFunction* clone() const;
             float localization_distance(const Point& p) const;
+            ivec get_parameter_indices(const Points& points) const;
+            int get_parameter_index(const Point& p) const;
+            float corr_indexed(const Point& p1, const Point& p2, int index1) const;
+            float corr_background_indexed(const Point& p1, const Point& p2, int index1) const;
+            float localization_distance_indexed(const Point& p, int index) const;
+            void corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const;
+            void corr_matrix(const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, CoordinateType type, const ivec& indices, vec2& output) const;
         private:
             StructureFunction* m_structure;
             float m_dist;
@@ -16,6 +16,8 @@ namespace {
     // Bilinear interpolation based on 4 surrounding points with coordinates (x0,y0), (x1,y1), etc
     // and values v0, v1, etc
     float bilinear(float x, float y, float x0, float x1, float x2, float x3, float y0, float y1, float y2, float y3, float v0, float v1, float v2, float v3);
+    // Compute the coefficients s and t used by bilinear to weight the 4 surrounding points
+    void calc_coefficients(float x, float y, float x0, float x1, float x2, float x3, float y0, float y1, float y2, float y3, float& s, float& t);
     // Compute s,t when the points form a parallelogram
     bool calcParallelogram(float x, float y, float X1, float X2, float X3, float X4, float Y1, float Y2, float Y3, float Y4, float &t, float &s);
 
@@ -137,6 +139,55 @@ vec2 gridpp::bilinear(const Grid& igrid, const Points& opoints, const vec3& ival
     return output;
 }
 
+void gridpp::Interpolator::set_bilinear_weights(const Grid& igrid, const vec& lats, const vec& lons) {
+    vec2 iInputLats = igrid.get_lats();
+    vec2 iInputLons = igrid.get_lons();
+    int N = lats.size();
+    mNumWeights = 4;
+    mRows.resize(4 * N);
+    mCols.resize(4 * N);
+    mWeights.resize(4 * N);
+    igrid.get_nearest_neighbours(lats, lons, mNearestRows, mNearestCols);
+
+    std::string error;
+    #pragma omp parallel for
+    for(int i = 0; i < N; i++) {
+        int I1, I2, J1, J2;
+        int start = 4 * i;
+        if(igrid.get_box(lats[i], lons[i], I1, J1, I2, J2)) {
+            float s = gridpp::MV, t = gridpp::MV;
+            try {
+                ::calc_coefficients(lons[i], lats[i], iInputLons[I1][J1], iInputLons[I2][J1], iInputLons[I1][J2],
+                        iInputLons[I2][J2], iInputLats[I1][J1], iInputLats[I2][J1], iInputLats[I1][J2],
+                        iInputLats[I2][J2], s, t);
+            }
+            catch(std::exception& e) {
+                #pragma omp critical
+                error = e.what();
+            }
+            // Same order as the terms in ::bilinear
+            int rows[4] = {I2, I2, I1, I1};
+            int cols[4] = {J1, J2, J1, J2};
+            float weights[4] = {(1 - s) * (1 - t), s * (1 - t), (1 - s) * t, s * t};
+            for(int k = 0; k < 4; k++) {
+                mRows[start + k] = rows[k];
+                mCols[start + k] = cols[k];
+                mWeights[start + k] = weights[k];
+            }
+        }
+        else {
+            // The point is outside the input domain. Revert to nearest neighbour
+            for(int k = 0; k < 4; k++) {
+                mRows[start + k] = mNearestRows[i];
+                mCols[start + k] = mNearestCols[i];
+                mWeights[start + k] = k == 0;
+            }
+        }
+    }
+    if(error != "")
+        throw std::runtime_error(error);
+}
+
 namespace {
     bool calcParallelogram(float x, float y, float X1, float X2, float X3, float X4, float Y1, float Y2, float Y3, float Y4, float &t, float &s) {
         // std::cout << "Method 3: Parallelogram" << std::endl;
@@ -240,6 +291,17 @@ namespace {
         return true;
     }
     float bilinear(float x, float y, float x0, float x1, float x2, float x3, float y0, float y1, float y2, float y3, float v0, float v1, float v2, float v3) {
+       float P1 = v1;
+       float P2 = v3;
+       float P3 = v0;
+       float P4 = v2;
+       float s = gridpp::MV, t = gridpp::MV;
+       calc_coefficients(x, y, x0, x1, x2, x3, y0, y1, y2, y3, s, t);
+       float value = P1 * (1 - s) * ( 1 - t) + P2 * s * (1 - t) + P3 * (1 - s) * t + P4 * s * t;
+
+       return value;
+    }
+    void calc_coefficients(float x, float y, float x0, float x1, float x2, float x3, float y0, float y1, float y2, float y3, float& s, float& t) {
        float Y1 = y1;
        float Y2 = y3;
        float Y3 = y0;
@@ -248,15 +310,10 @@ namespace {
        float X2 = x3;
        float X3 = x0;
        float X4 = x2;
-       float P1 = v1;
-       float P2 = v3;
-       float P3 = v0;
-       float P4 = v2;
 
        // General method based on: https://stackoverflow.com/questions/23920976/bilinear-interpolation-with-non-aligned-input-points
        // Parallelogram method based on: http://www.ahinson.com/algorithms_general/Sections/InterpolationRegression/InterpolationIrregularBilinear.pdf
 
-       float s = gridpp::MV, t = gridpp::MV;
        bool rectangularGrid = (X1 == X3 && X2 == X4 && Y1 == Y2 && Y3 == Y4);
        // TODO: Why are the tolerances so high?
        bool verticalParallel = fabs((X3 - X1)*(Y4 - Y2) - (X4 - X2)*(Y3 - Y1)) <= 1e-4;
@@ -284,9 +341,6 @@ namespace {
           throw std::runtime_error(ss.str());
        }
        assert(s >= 0 && s <= 1 && t >= 0 && t <= 1);
-       float value = P1 * (1 - s) * ( 1 - t) + P2 * s * (1 - t) + P3 * (1 - s) * t + P4 * s * t;
-
-       return value;
     }
 
     // Pass in input lats and lons, because otherwise we lose a lot of speed
@@ -3,19 +3,33 @@
 
 using namespace gridpp;
 
+namespace {
+    /** Find the position of the lowest and highest base in the neighbourhood of each gridpoint,
+      * only using gridpoints that are valid. Ties are resolved by using the first gridpoint in the
+      * neighbourhood. Monotonic queues are used first along rows and then along columns, so the
+      * cost does not depend on the halfwidth.
+      * @param valid Flat array of whether each gridpoint can be used
+      * @param imin Output flat index of the lowest base, or -1 if there are no valid gridpoints
+      * @param imax Output flat index of the highest base, or -1 if there are no valid gridpoints
+      * @param count Output number of valid gridpoints in the neighbourhood
+    */
+    void calc_extreme_indices(const vec2& base, const std::vector<char>& valid, int halfwidth, ivec& imin, ivec& imax, ivec& count);
+
+    /** Throws an exception if the arguments to calc_gradient are not valid */
+    void check_arguments(const vec2& base, const vec2& values, int halfwidth, int num_min, float min_range);
+
+    /** Get which gridpoints have both a valid base and valid values */
+    std::vector<char> get_valid(const vec2& base, const vec2& values);
+
+    /** Compute the MinMax gradient using the positions of the lowest and highest base */
+    void calc_minmax_gradient(const vec2& base, const vec2& values, const ivec& imin, const ivec& imax, const ivec& count,
+            int num_min, float min_range, float default_gradient, vec2& output);
+}
+
 vec2 gridpp::calc_gradient(const vec2& base, const vec2& values, GradientType gradientType,
     int halfwidth, int num_min, float min_range, float default_gradient){
 
-    if(halfwidth <= 0)
-        throw std::invalid_argument("Halwidth cannot be <= 0; must be positive integer");
-    if(gridpp::is_valid(min_range) && min_range < 0)
-        throw std::invalid_argument("min_range must be >= 0");
-    if(num_min < 0)
-        throw std::invalid_argument("num_min must be >= 0");
-    if(base.size() == 0)
-        throw std::invalid_argument("base input has no size");
-    if(!gridpp::compatible_size(base, values))
-        throw std::invalid_argument("base is not the same size as values");
+    ::check_arguments(base, values, halfwidth, num_min, min_range);
 
     int nY = base.size();
     int nX = base[0].size();
@@ -24,103 +38,290 @@ vec2 gridpp::calc_gradient(const vec2& base, const vec2& values, GradientType gr
 
     // Min Max Gradient 
     if(gradientType == MinMax){
-        for(int y = 0; y  < base.size(); y++) {
-            for(int x = 0; x < base[y].size(); x++){
-                float current_max = gridpp::MV;
-                float current_min = gridpp::MV;
-                int I_maxBase_Y = 0;
-                int I_maxBase_X = 0;
-                int I_minBase_Y = 0;
-                int I_minBase_X = 0;
-                int count = 0;
-                for(int yy = std::max(0, y - halfwidth); yy <= std::min(nY - 1, y + halfwidth); yy++){
-                    for(int xx = std::max(0, x - halfwidth); xx <= std::min(nX - 1, x + halfwidth); xx++){
-                        float current_base = base[yy][xx];
-                        if(!gridpp::is_valid(current_base)){
-                            continue;
-                        }
-                        if(!gridpp::is_valid(values[yy][xx]))
-                            continue;
-
-                        if(!gridpp::is_valid(current_max) || current_base > current_max){
-                            current_max = current_base;
-                            I_maxBase_Y = yy;
-                            I_maxBase_X = xx;
-                        }
-                        if(!gridpp::is_valid(current_min) || current_base < current_min){
-                            current_min = current_base;
-                            I_minBase_Y = yy;
-                            I_minBase_X = xx;
-                        }
-                        count++;
-                    }
-                }
-                if(count < num_min) {
-                    output[y][x] = default_gradient;
-                }
-                else if(!gridpp::is_valid(current_max) || !gridpp::is_valid(current_min)){
-                    output[y][x] = default_gradient;
-                }
-
-                else if(abs(current_max - current_min) <= min_range){
-                    output[y][x] = default_gradient;
-                }
-                else{
-                    float diffBase = current_max - current_min;
-                    float diffValues = values[I_maxBase_Y][I_maxBase_X] - values[I_minBase_Y][I_minBase_X];
-                    output[y][x] = diffValues / diffBase;
-                }
-            }
-        }
+        ivec imin, imax, count;
+        ::calc_extreme_indices(base, ::get_valid(base, values), halfwidth, imin, imax, count);
+        ::calc_minmax_gradient(base, values, imin, imax, count, num_min, min_range, default_gradient, output);
     }
     else if(gradientType == LinearRegression){
         // Compute neighbourhood means for different moments. Ensure we only use base and values
         // where both of them are defined
-        vec2 base0 = gridpp::init_vec2(nY, nX, gridpp::MV);
-        vec2 values0 = gridpp::init_vec2(nY, nX, gridpp::MV);
-        vec2 base_x_base = gridpp::init_vec2(nY, nX, gridpp::MV);
-        vec2 base_x_values = gridpp::init_vec2(nY, nX, gridpp::MV);
-        vec2 is_valid = gridpp::init_vec2(nY, nX, 0);
+        Field2D base0(nY, nX, gridpp::MV);
+        Field2D values0(nY, nX, gridpp::MV);
+        Field2D base_x_values(nY, nX, gridpp::MV);
 
         #pragma omp parallel for collapse(2)
         for(int y = 0; y < nY; y++){
             for(int x = 0; x < nX; x++){
                 if(gridpp::is_valid(base[y][x]) && gridpp::is_valid(values[y][x])) {
-                    base_x_base[y][x] = pow(base[y][x], 2);
-                    base_x_values[y][x] = base[y][x] * values[y][x];
-                    is_valid[y][x] = 1;
-                    base0[y][x] = base[y][x];
-                    values0[y][x] = values[y][x];
+                    base_x_values(y, x) = base[y][x] * values[y][x];
+                    base0(y, x) = base[y][x];
+                    values0(y, x) = values[y][x];
                 }
             }
         }
 
-        vec2 meanX = gridpp::neighbourhood(base0, halfwidth, gridpp::Mean);
-        vec2 meanY = gridpp::neighbourhood(values0, halfwidth, gridpp::Mean);
-
-        vec2 meanXX = gridpp::neighbourhood(base_x_base, halfwidth, gridpp::Mean);
-        vec2 meanXY = gridpp::neighbourhood(base_x_values, halfwidth, gridpp::Mean);
-        vec2 count = gridpp::neighbourhood(is_valid, halfwidth, gridpp::Sum);
+        // The table for base also provides the number of valid pairs and the sum of base squared
+        gridpp::SummedAreaTable tableX(base0, true);
+        gridpp::SummedAreaTable tableY(values0);
+        gridpp::SummedAreaTable tableXY(base_x_values);
 
         #pragma omp parallel for collapse(2)
         for(int y = 0; y < nY; y++){
             for(int x = 0; x < nX; x++){
                 output[y][x] = default_gradient;
-                if(count[y][x] >= num_min && gridpp::is_valid(meanXX[y][x]) && gridpp::is_valid(meanXY[y][x]) && gridpp::is_valid(meanX[y][x]) && meanXX[y][x] - meanX[y][x] * meanX[y][x] != 0) {
+                int y0 = y - halfwidth;
+                int x0 = x - halfwidth;
+                int y1 = y + halfwidth;
+                int x1 = x + halfwidth;
+                int count = tableX.count(y0, x0, y1, x1);
+                if(count == 0 || count < num_min)
+                    continue;
+                float meanX = tableX.sum(y0, x0, y1, x1) / count;
+                float meanY = tableY.sum(y0, x0, y1, x1) / count;
+                float meanXX = tableX.sum_squares(y0, x0, y1, x1) / count;
+                float meanXY = tableXY.sum(y0, x0, y1, x1) / count;
+                if(gridpp::is_valid(meanXX) && gridpp::is_valid(meanXY) && gridpp::is_valid(meanX) && meanXX - meanX * meanX != 0) {
                     bool valid_range = true;
                     if(gridpp::is_valid(min_range)) {
                         // Use the STD as a measure of range, since this is more efficient
-                        float range = sqrt(meanXX[y][x] - meanX[y][x] * meanX[y][x]);
+                        float range = sqrt(meanXX - meanX * meanX);
                         if(!gridpp::is_valid(range))
                             valid_range = false;
                         else if(range < min_range)
                             valid_range = false;
                     }
                     if(valid_range)
-                        output[y][x] = (meanXY[y][x] - meanX[y][x] * meanY[y][x]) / (meanXX[y][x] - meanX[y][x] * meanX[y][x]);
+                        output[y][x] = (meanXY - meanX * meanY) / (meanXX - meanX * meanX);
                 }
             }
         }
     }
     return output;
 }
+vec3 gridpp::calc_gradient(const vec2& base, const vec3& values, GradientType gradientType,
+    int halfwidth, int num_min, float min_range, float default_gradient){
+    if(!gridpp::compatible_size(base, values))
+        throw std::invalid_argument("base is not the same size as values. values must have dimensions (Y, X, T).");
+    int nY = values.size();
+    int nX = nY > 0 ? values[0].size() : 0;
+    int nT = nY > 0 && nX > 0 ? values[0][0].size() : 0;
+    for(int y = 0; y < nY; y++) {
+        for(int x = 0; x < nX; x++) {
+            if(values[y][x].size() != nT)
+                throw std::invalid_argument("All gridpoints must have the same number of times");
+        }
+    }
+    vec3 output = gridpp::init_vec3(nY, nX, nT, default_gradient);
+
+    // The kernels work on one field at a time, so each time is copied into a 2D field.
+    // For MinMax, the positions of the lowest and highest base only depend on which gridpoints
+    // are valid, so reuse them as long as the missing values are in the same places as in the
+    // previous field.
+    vec2 curr_values = gridpp::init_vec2(nY, nX);
+    vec2 curr_output;
+    std::vector<char> prev_valid;
+    ivec imin, imax, count;
+    for(int t = 0; t < nT; t++) {
+        #pragma omp parallel for
+        for(int y = 0; y < nY; y++) {
+            for(int x = 0; x < nX; x++) {
+                curr_values[y][x] = values[y][x][t];
+            }
+        }
+        if(gradientType == MinMax) {
+            ::check_arguments(base, curr_values, halfwidth, num_min, min_range);
+            std::vector<char> valid = ::get_valid(base, curr_values);
+            if(t == 0 || valid != prev_valid) {
+                ::calc_extreme_indices(base, valid, halfwidth, imin, imax, count);
+                prev_valid.swap(valid);
+            }
+            curr_output = gridpp::init_vec2(nY, nX, default_gradient);
+            ::calc_minmax_gradient(base, curr_values, imin, imax, count, num_min, min_range, default_gradient, curr_output);
+        }
+        else {
+            curr_output = gridpp::calc_gradient(base, curr_values, gradientType, halfwidth, num_min, min_range, default_gradient);
+        }
+        #pragma omp parallel for
+        for(int y = 0; y < nY; y++) {
+            for(int x = 0; x < nX; x++) {
+                output[y][x][t] = curr_output[y][x];
+            }
+        }
+    }
+    return output;
+}
+
+namespace {
+    void calc_extreme_indices(const vec2& base, const std::vector<char>& valid, int halfwidth, ivec& imin, ivec& imax, ivec& count) {
+        int nY = base.size();
+        int nX = base[0].size();
+        size_t N = size_t(nY) * nX;
+        ivec row_min(N), row_max(N), row_count(N);
+        vec row_min_value(N), row_max_value(N);
+        imin.resize(N);
+        imax.resize(N);
+        count.resize(N);
+
+        // Each queue holds candidate positions in increasing order, where the base values are
+        // increasing (for min) or decreasing (for max). The front is the extreme of the window.
+        // Each position is added at most once, so the queues do not need to wrap around.
+        #pragma omp parallel
+        {
+            ivec qmin(nX), qmax(nX);
+            #pragma omp for
+            for(int y = 0; y < nY; y++) {
+                const vec& curr = base[y];
+                size_t offset = size_t(y) * nX;
+                int min_head = 0, min_tail = 0, max_head = 0, max_tail = 0;
+                int total = 0;
+                for(int k = 0; k < nX + halfwidth; k++) {
+                    if(k < nX && valid[offset + k]) {
+                        while(min_tail > min_head && curr[qmin[min_tail - 1]] > curr[k])
+                            min_tail--;
+                        qmin[min_tail++] = k;
+                        while(max_tail > max_head && curr[qmax[max_tail - 1]] < curr[k])
+                            max_tail--;
+                        qmax[max_tail++] = k;
+                        total++;
+                    }
+                    int x = k - halfwidth;
+                    if(x < 0)
+                        continue;
+                    int start = x - halfwidth;
+                    if(start > 0 && valid[offset + start - 1])
+                        total--;
+                    while(min_head < min_tail && qmin[min_head] < start)
+                        min_head++;
+                    while(max_head < max_tail && qmax[max_head] < start)
+                        max_head++;
+                    row_min[offset + x] = -1;
+                    row_max[offset + x] = -1;
+                    if(min_head < min_tail) {
+                        row_min[offset + x] = offset + qmin[min_head];
+                        row_min_value[offset + x] = curr[qmin[min_head]];
+                        row_max[offset + x] = offset + qmax[max_head];
+                        row_max_value[offset + x] = curr[qmax[max_head]];
+                    }
+                    row_count[offset + x] = total;
+                }
+            }
+        }
+
+        // Then along columns, where the queues hold rows. Rows are added in increasing order, so
+        // that ties are resolved by using the first row. Process columns in blocks, so that the
+        // inner loop is over contiguous memory.
+        int block_size = 64;
+        int num_blocks = (nX + block_size - 1) / block_size;
+        #pragma omp parallel
+        {
+            ivec qmin(size_t(block_size) * nY), qmax(size_t(block_size) * nY);
+            ivec min_head(block_size), min_tail(block_size), max_head(block_size), max_tail(block_size), total(block_size);
+            #pragma omp for
+            for(int b = 0; b < num_blocks; b++) {
+                int x_start = b * block_size;
+                int x_end = std::min(nX, x_start + block_size);
+                std::fill(min_head.begin(), min_head.end(), 0);
+                std::fill(min_tail.begin(), min_tail.end(), 0);
+                std::fill(max_head.begin(), max_head.end(), 0);
+                std::fill(max_tail.begin(), max_tail.end(), 0);
+                std::fill(total.begin(), total.end(), 0);
+                for(int k = 0; k < nY + halfwidth; k++) {
+                    int y = k - halfwidth;
+                    int start = y - halfwidth;
+                    for(int x = x_start; x < x_end; x++) {
+                        int l = x - x_start;
+                        int* cmin = &qmin[size_t(l) * nY];
+                        int* cmax = &qmax[size_t(l) * nY];
+                        if(k < nY) {
+                            size_t index = size_t(k) * nX + x;
+                            if(row_min[index] >= 0) {
+                                float value = row_min_value[index];
+                                while(min_tail[l] > min_head[l] && row_min_value[size_t(cmin[min_tail[l] - 1]) * nX + x] > value)
+                                    min_tail[l]--;
+                                cmin[min_tail[l]++] = k;
+                                value = row_max_value[index];
+                                while(max_tail[l] > max_head[l] && row_max_value[size_t(cmax[max_tail[l] - 1]) * nX + x] < value)
+                                    max_tail[l]--;
+                                cmax[max_tail[l]++] = k;
+                            }
+                            total[l] += row_count[index];
+                        }
+                        if(y < 0)
+                            continue;
+                        if(start > 0)
+                            total[l] -= row_count[size_t(start - 1) * nX + x];
+                        while(min_head[l] < min_tail[l] && cmin[min_head[l]] < start)
+                            min_head[l]++;
+                        while(max_head[l] < max_tail[l] && cmax[max_head[l]] < start)
+                            max_head[l]++;
+                        size_t index = size_t(y) * nX + x;
+                        imin[index] = -1;
+                        imax[index] = -1;
+                        if(min_head[l] < min_tail[l]) {
+                            imin[index] = row_min[size_t(cmin[min_head[l]]) * nX + x];
+                            imax[index] = row_max[size_t(cmax[max_head[l]]) * nX + x];
+                        }
+                        count[index] = total[l];
+                    }
+                }
+            }
+        }
+    }
+    void check_arguments(const vec2& base, const vec2& values, int halfwidth, int num_min, float min_range) {
+        if(halfwidth <= 0)
+            throw std::invalid_argument("Halwidth cannot be <= 0; must be positive integer");
+        if(gridpp::is_valid(min_range) && min_range < 0)
+            throw std::invalid_argument("min_range must be >= 0");
+        if(num_min < 0)
+            throw std::invalid_argument("num_min must be >= 0");
+        if(base.size() == 0)
+            throw std::invalid_argument("base input has no size");
+        if(!gridpp::compatible_size(base, values))
+            throw std::invalid_argument("base is not the same size as values");
+    }
+    std::vector<char> get_valid(const vec2& base, const vec2& values) {
+        int nY = base.size();
+        int nX = base[0].size();
+        std::vector<char> valid(size_t(nY) * nX);
+        #pragma omp parallel for
+        for(int y = 0; y < nY; y++) {
+            for(int x = 0; x < nX; x++) {
+                valid[size_t(y) * nX + x] = gridpp::is_valid(base[y][x]) && gridpp::is_valid(values[y][x]);
+            }
+        }
+        return valid;
+    }
+    void calc_minmax_gradient(const vec2& base, const vec2& values, const ivec& imin, const ivec& imax, const ivec& count,
+            int num_min, float min_range, float default_gradient, vec2& output) {
+        int nY = base.size();
+        int nX = base[0].size();
+        #pragma omp parallel for
+        for(int y = 0; y < nY; y++) {
+            for(int x = 0; x < nX; x++){
+                size_t index = size_t(y) * nX + x;
+                if(count[index] < num_min) {
+                    output[y][x] = default_gradient;
+                }
+                else if(imin[index] < 0) {
+                    output[y][x] = default_gradient;
+                }
+                else {
+                    int I_minBase_Y = imin[index] / nX;
+                    int I_minBase_X = imin[index] % nX;
+                    int I_maxBase_Y = imax[index] / nX;
+                    int I_maxBase_X = imax[index] % nX;
+                    float current_min = base[I_minBase_Y][I_minBase_X];
+                    float current_max = base[I_maxBase_Y][I_maxBase_X];
+                    if(abs(current_max - current_min) <= min_range){
+                        output[y][x] = default_gradient;
+                    }
+                    else{
+                        float diffBase = current_max - current_min;
+                        float diffValues = values[I_maxBase_Y][I_maxBase_X] - values[I_minBase_Y][I_minBase_X];
+                        output[y][x] = diffValues / diffBase;
+                    }
+                }
+            }
+        }
+    }
+}
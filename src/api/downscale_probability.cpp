@@ -10,7 +10,12 @@ vec2 gridpp::downscale_probability(const Grid& igrid, const Grid& ogrid, const v
 
     int nLat = iOutputLats.size();
     int nLon = iOutputLats[0].size();
-    int nEns = ivalues[0][0].size();
+    int nEns = 0;
+    if(ivalues.size() > 0 && ivalues[0].size() > 0)
+        nEns = ivalues[0][0].size();
+
+    ivec II, JJ;
+    igrid.get_nearest_neighbours(Field2D(iOutputLats).values(), Field2D(iOutputLons).values(), II, JJ);
 
     vec2 output(nLat);
     for(int i = 0; i < nLat; i++)
@@ -19,9 +24,13 @@ vec2 gridpp::downscale_probability(const Grid& igrid, const Grid& ogrid, const v
     #pragma omp parallel for collapse(2)
     for(int i = 0; i < nLat; i++) {
         for(int j = 0; j < nLon; j++) {
-            ivec indices = igrid.get_nearest_neighbour(iOutputLats[i][j], iOutputLons[i][j]);
-            int I = indices[0];
-            int J = indices[1];
+            int I = II[i * nLon + j];
+            int J = JJ[i * nLon + j];
+            if(I < 0) {
+                // No valid gridpoints in the input grid
+                output[i][j] = gridpp::MV;
+                continue;
+            }
             int count = 0;
             int total = 0;
             for(int k = 0; k < nEns; k++){
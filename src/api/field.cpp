@@ -0,0 +1,131 @@
+#include "gridpp.h"
+#include <sstream>
+#include <utility>
+
+using namespace gridpp;
+
+gridpp::Field2D::Field2D() : mY(0), mX(0), mKnowsMissing(false), mHasMissing(false) {
+}
+gridpp::Field2D::Field2D(int Y, int X, float value) : mY(Y), mX(X), mKnowsMissing(false), mHasMissing(false) {
+    if(Y < 0 || X < 0)
+        throw std::invalid_argument("Field dimensions must be >= 0");
+    mValues.resize(size_t(Y) * X, value);
+}
+gridpp::Field2D::Field2D(int Y, int X, vec&& values) : mY(Y), mX(X), mKnowsMissing(false), mHasMissing(false) {
+    if(Y < 0 || X < 0)
+        throw std::invalid_argument("Field dimensions must be >= 0");
+    if(values.size() != size_t(Y) * X) {
+        std::stringstream ss;
+        ss << "Number of values (" << values.size() << ") does not match the field size (" << Y << "," << X << ")";
+        throw std::invalid_argument(ss.str());
+    }
+    mValues = std::move(values);
+}
+gridpp::Field2D::Field2D(const vec2& input) : mY(input.size()), mX(0), mKnowsMissing(false), mHasMissing(false) {
+    if(mY > 0)
+        mX = input[0].size();
+    mValues.resize(size_t(mY) * mX);
+    for(int y = 0; y < mY; y++) {
+        if(input[y].size() != mX)
+            throw std::invalid_argument("Cannot create a field from a 2D vector with rows of different length");
+        std::copy(input[y].begin(), input[y].end(), mValues.begin() + size_t(y) * mX);
+    }
+}
+gridpp::Field2D::Field2D(const View2& input) : mY(input.size_y()), mX(input.size_x()), mKnowsMissing(false), mHasMissing(false) {
+    mValues.resize(size_t(mY) * mX);
+    for(int y = 0; y < mY; y++) {
+        for(int x = 0; x < mX; x++) {
+            (*this)(y, x) = input(y, x);
+        }
+    }
+}
+View2 gridpp::Field2D::view() const {
+    return View2(data(), mY, mX);
+}
+bool gridpp::Field2D::has_missing() const {
+    if(!mKnowsMissing) {
+        // Stop at the first missing value
+        mHasMissing = false;
+        for(size_t i = 0; i < mValues.size() && !mHasMissing; i++) {
+            mHasMissing = !gridpp::is_valid(mValues[i]);
+        }
+        mKnowsMissing = true;
+    }
+    return mHasMissing;
+}
+vec2 gridpp::Field2D::to_vec2() const {
+    vec2 output(mY);
+    for(int y = 0; y < mY; y++) {
+        output[y].assign(mValues.begin() + size_t(y) * mX, mValues.begin() + size_t(y + 1) * mX);
+    }
+    return output;
+}
+
+gridpp::Field3D::Field3D() : mY(0), mX(0), mE(0), mKnowsMissing(false), mHasMissing(false) {
+}
+gridpp::Field3D::Field3D(int Y, int X, int E, float value) : mY(Y), mX(X), mE(E), mKnowsMissing(false), mHasMissing(false) {
+    if(Y < 0 || X < 0 || E < 0)
+        throw std::invalid_argument("Field dimensions must be >= 0");
+    mValues.resize(size_t(Y) * X * E, value);
+}
+gridpp::Field3D::Field3D(int Y, int X, int E, vec&& values) : mY(Y), mX(X), mE(E), mKnowsMissing(false), mHasMissing(false) {
+    if(Y < 0 || X < 0 || E < 0)
+        throw std::invalid_argument("Field dimensions must be >= 0");
+    if(values.size() != size_t(Y) * X * E) {
+        std::stringstream ss;
+        ss << "Number of values (" << values.size() << ") does not match the field size (" << Y << "," << X << "," << E << ")";
+        throw std::invalid_argument(ss.str());
+    }
+    mValues = std::move(values);
+}
+gridpp::Field3D::Field3D(const vec3& input) : mY(input.size()), mX(0), mE(0), mKnowsMissing(false), mHasMissing(false) {
+    if(mY > 0)
+        mX = input[0].size();
+    if(mY > 0 && mX > 0)
+        mE = input[0][0].size();
+    mValues.resize(size_t(mY) * mX * mE);
+    for(int y = 0; y < mY; y++) {
+        if(input[y].size() != mX)
+            throw std::invalid_argument("Cannot create a field from a 3D vector with rows of different length");
+        for(int x = 0; x < mX; x++) {
+            if(input[y][x].size() != mE)
+                throw std::invalid_argument("Cannot create a field from a 3D vector with rows of different length");
+            std::copy(input[y][x].begin(), input[y][x].end(), mValues.begin() + (size_t(y) * mX + x) * mE);
+        }
+    }
+}
+gridpp::Field3D::Field3D(const View3& input) : mY(input.size_y()), mX(input.size_x()), mE(input.size_e()), mKnowsMissing(false), mHasMissing(false) {
+    mValues.resize(size_t(mY) * mX * mE);
+    for(int y = 0; y < mY; y++) {
+        for(int x = 0; x < mX; x++) {
+            for(int e = 0; e < mE; e++) {
+                (*this)(y, x, e) = input(y, x, e);
+            }
+        }
+    }
+}
+View3 gridpp::Field3D::view() const {
+    return View3(data(), mY, mX, mE);
+}
+bool gridpp::Field3D::has_missing() const {
+    if(!mKnowsMissing) {
+        // Stop at the first missing value
+        mHasMissing = false;
+        for(size_t i = 0; i < mValues.size() && !mHasMissing; i++) {
+            mHasMissing = !gridpp::is_valid(mValues[i]);
+        }
+        mKnowsMissing = true;
+    }
+    return mHasMissing;
+}
+vec3 gridpp::Field3D::to_vec3() const {
+    vec3 output(mY);
+    for(int y = 0; y < mY; y++) {
+        output[y].resize(mX);
+        for(int x = 0; x < mX; x++) {
+            size_t start = (size_t(y) * mX + x) * mE;
+            output[y][x].assign(mValues.begin() + start, mValues.begin() + start + mE);
+        }
+    }
+    return output;
+}
@@ -1,9 +1,20 @@
 #include "gridpp.h"
 #include <iostream>
+#include <cmath>
 
 using namespace gridpp;
 
-gridpp::Grid::Grid() {
+namespace {
+    /** Find the interval [i, i+1] of a strictly monotonic axis containing value, using the spacing
+      * of the axis as a first guess. Values outside the axis are placed in the first or last interval.
+      * Returns false if the value is outside the axis */
+    bool locate(const vec& axis, float value, int& index);
+
+    // Maximum number of rows checked in a rectilinear nearest neighbour lookup
+    const int max_rectilinear_rows = 16;
+}
+
+gridpp::Grid::Grid() : mRectilinear(false) {
     vec lats;
     vec lons;
     mTree = KDTree(lats, lons);
@@ -42,6 +53,135 @@ gridpp::Grid::Grid(vec2 lats, vec2 lons, vec2 elevs, vec2 lafs, CoordinateType t
             mLafs[i].resize(lats[0].size(), gridpp::MV);
         }
     }
+    set_rectilinear();
+}
+void gridpp::Grid::set_rectilinear() {
+    mRectilinear = false;
+    int nY = mLats.size();
+    if(nY == 0 || mX == 0)
+        return;
+    bool is_geodetic = get_coordinate_type() == gridpp::Geodetic;
+    for(int y = 0; y < nY; y++) {
+        for(int x = 0; x < mX; x++) {
+            if(mLats[y][x] != mLats[y][0] || mLons[y][x] != mLons[0][x])
+                return;
+            if(!gridpp::is_valid(mLats[y][x]) || !gridpp::is_valid(mLons[y][x]))
+                return;
+            if(is_geodetic && std::fabs(mLats[y][x]) > 90)
+                return;
+        }
+    }
+    mAxisLats.resize(nY);
+    for(int y = 0; y < nY; y++)
+        mAxisLats[y] = mLats[y][0];
+    mAxisLons = mLons[0];
+
+    // The axes must be strictly increasing or decreasing
+    const vec* axes[2] = {&mAxisLats, &mAxisLons};
+    for(int a = 0; a < 2; a++) {
+        const vec& axis = *axes[a];
+        for(int i = 2; i < axis.size(); i++) {
+            if((axis[i] - axis[i-1] > 0) != (axis[1] - axis[0] > 0) || axis[i] == axis[i-1])
+                return;
+        }
+        if(axis.size() > 1 && axis[1] == axis[0])
+            return;
+    }
+
+    // Use the same expressions as KDTree::convert_coordinates, so that distances are identical
+    if(is_geodetic) {
+        mCosLats.resize(nY);
+        mSinLats.resize(nY);
+        for(int y = 0; y < nY; y++) {
+            double latr = M_PI / 180 * mAxisLats[y];
+            mCosLats[y] = std::cos(latr);
+            mSinLats[y] = std::sin(latr);
+        }
+        mCosLons.resize(mX);
+        mSinLons.resize(mX);
+        for(int x = 0; x < mX; x++) {
+            double lonr = M_PI / 180 * mAxisLons[x];
+            mCosLons[x] = std::cos(lonr);
+            mSinLons[x] = std::sin(lonr);
+        }
+    }
+    mRectilinear = true;
+}
+bool gridpp::Grid::is_rectilinear() const {
+    return mRectilinear;
+}
+int gridpp::Grid::get_nearest_rectilinear(float lat, float lon) const {
+    if(!mRectilinear || !gridpp::is_valid(lat) || !gridpp::is_valid(lon))
+        return -1;
+    bool is_geodetic = get_coordinate_type() == gridpp::Geodetic;
+    int I, J;
+    bool inside = locate(mAxisLats, lat, I);
+    inside = locate(mAxisLons, lon, J) && inside;
+
+    // Outside the domain, the nearest geodetic point can be on the other side of the domain
+    // (e.g. across the date line). For Cartesian grids the distance is separable in y and x, so the
+    // nearest point is always next to the interval found above.
+    if(is_geodetic && !inside)
+        return -1;
+
+    int nY = mAxisLats.size();
+    int y_start = std::max(I - 1, 0);
+    int y_end = std::min(I + 2, nY - 1);
+    int x_start = std::max(J - 1, 0);
+    int x_end = std::min(J + 2, mX - 1);
+    if(is_geodetic) {
+        // Along a meridian that is dlon away from the point, the closest latitude is
+        // atan(tan(lat) / cos(dlon)), which is poleward of lat. Widen the rows so that it is included.
+        double tan_lat = std::tan(M_PI / 180 * lat);
+        for(int x = x_start; x <= x_end; x++) {
+            double cos_dlon = std::cos(M_PI / 180 * (mAxisLons[x] - lon));
+            if(cos_dlon <= 0)
+                return -1;
+            float closest_lat = 180 / M_PI * std::atan(tan_lat / cos_dlon);
+            int Ic;
+            locate(mAxisLats, closest_lat, Ic);
+            y_start = std::min(y_start, std::max(Ic - 1, 0));
+            y_end = std::max(y_end, std::min(Ic + 2, nY - 1));
+        }
+        // Grids that are much finer in latitude than in longitude can need many rows at high
+        // latitudes. The tree search is faster in that case.
+        if(y_end - y_start > max_rectilinear_rows)
+            return -1;
+    }
+
+    float p[3];
+    mTree.convert_coordinates(lat, lon, p[0], p[1], p[2]);
+    int best = -1;
+    float best_dist = 0;
+    // Candidates are checked in increasing index order, so that ties are broken by the lowest
+    // index, like in the tree search
+    for(int y = y_start; y <= y_end; y++) {
+        // All points at a pole are identical, so the lowest index can be outside the candidates
+        if(is_geodetic && std::fabs(mAxisLats[y]) == 90)
+            return -1;
+        for(int x = x_start; x <= x_end; x++) {
+            float q[3];
+            if(is_geodetic) {
+                q[0] = mCosLats[y] * mCosLons[x] * gridpp::radius_earth;
+                q[1] = mCosLats[y] * mSinLons[x] * gridpp::radius_earth;
+                q[2] = mSinLats[y] * gridpp::radius_earth;
+            }
+            else {
+                q[0] = mAxisLons[x];
+                q[1] = mAxisLats[y];
+                q[2] = 0;
+            }
+            float dx = q[0] - p[0];
+            float dy = q[1] - p[1];
+            float dz = q[2] - p[2];
+            float dist = dx * dx + dy * dy + dz * dz;
+            if(best == -1 || dist < best_dist) {
+                best = y * mX + x;
+                best_dist = dist;
+            }
+        }
+    }
+    return best;
 }
 
 int gridpp::Grid::get_num_neighbours(float lat, float lon, float radius, bool include_match) const {
@@ -64,12 +204,56 @@ ivec2 gridpp::Grid::get_closest_neighbours(float lat, float lon, int num, bool i
     return get_indices(indices);
 }
 ivec gridpp::Grid::get_nearest_neighbour(float lat, float lon, bool include_match) const {
+    if(include_match) {
+        int index = get_nearest_rectilinear(lat, lon);
+        if(index >= 0)
+            return get_indices(index);
+    }
     ivec2 I = get_closest_neighbours(lat, lon, 1, include_match);
     if(I.size() > 0)
         return I[0];
     else
         return ivec();
 }
+void gridpp::Grid::get_nearest_neighbours(const vec& lats, const vec& lons, ivec& y_indices, ivec& x_indices, bool include_match) const {
+    ivec indices;
+    if(mRectilinear && include_match) {
+        if(lats.size() != lons.size())
+            throw std::invalid_argument("Lats and lons must be the same size");
+        indices.resize(lats.size());
+        #pragma omp parallel for
+        for(int i = 0; i < lats.size(); i++) {
+            indices[i] = get_nearest_rectilinear(lats[i], lons[i]);
+            if(indices[i] < 0)
+                indices[i] = mTree.get_nearest_neighbour(lats[i], lons[i]);
+        }
+    }
+    else {
+        mTree.get_nearest_neighbours(lats, lons, indices, include_match);
+    }
+    int N = indices.size();
+    y_indices.clear();
+    x_indices.clear();
+    y_indices.resize(N, -1);
+    x_indices.resize(N, -1);
+    for(int i = 0; i < N; i++) {
+        if(indices[i] >= 0) {
+            y_indices[i] = indices[i] / mX;
+            x_indices[i] = indices[i] % mX;
+        }
+    }
+}
+void gridpp::Grid::get_neighbours(const vec& lats, const vec& lons, float radius, ivec& offsets, ivec& y_indices, ivec& x_indices, bool include_match) const {
+    ivec indices;
+    mTree.get_neighbours(lats, lons, radius, offsets, indices, include_match);
+    int N = indices.size();
+    y_indices.resize(N);
+    x_indices.resize(N);
+    for(int i = 0; i < N; i++) {
+        y_indices[i] = indices[i] / mX;
+        x_indices[i] = indices[i] % mX;
+    }
+}
 vec2 gridpp::Grid::get_lats() const {
     return mLats;
 }
@@ -137,6 +321,18 @@ CoordinateType gridpp::Grid::get_coordinate_type() const {
     return mTree.get_coordinate_type();
 }
 bool gridpp::Grid::get_box(float lat, float lon, int& Y1, int& X1, int& Y2, int& X2) const {
+    if(mRectilinear) {
+        if(mAxisLats.size() <= 1 || mX <= 1)
+            return false;
+        int I, J;
+        if(!locate(mAxisLats, lat, I) || !locate(mAxisLons, lon, J))
+            return false;
+        Y1 = I;
+        Y2 = I + 1;
+        X1 = J;
+        X2 = J + 1;
+        return true;
+    }
     int xdir = 1;
     int ydir = 1;
     ivec nn = get_nearest_neighbour(lat, lon);
@@ -222,3 +418,34 @@ bool gridpp::Grid::get_box(float lat, float lon, int& Y1, int& X1, int& Y2, int&
 gridpp::Point gridpp::Grid::get_point(int y_index, int x_index) const {
     return Point(mLats[y_index][x_index], mLons[y_index][x_index], mElevs[y_index][x_index], mLafs[y_index][x_index], get_coordinate_type());
 }
+
+namespace {
+    bool locate(const vec& axis, float value, int& index) {
+        int n = axis.size();
+        index = 0;
+        if(n < 2)
+            return n == 1 && value == axis[0];
+        bool ascending = axis[n - 1] > axis[0];
+        float guess = (value - axis[0]) / (axis[n - 1] - axis[0]) * (n - 1);
+        if(!(guess >= 0))
+            guess = 0;
+        else if(guess > n - 2)
+            guess = n - 2;
+        index = guess;
+        // Correct the guess for axes that are not evenly spaced
+        if(ascending) {
+            while(index > 0 && value < axis[index])
+                index--;
+            while(index < n - 2 && value > axis[index + 1])
+                index++;
+            return value >= axis[0] && value <= axis[n - 1];
+        }
+        else {
+            while(index > 0 && value > axis[index])
+                index--;
+            while(index < n - 2 && value < axis[index + 1])
+                index++;
+            return value <= axis[0] && value >= axis[n - 1];
+        }
+    }
+}
@@ -12,15 +12,19 @@ vec2 gridpp::gridding(const Grid& grid, const Points& points, const vec& values,
     vec2 lons = grid.get_lons();
     vec2 output = gridpp::init_vec2(Y, X);
 
+    ivec offsets, indices;
+    points.get_neighbours(Field2D(lats).values(), Field2D(lons).values(), radius, offsets, indices);
+
     // Compute the statistic of the point values at each gridpoint
     #pragma omp parallel for collapse(2)
     for(int y = 0; y < Y; y++) {
         for(int x = 0; x < X; x++) {
-            ivec I = points.get_neighbours(lats[y][x], lons[y][x], radius);
-            if(min_num <= 0 || I.size() >= min_num) {
-                vec curr(I.size());
-                for(int i = 0; i < I.size(); i++) {
-                    curr[i] = values[I[i]];
+            int index = y * X + x;
+            int num = offsets[index + 1] - offsets[index];
+            if(min_num <= 0 || num >= min_num) {
+                vec curr(num);
+                for(int i = 0; i < num; i++) {
+                    curr[i] = values[indices[offsets[index] + i]];
                 }
                 output[y][x] = gridpp::calc_statistic(curr, statistic);
             }
@@ -42,13 +46,16 @@ vec2 gridpp::gridding_nearest(const Grid& grid, const Points& points, const vec&
 
     int S = values.size();
 
+    ivec I, J;
+    grid.get_nearest_neighbours(lats, lons, I, J);
+
     // Add value to the nearest grid point in the grid
     // Not parallelizable, because two threads might be writing to the same piece of memory
     for(int s = 0; s < S; s++) {
-        ivec indices = grid.get_nearest_neighbour(lats[s], lons[s]);
-        int iY = indices[0];
-        int iX = indices[1];
-        temp[iY][iX].push_back(values[s]);
+        // Points without a nearest gridpoint (e.g. an empty grid) are skipped
+        if(I[s] < 0)
+            continue;
+        temp[I[s]][J[s]].push_back(values[s]);
     }
 
     vec2 output = gridpp::init_vec2(Y, X, gridpp::MV);
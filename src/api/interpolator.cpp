@@ -0,0 +1,406 @@
+#include "gridpp.h"
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+using namespace gridpp;
+
+namespace {
+    // Identifies the file format written by Interpolator::write
+    const char magic[8] = {'G', 'R', 'I', 'D', 'P', 'P', 'I', 'P'};
+    const int file_version = 2;
+
+    template <class T> void write_value(std::ofstream& file, T value);
+    template <class T> void write_vector(std::ofstream& file, const std::vector<T>& values);
+    template <class T> T read_value(std::ifstream& file);
+    template <class T> void read_vector(std::ifstream& file, std::vector<T>& values);
+    bool is_size(const vec2& values, int Y, int X);
+    bool is_valid_index(int row, int col, int Y, int X);
+}
+
+gridpp::Interpolator::Interpolator() : mDownscaler(gridpp::Nearest), mToPoints(false), mInputY(0),
+    mInputX(0), mOutputY(0), mOutputX(0), mNumWeights(1) {
+}
+gridpp::Interpolator::Interpolator(const Grid& igrid, const Grid& ogrid, Downscaler downscaler) :
+    mDownscaler(downscaler), mToPoints(false) {
+    ivec size = ogrid.size();
+    mOutputY = size[0];
+    mOutputX = size[1];
+    init(igrid, Field2D(ogrid.get_lats()).values(), Field2D(ogrid.get_lons()).values(),
+            Field2D(ogrid.get_elevs()).values(), Field2D(ogrid.get_lafs()).values());
+}
+gridpp::Interpolator::Interpolator(const Grid& igrid, const Points& opoints, Downscaler downscaler) :
+    mDownscaler(downscaler), mToPoints(true) {
+    mOutputY = opoints.size();
+    mOutputX = 1;
+    init(igrid, opoints.get_lats(), opoints.get_lons(), opoints.get_elevs(), opoints.get_lafs());
+}
+void gridpp::Interpolator::init(const Grid& igrid, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs) {
+    ivec size = igrid.size();
+    mInputY = size[0];
+    mInputX = size[1];
+    if(mDownscaler == gridpp::Nearest) {
+        mNumWeights = 1;
+        igrid.get_nearest_neighbours(lats, lons, mRows, mCols);
+        mWeights.clear();
+        mWeights.resize(mRows.size(), 1);
+    }
+    else if(mDownscaler == gridpp::Bilinear) {
+        set_bilinear_weights(igrid, lats, lons);
+    }
+    else {
+        throw std::invalid_argument("Invalid downscaler");
+    }
+
+    // Precompute the elevation and land area fraction differences, like gridpp::full_gradient does
+    // for each call
+    vec2 ielevs = igrid.get_elevs();
+    vec2 ilafs = igrid.get_lafs();
+    int N = lats.size();
+    mElevDiffs.resize(N);
+    mLafDiffs.resize(N);
+    #pragma omp parallel for
+    for(int i = 0; i < N; i++) {
+        float ielev = calc(ielevs, i);
+        float ilaf = calc(ilafs, i);
+        mElevDiffs[i] = gridpp::is_valid(elevs[i]) && gridpp::is_valid(ielev) ? elevs[i] - ielev : gridpp::MV;
+        mLafDiffs[i] = gridpp::is_valid(lafs[i]) && gridpp::is_valid(ilaf) ? lafs[i] - ilaf : gridpp::MV;
+    }
+}
+gridpp::Interpolator::Interpolator(const std::string& filename) {
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if(!file.good())
+        throw std::runtime_error("Could not open interpolator file '" + filename + "'");
+    char header[8];
+    file.read(header, 8);
+    if(!file.good() || memcmp(header, magic, 8) != 0)
+        throw std::runtime_error("'" + filename + "' is not an interpolator file");
+    int version = read_value<int>(file);
+    if(version != file_version) {
+        std::stringstream ss;
+        ss << "Cannot read interpolator file version " << version;
+        throw std::runtime_error(ss.str());
+    }
+    int downscaler = read_value<int>(file);
+    if(downscaler != gridpp::Nearest && downscaler != gridpp::Bilinear)
+        throw std::runtime_error("Interpolator file '" + filename + "' is corrupt");
+    mDownscaler = static_cast<Downscaler>(downscaler);
+    mToPoints = read_value<int>(file);
+    mInputY = read_value<int>(file);
+    mInputX = read_value<int>(file);
+    mOutputY = read_value<int>(file);
+    mOutputX = read_value<int>(file);
+    mNumWeights = read_value<int>(file);
+    read_vector(file, mRows);
+    read_vector(file, mCols);
+    read_vector(file, mWeights);
+    read_vector(file, mNearestRows);
+    read_vector(file, mNearestCols);
+    read_vector(file, mElevDiffs);
+    read_vector(file, mLafDiffs);
+    if(!file.good())
+        throw std::runtime_error("Could not read interpolator file '" + filename + "'");
+    if(!is_valid_plan())
+        throw std::runtime_error("Interpolator file '" + filename + "' is corrupt");
+}
+bool gridpp::Interpolator::is_valid_plan() const {
+    if(mDownscaler == gridpp::Nearest) {
+        if(mNumWeights != 1)
+            return false;
+    }
+    else if(mDownscaler == gridpp::Bilinear) {
+        if(mNumWeights != 4)
+            return false;
+    }
+    else {
+        return false;
+    }
+    if(mInputY < 0 || mInputX < 0 || mOutputY < 0 || mOutputX < 0 || (mToPoints && mOutputX != 1))
+        return false;
+
+    size_t N = size_t(mOutputY) * mOutputX;
+    if(mRows.size() != N * mNumWeights || mCols.size() != mRows.size() || mWeights.size() != mRows.size())
+        return false;
+    if(mNumWeights > 1 && (mNearestRows.size() != N || mNearestCols.size() != N))
+        return false;
+    if(mElevDiffs.size() != N || mLafDiffs.size() != N)
+        return false;
+
+    // calc only checks the first row of each output location, so either all input gridpoints of
+    // a location are missing or all must be inside the input grid
+    for(size_t i = 0; i < N; i++) {
+        size_t start = i * mNumWeights;
+        bool missing = mRows[start] == -1;
+        for(size_t k = start; k < start + mNumWeights; k++) {
+            if(missing) {
+                if(mRows[k] != -1 || mCols[k] != -1)
+                    return false;
+            }
+            else if(!is_valid_index(mRows[k], mCols[k], mInputY, mInputX)) {
+                return false;
+            }
+        }
+        if(mNumWeights > 1 && mNearestRows[i] != -1 && !is_valid_index(mNearestRows[i], mNearestCols[i], mInputY, mInputX))
+            return false;
+    }
+    return true;
+}
+void gridpp::Interpolator::write(const std::string& filename) const {
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if(!file.good())
+        throw std::runtime_error("Could not open interpolator file '" + filename + "' for writing");
+    file.write(magic, 8);
+    write_value<int>(file, file_version);
+    write_value<int>(file, mDownscaler);
+    write_value<int>(file, mToPoints);
+    write_value<int>(file, mInputY);
+    write_value<int>(file, mInputX);
+    write_value<int>(file, mOutputY);
+    write_value<int>(file, mOutputX);
+    write_value<int>(file, mNumWeights);
+    write_vector(file, mRows);
+    write_vector(file, mCols);
+    write_vector(file, mWeights);
+    write_vector(file, mNearestRows);
+    write_vector(file, mNearestCols);
+    write_vector(file, mElevDiffs);
+    write_vector(file, mLafDiffs);
+    if(!file.good())
+        throw std::runtime_error("Could not write interpolator file '" + filename + "'");
+}
+vec2 gridpp::Interpolator::apply(const vec2& ivalues) const {
+    if(mToPoints)
+        throw std::invalid_argument("Interpolator was created for points. Use apply_points instead.");
+    if(!is_size(ivalues, mInputY, mInputX))
+        throw std::invalid_argument("Input values are not the same size as the input grid");
+
+    vec2 output(mOutputY);
+    for(int y = 0; y < mOutputY; y++)
+        output[y].resize(mOutputX);
+
+    #pragma omp parallel for collapse(2)
+    for(int y = 0; y < mOutputY; y++) {
+        for(int x = 0; x < mOutputX; x++) {
+            output[y][x] = calc(ivalues, y * mOutputX + x);
+        }
+    }
+    return output;
+}
+vec3 gridpp::Interpolator::apply(const vec3& ivalues) const {
+    if(mToPoints)
+        throw std::invalid_argument("Interpolator was created for points. Use apply_points instead.");
+    int nTime = ivalues.size();
+    for(int t = 0; t < nTime; t++) {
+        if(!is_size(ivalues[t], mInputY, mInputX))
+            throw std::invalid_argument("Input values are not the same size as the input grid");
+    }
+
+    vec3 output(nTime);
+    for(int t = 0; t < nTime; t++) {
+        output[t].resize(mOutputY);
+        for(int y = 0; y < mOutputY; y++)
+            output[t][y].resize(mOutputX);
+    }
+
+    #pragma omp parallel for collapse(2)
+    for(int t = 0; t < nTime; t++) {
+        for(int y = 0; y < mOutputY; y++) {
+            for(int x = 0; x < mOutputX; x++) {
+                output[t][y][x] = calc(ivalues[t], y * mOutputX + x);
+            }
+        }
+    }
+    return output;
+}
+vec gridpp::Interpolator::apply_points(const vec2& ivalues) const {
+    if(!mToPoints)
+        throw std::invalid_argument("Interpolator was created for a grid. Use apply instead.");
+    if(!is_size(ivalues, mInputY, mInputX))
+        throw std::invalid_argument("Input values are not the same size as the input grid");
+
+    vec output(mOutputY);
+    #pragma omp parallel for
+    for(int i = 0; i < mOutputY; i++) {
+        output[i] = calc(ivalues, i);
+    }
+    return output;
+}
+vec2 gridpp::Interpolator::apply_points(const vec3& ivalues) const {
+    if(!mToPoints)
+        throw std::invalid_argument("Interpolator was created for a grid. Use apply instead.");
+    int nTime = ivalues.size();
+    for(int t = 0; t < nTime; t++) {
+        if(!is_size(ivalues[t], mInputY, mInputX))
+            throw std::invalid_argument("Input values are not the same size as the input grid");
+    }
+
+    vec2 output(nTime);
+    for(int t = 0; t < nTime; t++)
+        output[t].resize(mOutputY);
+
+    #pragma omp parallel for collapse(2)
+    for(int t = 0; t < nTime; t++) {
+        for(int i = 0; i < mOutputY; i++) {
+            output[t][i] = calc(ivalues[t], i);
+        }
+    }
+    return output;
+}
+vec2 gridpp::Interpolator::apply_full_gradient(const vec2& ivalues, const vec2& elev_gradient, const vec2& laf_gradient) const {
+    if(mToPoints)
+        throw std::invalid_argument("Interpolator was created for points. Use apply_full_gradient_points instead.");
+    if(!is_size(ivalues, mInputY, mInputX))
+        throw std::invalid_argument("Input values are not the same size as the input grid");
+    if(elev_gradient.size() > 0 && !is_size(elev_gradient, mInputY, mInputX))
+        throw std::invalid_argument("Elevation gradient is not the same size as the input grid");
+    if(laf_gradient.size() > 0 && !is_size(laf_gradient, mInputY, mInputX))
+        throw std::invalid_argument("Laf gradient is not the same size as the input grid");
+
+    vec2 output(mOutputY);
+    for(int y = 0; y < mOutputY; y++)
+        output[y].resize(mOutputX);
+
+    #pragma omp parallel for collapse(2)
+    for(int y = 0; y < mOutputY; y++) {
+        for(int x = 0; x < mOutputX; x++) {
+            output[y][x] = calc_full_gradient(ivalues, elev_gradient, laf_gradient, y * mOutputX + x);
+        }
+    }
+    return output;
+}
+vec3 gridpp::Interpolator::apply_full_gradient(const vec3& ivalues, const vec3& elev_gradient, const vec3& laf_gradient) const {
+    if(mToPoints)
+        throw std::invalid_argument("Interpolator was created for points. Use apply_full_gradient_points instead.");
+    int nTime = ivalues.size();
+    if(elev_gradient.size() > 0 && elev_gradient.size() != nTime)
+        throw std::invalid_argument("Elevation gradient does not have the same number of times as the values");
+    if(laf_gradient.size() > 0 && laf_gradient.size() != nTime)
+        throw std::invalid_argument("Laf gradient does not have the same number of times as the values");
+
+    vec3 output(nTime);
+    for(int t = 0; t < nTime; t++) {
+        output[t] = apply_full_gradient(ivalues[t], elev_gradient.size() > 0 ? elev_gradient[t] : vec2(),
+                laf_gradient.size() > 0 ? laf_gradient[t] : vec2());
+    }
+    return output;
+}
+vec gridpp::Interpolator::apply_full_gradient_points(const vec2& ivalues, const vec2& elev_gradient, const vec2& laf_gradient) const {
+    if(!mToPoints)
+        throw std::invalid_argument("Interpolator was created for a grid. Use apply_full_gradient instead.");
+    if(!is_size(ivalues, mInputY, mInputX))
+        throw std::invalid_argument("Input values are not the same size as the input grid");
+    if(elev_gradient.size() > 0 && !is_size(elev_gradient, mInputY, mInputX))
+        throw std::invalid_argument("Elevation gradient is not the same size as the input grid");
+    if(laf_gradient.size() > 0 && !is_size(laf_gradient, mInputY, mInputX))
+        throw std::invalid_argument("Laf gradient is not the same size as the input grid");
+
+    vec output(mOutputY);
+    #pragma omp parallel for
+    for(int i = 0; i < mOutputY; i++) {
+        output[i] = calc_full_gradient(ivalues, elev_gradient, laf_gradient, i);
+    }
+    return output;
+}
+vec2 gridpp::Interpolator::apply_full_gradient_points(const vec3& ivalues, const vec3& elev_gradient, const vec3& laf_gradient) const {
+    if(!mToPoints)
+        throw std::invalid_argument("Interpolator was created for a grid. Use apply_full_gradient instead.");
+    int nTime = ivalues.size();
+    if(elev_gradient.size() > 0 && elev_gradient.size() != nTime)
+        throw std::invalid_argument("Elevation gradient does not have the same number of times as the values");
+    if(laf_gradient.size() > 0 && laf_gradient.size() != nTime)
+        throw std::invalid_argument("Laf gradient does not have the same number of times as the values");
+
+    vec2 output(nTime);
+    for(int t = 0; t < nTime; t++) {
+        output[t] = apply_full_gradient_points(ivalues[t], elev_gradient.size() > 0 ? elev_gradient[t] : vec2(),
+                laf_gradient.size() > 0 ? laf_gradient[t] : vec2());
+    }
+    return output;
+}
+float gridpp::Interpolator::calc(const vec2& ivalues, int index) const {
+    int start = index * mNumWeights;
+    if(mRows[start] < 0)
+        return gridpp::MV;
+    if(mNumWeights == 1)
+        return ivalues[mRows[start]][mCols[start]];
+
+    float value = 0;
+    for(int k = start; k < start + mNumWeights; k++) {
+        float curr = ivalues[mRows[k]][mCols[k]];
+        if(!gridpp::is_valid(curr)) {
+            if(mNearestRows[index] < 0)
+                return gridpp::MV;
+            return ivalues[mNearestRows[index]][mNearestCols[index]];
+        }
+        value += mWeights[k] * curr;
+    }
+    return value;
+}
+float gridpp::Interpolator::calc_full_gradient(const vec2& ivalues, const vec2& elev_gradient, const vec2& laf_gradient, int index) const {
+    float value = calc(ivalues, index);
+    if(elev_gradient.size() > 0 && gridpp::is_valid(mElevDiffs[index]))
+        value += calc(elev_gradient, index) * mElevDiffs[index];
+    if(laf_gradient.size() > 0 && gridpp::is_valid(mLafDiffs[index]))
+        value += calc(laf_gradient, index) * mLafDiffs[index];
+    return value;
+}
+Downscaler gridpp::Interpolator::get_downscaler() const {
+    return mDownscaler;
+}
+ivec gridpp::Interpolator::get_input_size() const {
+    ivec size(2);
+    size[0] = mInputY;
+    size[1] = mInputX;
+    return size;
+}
+ivec gridpp::Interpolator::get_output_size() const {
+    if(mToPoints)
+        return ivec(1, mOutputY);
+    ivec size(2);
+    size[0] = mOutputY;
+    size[1] = mOutputX;
+    return size;
+}
+
+namespace {
+    template <class T> void write_value(std::ofstream& file, T value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    template <class T> void write_vector(std::ofstream& file, const std::vector<T>& values) {
+        write_value<long>(file, values.size());
+        if(values.size() > 0)
+            file.write(reinterpret_cast<const char*>(&values[0]), sizeof(T) * values.size());
+    }
+    template <class T> T read_value(std::ifstream& file) {
+        T value = 0;
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+    template <class T> void read_vector(std::ifstream& file, std::vector<T>& values) {
+        long N = read_value<long>(file);
+        if(!file.good() || N < 0)
+            throw std::runtime_error("Could not read interpolator file");
+        // Don't trust the size before checking that the file has that many values left
+        std::streampos pos = file.tellg();
+        file.seekg(0, std::ios::end);
+        long remaining = file.tellg() - pos;
+        file.seekg(pos);
+        if(!file.good() || N > remaining / long(sizeof(T)))
+            throw std::runtime_error("Could not read interpolator file");
+        values.resize(N);
+        if(N > 0)
+            file.read(reinterpret_cast<char*>(&values[0]), sizeof(T) * N);
+    }
+    bool is_valid_index(int row, int col, int Y, int X) {
+        return row >= 0 && row < Y && col >= 0 && col < X;
+    }
+    bool is_size(const vec2& values, int Y, int X) {
+        if(values.size() != Y)
+            return false;
+        for(int y = 0; y < Y; y++) {
+            if(values[y].size() != X)
+                return false;
+        }
+        return true;
+    }
+}
@@ -1,17 +1,153 @@
 #include "gridpp.h"
+#include <algorithm>
 
 using namespace gridpp;
 
+namespace {
+    /** Nodes with at most this many points are searched linearly */
+    const int leaf_size = 8;
+
+    struct compare_coordinate {
+        compare_coordinate(const vec& coords, int dim) : coords(coords), dim(dim) {};
+        bool operator()(int a, int b) const {
+            float ca = coords[3 * a + dim];
+            float cb = coords[3 * b + dim];
+            return ca < cb || (ca == cb && a < b);
+        }
+        const vec& coords;
+        int dim;
+    };
+}
+
 gridpp::KDTree::KDTree(vec lats, vec lons, CoordinateType type) {
     mLats = lats;
     mLons = lons;
     mType = type;
-    vec x, y, z;
+    build();
+}
+
+void gridpp::KDTree::build() {
+    int N = mLats.size();
+    vec coords(3 * N);
+    ivec order;
+    order.reserve(N);
+    for(int i = 0; i < N; i++) {
+        convert_coordinates(mLats[i], mLons[i], coords[3 * i], coords[3 * i + 1], coords[3 * i + 2]);
+        if(gridpp::is_valid(coords[3 * i]) && gridpp::is_valid(coords[3 * i + 1]) && gridpp::is_valid(coords[3 * i + 2]))
+            order.push_back(i);
+    }
+    int S = order.size();
+    mSplitDims.clear();
+    mSplitDims.resize(S, 0);
+    build(0, S, order, coords);
 
-    gridpp::KDTree::convert_coordinates(mLats, mLons, x, y, z);
-    for(int i = 0; i < mLats.size(); i++) {
-        point p(x[i], y[i], z[i]);
-        mTree.insert(std::make_pair(p, i));
+    // Store the coordinates in tree order, so that nodes are contiguous in memory
+    mIndices = order;
+    mCoords.resize(3 * S);
+    for(int i = 0; i < S; i++) {
+        for(int d = 0; d < 3; d++)
+            mCoords[3 * i + d] = coords[3 * order[i] + d];
+    }
+}
+
+void gridpp::KDTree::build(int start, int end, ivec& order, const vec& coords) {
+    if(end - start <= leaf_size)
+        return;
+
+    // Split along the dimension with the largest extent
+    float min[3];
+    float max[3];
+    for(int d = 0; d < 3; d++) {
+        min[d] = coords[3 * order[start] + d];
+        max[d] = min[d];
+    }
+    for(int i = start + 1; i < end; i++) {
+        for(int d = 0; d < 3; d++) {
+            float value = coords[3 * order[i] + d];
+            min[d] = std::min(min[d], value);
+            max[d] = std::max(max[d], value);
+        }
+    }
+    int dim = 0;
+    for(int d = 1; d < 3; d++) {
+        if(max[d] - min[d] > max[dim] - min[dim])
+            dim = d;
+    }
+
+    int mid = start + (end - start) / 2;
+    std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end, compare_coordinate(coords, dim));
+    mSplitDims[mid] = dim;
+    build(start, mid, order, coords);
+    build(mid + 1, end, order, coords);
+}
+
+void gridpp::KDTree::search_radius(int start, int end, const float* p, float radius, bool include_match, ivec& output) const {
+    if(end - start <= leaf_size) {
+        for(int i = start; i < end; i++) {
+            const float* q = &mCoords[3 * i];
+            // Only accept points strictly inside the bounding box of the circle, then check the
+            // distance. Points on the edge of the box are not accepted.
+            bool inside = true;
+            for(int d = 0; d < 3; d++) {
+                inside = inside && q[d] > p[d] - radius && q[d] < p[d] + radius;
+            }
+            if(!inside)
+                continue;
+            float dist = calc_distance(q[0], q[1], q[2], p[0], p[1], p[2]);
+            if(dist <= radius && (include_match || dist > 0))
+                output.push_back(mIndices[i]);
+        }
+        return;
+    }
+    int mid = start + (end - start) / 2;
+    int dim = mSplitDims[mid];
+    float split = mCoords[3 * mid + dim];
+    if(p[dim] - radius < split)
+        search_radius(start, mid, p, radius, include_match, output);
+    search_radius(mid, mid + 1, p, radius, include_match, output);
+    if(p[dim] + radius > split)
+        search_radius(mid + 1, end, p, radius, include_match, output);
+}
+
+void gridpp::KDTree::search_nearest(int start, int end, const float* p, int num, bool include_match, std::vector<candidate>& heap) const {
+    if(end - start <= leaf_size) {
+        for(int i = start; i < end; i++) {
+            const float* q = &mCoords[3 * i];
+            if(!include_match && q[0] == p[0] && q[1] == p[1] && q[2] == p[2])
+                continue;
+            float dx = q[0] - p[0];
+            float dy = q[1] - p[1];
+            float dz = q[2] - p[2];
+            candidate curr(dx * dx + dy * dy + dz * dz, mIndices[i]);
+            // The heap has the worst candidate at the front. Ties are broken by the lowest index.
+            if(heap.size() < num) {
+                heap.push_back(curr);
+                std::push_heap(heap.begin(), heap.end());
+            }
+            else if(curr < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = curr;
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+        return;
+    }
+    int mid = start + (end - start) / 2;
+    int dim = mSplitDims[mid];
+    float diff = p[dim] - mCoords[3 * mid + dim];
+
+    // Search the side containing the lookup-point first
+    if(diff < 0) {
+        search_nearest(start, mid, p, num, include_match, heap);
+        search_nearest(mid, mid + 1, p, num, include_match, heap);
+        if(heap.size() < num || diff * diff <= heap.front().first)
+            search_nearest(mid + 1, end, p, num, include_match, heap);
+    }
+    else {
+        search_nearest(mid + 1, end, p, num, include_match, heap);
+        search_nearest(mid, mid + 1, p, num, include_match, heap);
+        if(heap.size() < num || diff * diff <= heap.front().first)
+            search_nearest(start, mid, p, num, include_match, heap);
     }
 }
 
@@ -37,72 +173,96 @@ ivec gridpp::KDTree::get_neighbours_with_distance(float lat, float lon, float ra
 }
 
 ivec gridpp::KDTree::get_neighbours(float lat, float lon, float radius, bool include_match) const {
-    float x, y, z;
-    gridpp::KDTree::convert_coordinates(lat, lon, x, y, z);
-
-    std::vector<value> results;
-#if 1
-    point p(x, y, z);
-    box bx(point(x - radius, y - radius, z - radius), point(x + radius, y + radius, z + radius));
-    within_radius r(p, radius, include_match);
-
-    // NOTE: The boost::geometry::index::within predicate is extremely efficient at finding points
-    // within the box, whereas the within_radius predicate is slow since boost has to test all points.
-    // By including within_radius second in the && only when the within predicate evaluates to true
-    // will the within_radius predicate be evaluated. See #6e4d5ca for how to do this incorrectly.
-    mTree.query(boost::geometry::index::within(bx) && boost::geometry::index::satisfies(r), std::back_inserter(results));
-    int num = results.size();
-
-    ivec ret;
-    ret.reserve(num);
-    for(int i = 0; i < num; i++) {
-        ret.push_back(results[i].second);
-    }
-#else
-    // Alternative implementation that is roughly the same speed
-    box bx(point(x - radius, y - radius, z - radius), point(x + radius, y + radius, z + radius));
-    mTree.query(boost::geometry::index::within(bx), std::back_inserter(results));
-    int num = results.size();
+    float p[3];
+    gridpp::KDTree::convert_coordinates(lat, lon, p[0], p[1], p[2]);
 
     ivec ret;
-    ret.reserve(num);
-    for(int i = 0; i < num; i++) {
-        float x1, y1, z1;
-        gridpp::KDTree::convert_coordinates(mLats[results[i].second], mLons[results[i].second], x1, y1, z1);
-        float dist = gridpp::KDTree::calc_distance(x, y, z, x1, y1, z1);
-        if(dist <= radius) {
-            if(include_match || dist != 0)
-                ret.push_back(results[i].second);
-        }
-    }
-#endif
+    search_radius(0, mIndices.size(), p, radius, include_match, ret);
+    std::sort(ret.begin(), ret.end());
     return ret;
 }
 
 ivec gridpp::KDTree::get_closest_neighbours(float lat, float lon, int num, bool include_match) const {
-    float x, y, z;
-    gridpp::KDTree::convert_coordinates(lat, lon, x, y, z);
-    point p(x, y, z);
+    float p[3];
+    gridpp::KDTree::convert_coordinates(lat, lon, p[0], p[1], p[2]);
 
-    std::vector<value> results;
-    if(!include_match) {
-        is_not_equal s(p);
-        mTree.query(boost::geometry::index::nearest(p, num) && boost::geometry::index::satisfies(s), std::back_inserter(results));
-    }
-    else {
-        mTree.query(boost::geometry::index::nearest(p, num), std::back_inserter(results));
+    std::vector<candidate> heap;
+    if(num > 0) {
+        heap.reserve(num);
+        search_nearest(0, mIndices.size(), p, num, include_match, heap);
     }
-    int num_found = results.size();
+    std::sort_heap(heap.begin(), heap.end());
 
-    ivec ret;
-    ret.reserve(num);
-    for(int i = 0; i < num_found; i++) {
-        ret.push_back(results[i].second);
+    ivec ret(heap.size());
+    for(int i = 0; i < heap.size(); i++) {
+        ret[i] = heap[i].second;
     }
     return ret;
 }
 int gridpp::KDTree::get_nearest_neighbour(float lat, float lon, bool include_match) const {
-    return get_closest_neighbours(lat, lon, 1, include_match)[0];
+    ivec I = get_closest_neighbours(lat, lon, 1, include_match);
+    if(I.size() > 0)
+        return I[0];
+    else
+        return -1;
+}
+void gridpp::KDTree::get_nearest_neighbours(const vec& lats, const vec& lons, ivec& output, bool include_match) const {
+    if(lats.size() != lons.size())
+        throw std::invalid_argument("Cannot look up points with unequal lat and lon sizes");
+    int N = lats.size();
+    output.clear();
+    output.resize(N, -1);
+
+    #pragma omp parallel
+    {
+        std::vector<candidate> heap;
+        heap.reserve(1);
+        #pragma omp for
+        for(int i = 0; i < N; i++) {
+            float p[3];
+            convert_coordinates(lats[i], lons[i], p[0], p[1], p[2]);
+            heap.clear();
+            search_nearest(0, mIndices.size(), p, 1, include_match, heap);
+            if(heap.size() > 0)
+                output[i] = heap[0].second;
+        }
+    }
+}
+void gridpp::KDTree::get_neighbours(const vec& lats, const vec& lons, float radius, ivec& offsets, ivec& indices, bool include_match) const {
+    if(lats.size() != lons.size())
+        throw std::invalid_argument("Cannot look up points with unequal lat and lon sizes");
+    int N = lats.size();
+    offsets.clear();
+    offsets.resize(N + 1, 0);
+    indices.clear();
+
+    // Search each lookup-point once. Each thread appends the neighbours of a contiguous block of
+    // lookup-points to its own buffer, which is copied into place once the offsets are known.
+    #pragma omp parallel
+    {
+        ivec found;
+        int first = -1;
+        #pragma omp for schedule(static)
+        for(int i = 0; i < N; i++) {
+            if(first < 0)
+                first = i;
+            float p[3];
+            convert_coordinates(lats[i], lons[i], p[0], p[1], p[2]);
+            size_t start = found.size();
+            search_radius(0, mIndices.size(), p, radius, include_match, found);
+            std::sort(found.begin() + start, found.end());
+            offsets[i + 1] = found.size() - start;
+        }
+        #pragma omp single
+        {
+            for(int i = 0; i < N; i++) {
+                offsets[i + 1] += offsets[i];
+            }
+            indices.resize(offsets[N]);
+        }
+        if(first >= 0)
+            std::copy(found.begin(), found.end(), indices.begin() + offsets[first]);
+    }
 }
 bool gridpp::KDTree::convert_coordinates(const vec& lats, const vec& lons, vec& x_coords, vec& y_coords, vec& z_coords) const {
     int N = lats.size();
@@ -206,43 +366,17 @@ CoordinateType gridpp::KDTree::get_coordinate_type() const {
 gridpp::KDTree& gridpp::KDTree::operator=(gridpp::KDTree other) {
     std::swap(mLats, other.mLats);
     std::swap(mLons, other.mLons);
-    std::swap(mTree, other.mTree);
     std::swap(mType, other.mType);
+    std::swap(mCoords, other.mCoords);
+    std::swap(mIndices, other.mIndices);
+    std::swap(mSplitDims, other.mSplitDims);
     return *this;
 }
 gridpp::KDTree::KDTree(const gridpp::KDTree& other) {
     mLats = other.mLats;
     mLons = other.mLons;
-    mTree = other.mTree;
     mType = other.mType;
-}
-gridpp::KDTree::within_radius::within_radius(point p, float radius, bool include_match)  {
-    this->p = p;
-    this->radius = radius;
-    this->include_match = include_match;
-}
-
-bool gridpp::KDTree::within_radius::operator()(value const& v) const {
-    float x0 = v.first.get<0>();
-    float y0 = v.first.get<1>();
-    float z0 = v.first.get<2>();
-    float x1 = p.get<0>();
-    float y1 = p.get<1>();
-    float z1 = p.get<2>();
-    if(include_match)
-        return gridpp::KDTree::calc_distance(x0, y0, z0, x1, y1, z1) <= radius;
-    else {
-        float dist = gridpp::KDTree::calc_distance(x0, y0, z0, x1, y1, z1);
-        return dist <= radius && dist > 0;
-    }
-}
-gridpp::KDTree::is_not_equal::is_not_equal(point p)  {
-    this->p = p;
-}
-
-bool gridpp::KDTree::is_not_equal::operator()(value const& v) const {
-    float x0 = v.first.get<0>();
-    float y0 = v.first.get<1>();
-    float z0 = v.first.get<2>();
-    return p.get<0>() != x0 || p.get<1>() != y0 || p.get<2>() != z0;
+    mCoords = other.mCoords;
+    mIndices = other.mIndices;
+    mSplitDims = other.mSplitDims;
 }
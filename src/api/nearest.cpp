@@ -13,6 +13,9 @@ vec2 gridpp::nearest(const Grid& igrid, const Grid& ogrid, const vec2& ivalues)
     int nLat = iOutputLats.size();
     int nLon = iOutputLats[0].size();
 
+    ivec I, J;
+    igrid.get_nearest_neighbours(Field2D(iOutputLats).values(), Field2D(iOutputLons).values(), I, J);
+
     vec2 output(nLat);
     for(int i = 0; i < nLat; i++)
         output[i].resize(nLon);
@@ -20,10 +23,12 @@ vec2 gridpp::nearest(const Grid& igrid, const Grid& ogrid, const vec2& ivalues)
     #pragma omp parallel for collapse(2)
     for(int i = 0; i < nLat; i++) {
         for(int j = 0; j < nLon; j++) {
-            ivec indices = igrid.get_nearest_neighbour(iOutputLats[i][j], iOutputLons[i][j]);
-            int I = indices[0];
-            int J = indices[1];
-            output[i][j] = ivalues[I][J];
+            int index = i * nLon + j;
+            // The nearest neighbour search returns -1 when the grid has no valid points
+            if(I[index] < 0)
+                output[i][j] = gridpp::MV;
+            else
+                output[i][j] = ivalues[I[index]][J[index]];
         }
     }
     return output;
@@ -42,20 +47,8 @@ vec3 gridpp::nearest(const Grid& igrid, const Grid& ogrid, const vec3& ivalues)
 
     // Fetch the nearest neighbours first, because we do not want time to be the inner loop. For
     // large number of times, the memory access gets slow when time is the inner loop.
-    ivec2 I(nLat);
-    ivec2 J(nLat);
-    for(int i = 0; i < nLat; i++) {
-        I[i].resize(nLon);
-        J[i].resize(nLon);
-    }
-    #pragma omp parallel for collapse(2)
-    for(int i = 0; i < nLat; i++) {
-        for(int j = 0; j < nLon; j++) {
-            ivec indices = igrid.get_nearest_neighbour(iOutputLats[i][j], iOutputLons[i][j]);
-            I[i][j] = indices[0];
-            J[i][j] = indices[1];
-        }
-    }
+    ivec I, J;
+    igrid.get_nearest_neighbours(Field2D(iOutputLats).values(), Field2D(iOutputLons).values(), I, J);
 
     for(int t = 0; t < nTime; t++) {
         output[t].resize(nLat);
@@ -67,9 +60,11 @@ vec3 gridpp::nearest(const Grid& igrid, const Grid& ogrid, const vec3& ivalues)
     for(int t = 0; t < nTime; t++) {
         for(int i = 0; i < nLat; i++) {
             for(int j = 0; j < nLon; j++) {
-                int II = I[i][j];
-                int JJ = J[i][j];
-                output[t][i][j] = ivalues[t][II][JJ];
+                int index = i * nLon + j;
+                if(I[index] < 0)
+                    output[t][i][j] = gridpp::MV;
+                else
+                    output[t][i][j] = ivalues[t][I[index]][J[index]];
             }
         }
     }
@@ -85,6 +80,9 @@ vec2 gridpp::nearest(const Points& ipoints, const Grid& ogrid, const vec& ivalue
     int nLat = iOutputLats.size();
     int nLon = iOutputLats[0].size();
 
+    ivec I;
+    ipoints.get_nearest_neighbours(Field2D(iOutputLats).values(), Field2D(iOutputLons).values(), I);
+
     vec2 output(nLat);
     for(int i = 0; i < nLat; i++)
         output[i].resize(nLon);
@@ -92,8 +90,8 @@ vec2 gridpp::nearest(const Points& ipoints, const Grid& ogrid, const vec& ivalue
     #pragma omp parallel for collapse(2)
     for(int i = 0; i < nLat; i++) {
         for(int j = 0; j < nLon; j++) {
-            int index = ipoints.get_nearest_neighbour(iOutputLats[i][j], iOutputLons[i][j]);
-            output[i][j] = ivalues[index];
+            int index = I[i * nLon + j];
+            output[i][j] = index < 0 ? gridpp::MV : ivalues[index];
         }
     }
     return output;
@@ -118,12 +116,15 @@ vec3 gridpp::nearest(const Points& ipoints, const Grid& ogrid, const vec2& ivalu
             output[t][i].resize(nLon);
     }
 
+    ivec I;
+    ipoints.get_nearest_neighbours(Field2D(iOutputLats).values(), Field2D(iOutputLons).values(), I);
+
     #pragma omp parallel for collapse(2)
     for(int i = 0; i < nLat; i++) {
         for(int j = 0; j < nLon; j++) {
-            int index = ipoints.get_nearest_neighbour(iOutputLats[i][j], iOutputLons[i][j]);
+            int index = I[i * nLon + j];
             for(int t = 0; t < nTime; t++) {
-                output[t][i][j] = ivalues[t][index];
+                output[t][i][j] = index < 0 ? gridpp::MV : ivalues[t][index];
             }
         }
     }
@@ -138,14 +139,14 @@ vec gridpp::nearest(const Grid& igrid, const Points& opoints, const vec2& ivalue
 
     int nPoints = iOutputLats.size();
 
+    ivec I, J;
+    igrid.get_nearest_neighbours(iOutputLats, iOutputLons, I, J);
+
     vec output(nPoints);
 
     #pragma omp parallel for
     for(int i = 0; i < nPoints; i++) {
-        ivec indices = igrid.get_nearest_neighbour(iOutputLats[i], iOutputLons[i]);
-        int I = indices[0];
-        int J = indices[1];
-        output[i] = ivalues[I][J];
+        output[i] = I[i] < 0 ? gridpp::MV : ivalues[I[i]][J[i]];
     }
     return output;
 }
@@ -160,14 +161,8 @@ vec2 gridpp::nearest(const Grid& igrid, const Points& opoints, const vec3& ivalu
 
     // Fetch the nearest neighbours first, because we do not want time to be the inner loop. For
     // large number of times, the memory access gets slow when time is the inner loop.
-    ivec I(nPoints);
-    ivec J(nPoints);
-    #pragma omp parallel for
-    for(int i = 0; i < nPoints; i++) {
-        ivec indices = igrid.get_nearest_neighbour(iOutputLats[i], iOutputLons[i]);
-        I[i] = indices[0];
-        J[i] = indices[1];
-    }
+    ivec I, J;
+    igrid.get_nearest_neighbours(iOutputLats, iOutputLons, I, J);
 
     vec2 output(nTime);
     for(int t = 0; t < nTime; t++) {
@@ -177,7 +172,8 @@ vec2 gridpp::nearest(const Grid& igrid, const Points& opoints, const vec3& ivalu
     #pragma omp parallel for collapse(2)
     for(int t = 0; t < nTime; t++) {
         for(int i = 0; i < nPoints; i++) {
-            output[t][i] = ivalues[t][I[i]][J[i]];
+            if(I[i] >= 0)
+                output[t][i] = ivalues[t][I[i]][J[i]];
         }
     }
     return output;
@@ -190,12 +186,14 @@ vec gridpp::nearest(const Points& ipoints, const Points& opoints, const vec& iva
 
     int nPoints = iOutputLats.size();
 
+    ivec I;
+    ipoints.get_nearest_neighbours(iOutputLats, iOutputLons, I);
+
     vec output(nPoints);
 
     #pragma omp parallel for
     for(int i = 0; i < nPoints; i++) {
-        int index = ipoints.get_nearest_neighbour(iOutputLats[i], iOutputLons[i]);
-        output[i] = ivalues[index];
+        output[i] = I[i] < 0 ? gridpp::MV : ivalues[I[i]];
     }
     return output;
 }
@@ -216,11 +214,15 @@ vec2 gridpp::nearest(const Points& ipoints, const Points& opoints, const vec2& i
         output[t].resize(nPoints, gridpp::MV);
     }
 
+    ivec I;
+    ipoints.get_nearest_neighbours(iOutputLats, iOutputLons, I);
+
     #pragma omp parallel for
     for(int i = 0; i < nPoints; i++) {
-        int index = ipoints.get_nearest_neighbour(iOutputLats[i], iOutputLons[i]);
+        if(I[i] < 0)
+            continue;
         for(int t = 0; t < nTime; t++) {
-            output[t][i] = ivalues[t][index];
+            output[t][i] = ivalues[t][I[i]];
         }
     }
     return output;
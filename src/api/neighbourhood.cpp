@@ -1,6 +1,9 @@
 #include "gridpp.h"
 #include <exception>
 #include <iostream>
+#include <limits>
+#include <algorithm>
+#include <utility>
 
 using namespace gridpp;
 
@@ -8,22 +11,69 @@ namespace {
     vec2 neighbourhood_brute_force(const vec2& input, int halfwidth, gridpp::Statistic statistic, float quantile);
     vec2 neighbourhood_brute_force(const vec3& input, int halfwidth, gridpp::Statistic statistic, float quantile);
     vec3 vec2_to_vec3(const vec2& input);
+    /** Computes a neighbourhood statistic of a 2D field. This is a template over vec2 and Field2D,
+      * so that both inputs are read in place instead of being copied to the other type. Assumes the
+      * arguments have already been checked and that the field is not empty. */
+    template<class T> Field2D neighbourhood_2d(const T& input, int halfwidth, gridpp::Statistic statistic);
+    /** Computes a neighbourhood statistic of an ensemble, by first reducing the members of each
+      * gridpoint with the same statistic. Shared by the vec3 and View3 overloads, which differ only
+      * in how the members are read. Assumes that the input is not empty. */
+    template<class T> Field2D neighbourhood_ensemble(const T& input, int halfwidth, gridpp::Statistic statistic);
+    /** Reduces the members of each gridpoint. Assumes that the statistic is supported. */
+    Field2D reduce_members(const vec3& input, gridpp::Statistic statistic);
+    Field2D reduce_members(const View3& input, gridpp::Statistic statistic);
+    /** Access to the inputs of neighbourhood_2d */
+    int get_size_y(const vec2& input);
+    int get_size_x(const vec2& input);
+    const float* get_row(const vec2& input, int y);
+    bool has_missing(const vec2& input);
+    const vec2& to_vec2(const vec2& input);
+    int get_size_y(const Field2D& input);
+    int get_size_x(const Field2D& input);
+    const float* get_row(const Field2D& input, int y);
+    bool has_missing(const Field2D& input);
+    vec2 to_vec2(const Field2D& input);
+    /** Compute the min or max in a sliding window of 2 * halfwidth + 1 values using the van
+      * Herk/Gil-Werman algorithm, which needs 3 comparisons per value independent of the window
+      * size. Processes num_lanes independent lines at once: element k of lane l is at
+      * input[k * stride + l], with the same layout for output. Missing values are ignored. The
+      * buffers f, g, h are used as scratch space.
+      * @param missing_output If true, windows without valid values are set to MV, otherwise to -inf (max)
+      * or inf (min)
+      * @param all_valid True if the input has no missing values, which skips the validity tests
+     */
+    void sliding_extreme(const float* input, float* output, int n, int num_lanes, long stride,
+            int halfwidth, bool is_max, bool missing_output, bool all_valid, vec& f, vec& g, vec& h);
+    /** Exact neighbourhood quantile, pooling all members of the ensemble dimension. The window is
+      * slid along each row, while keeping a count of how many times each distinct value is inside
+      * the window in a Fenwick tree. The cost per gridpoint is proportional to the width of the
+      * window, instead of its area. Gives the same result as calc_quantile on each window. */
+    Field2D neighbourhood_quantile_sliding(const Field3D& input, float quantile, int halfwidth);
+    /** Computes neighbourhood_quantile_fast for all thresholds in one pass. The fraction of members
+      * below each threshold is accumulated for each column of the neighbourhood while sliding down
+      * a band of rows, so that memory use does not grow with the number of thresholds times the
+      * size of the field. Assumes the arguments have already been checked. */
+    vec2 neighbourhood_quantile_fast_single_pass(const Field3D& input, const vec2& quantile, int halfwidth, const vec& thresholds);
 }
 vec2 gridpp::neighbourhood(const vec3& input, int halfwidth, gridpp::Statistic statistic) {
-    vec2 flat(input.size());
-    int Y = input.size();
-    int X = input[0].size();
-    int E = input[0][0].size();
-    for(int y = 0; y < Y; y++) {
-        flat[y].resize(X, 0);
-    }
-    for(int y = 0; y < Y; y++) {
-        for(int x = 0; x < X; x++) {
-            flat[y][x] = gridpp::calc_statistic(input[y][x], statistic);
-        }
-    }
-    vec2 results = neighbourhood(flat, halfwidth, statistic);
-    return results;
+    if(halfwidth < 0)
+        throw std::invalid_argument("Half width must be > 0");
+    if(statistic == gridpp::Quantile)
+        throw std::invalid_argument("Use neighbourhood_quantile for computing neighbourhood quantiles");
+    if(input.size() == 0 || input[0].size() == 0 || input[0][0].size() == 0)
+        return vec2();
+
+    return ::neighbourhood_ensemble(input, halfwidth, statistic).to_vec2();
+}
+Field2D gridpp::neighbourhood(const View3& input, int halfwidth, gridpp::Statistic statistic) {
+    if(halfwidth < 0)
+        throw std::invalid_argument("Half width must be > 0");
+    if(statistic == gridpp::Quantile)
+        throw std::invalid_argument("Use neighbourhood_quantile for computing neighbourhood quantiles");
+    if(input.size_y() == 0 || input.size_x() == 0 || input.size_e() == 0)
+        return Field2D();
+
+    return ::neighbourhood_ensemble(input, halfwidth, statistic);
 }
 vec2 gridpp::neighbourhood(const vec2& input, int halfwidth, gridpp::Statistic statistic) {
     if(halfwidth < 0)
@@ -32,213 +82,22 @@ vec2 gridpp::neighbourhood(const vec2& input, int halfwidth, gridpp::Statistic s
         throw std::invalid_argument("Use neighbourhood_quantile for computing neighbourhood quantiles");
     if(input.size() == 0 || input[0].size() == 0)
         return vec2();
-
-    double s_time = gridpp::clock();
-    bool fast = true;
-    int count_stat = 0;
-    int nY = input.size();
-    int nX = input[0].size();
-    vec2 output(nY);
-    for(int y = 0; y < nY; y++) {
-        output[y].resize(nX, gridpp::MV);
+    for(int y = 1; y < input.size(); y++) {
+        if(input[y].size() != input[0].size())
+            throw std::invalid_argument("All rows of the input must have the same length");
     }
-    if(statistic == gridpp::Mean || statistic == gridpp::Sum || statistic == gridpp::Count) {
-        dvec2 values;
-        ivec2 counts;
-        values.resize(nY);
-        counts.resize(nY);
-        for(int i = 0; i < nY; i++) {
-            values[i].resize(nX, 0);
-            counts[i].resize(nX, 0);
-        }
-        // Compute accumulated values
-        for(int i = 0; i < nY; i++) {
-            for(int j = 0; j < nX; j++) {
-                float value = input[i][j];
-                if(j == 0 && i == 0) {
-                    // Lower corner
-                    if(gridpp::is_valid(value)) {
-                        values[i][j] = value;
-                        counts[i][j] = 1;
-                    }
-                }
-                else if(j == 0) {
-                    // Lower row
-                    if(gridpp::is_valid(value)) {
-                        values[i][j] = values[i-1][j] + value;
-                        counts[i][j] = counts[i-1][j] + 1;
-                    }
-                    else {
-                        values[i][j] = values[i-1][j];
-                        counts[i][j] = counts[i-1][j];
-                    }
-                }
-                else if(i == 0) {
-                    // Left column
-                    if(gridpp::is_valid(value)) {
-                        values[i][j] = values[i][j-1] + value;
-                        counts[i][j] = counts[i][j-1] + 1;
-                    }
-                    else {
-                        values[i][j] = values[i][j-1];
-                        counts[i][j] = counts[i][j-1];
-                    }
 
-                }
-                else {
-                    if(gridpp::is_valid(value)) {
-                        values[i][j] = values[i][j-1] + values[i-1][j] - values[i-1][j-1] + value;
-                        counts[i][j] = counts[i][j-1] + counts[i-1][j] - counts[i-1][j-1] + 1;
-                    }
-                    else {
-                        values[i][j] = values[i][j-1] + values[i-1][j] - values[i-1][j-1];
-                        counts[i][j] = counts[i][j-1] + counts[i-1][j] - counts[i-1][j-1];
-                    }
-                }
-            }
-        }
-        // Put neighbourhood into vector
-        #pragma omp parallel for
-        for(int i = 0; i < nY; i++) {
-            for(int j = 0; j < nX; j++) {
-                int i1 = std::min(nY-1, i + halfwidth);
-                int j1 = std::min(nX-1, j + halfwidth);
-                int i0 = i - halfwidth - 1;
-                int j0 = j - halfwidth - 1;
-                double value11 = values[i1][j1];
-                double value00 = 0;
-                double value10 = 0;
-                double value01 = 0;
-                int count11 = counts[i1][j1];
-                int count00 = 0;
-                int count10 = 0;
-                int count01 = 0;
-                if(i0 >= 0 && j0 >= 0) {
-                    value00 = values[i0][j0];
-                    value10 = values[i1][j0];
-                    value01 = values[i0][j1];
-                    count00 = counts[i0][j0];
-                    count10 = counts[i1][j0];
-                    count01 = counts[i0][j1];
-                }
-                else if(j0 >= 0) {
-                    value10 = values[i1][j0];
-                    count10 = counts[i1][j0];
-                }
-                else if(i0 >= 0) {
-                    value01 = values[i0][j1];
-                    count01 = counts[i0][j1];
-                }
-                double value = value11 + value00 - value10 - value01;
-                int count = count11 + count00 - count10 - count01;
-                if(statistic == gridpp::Count) {
-                    output[i][j] = count;
-                }
-                else if(count > 0) {
-                    if(statistic == gridpp::Mean) {
-                        value /= count;
-                    }
-                    output[i][j] = value;
-                }
-            }
-        }
-    }
-    else if(statistic == gridpp::Min || statistic == gridpp::Max) {
-        // Compute min/max quickly or any other quantile in a faster, but approximate way
-        vec2 values;
-        values.resize(nY);
-        for(int i = 0; i < nY; i++) {
-            values[i].resize(nX, 0);
-        }
-        #pragma omp parallel for
-        for(int i = 0; i < nY; i++) {
-            if(i < halfwidth || i >= nY - halfwidth) {
-                // Regular way
-                for(int j = 0; j < nX; j++) {
-                    // Put neighbourhood into vector
-                    vec neighbourhood;
-                    int Ni = std::min(nY-1, i+halfwidth) - std::max(0, i-halfwidth) + 1;
-                    int Nj = std::min(nX-1, j+halfwidth) - std::max(0, j-halfwidth) + 1;
-                    assert(Ni > 0);
-                    assert(Nj > 0);
-                    neighbourhood.reserve(Ni*Nj);
-                    int index = 0;
-                    for(int ii = std::max(0, i-halfwidth); ii <= std::min(nY-1, i+halfwidth); ii++) {
-                        for(int jj = std::max(0, j-halfwidth); jj <= std::min(nX-1, j+halfwidth); jj++) {
-                            float value = input[ii][jj];
-                            if(gridpp::is_valid(value)) {
-                                assert(index < Ni*Nj);
-                                neighbourhood.push_back(value);
-                                index++;
-                            }
-                        }
-                    }
-                    values[i][j] = gridpp::calc_statistic(neighbourhood, statistic);
-                    count_stat += neighbourhood.size();
-                }
-            }
-            else {
-                // Fast way: Compute stats on each sliver
-                vec slivers(nX, 0);
-                for(int j = 0; j < nX; j++) {
-                    vec sliver(2*halfwidth+1, 0);
-                    int count = 0;
-                    for(int ii = i - halfwidth; ii <= i + halfwidth; ii++) {
-                        sliver[count] = input[ii][j];
-                        count++;
-                    }
-                    slivers[j] = gridpp::calc_statistic(sliver, statistic);
-                    count_stat += sliver.size();
-                }
-                for(int j = 0; j < nX; j++) {
-                    vec curr;
-                    curr.reserve(2*halfwidth);
-                    for(int jj = std::max(0, j - halfwidth); jj <= std::min(nX-1, j + halfwidth); jj++) {
-                        curr.push_back(slivers[jj]);
-                    }
-                    values[i][j] = gridpp::calc_statistic(curr, statistic);
-                    count_stat += curr.size();
-                }
-            }
-        }
-        #pragma omp parallel for
-        for(int i = 0; i < nY; i++) {
-            for(int j = 0; j < nX; j++) {
-                output[i][j] = values[i][j];
-            }
-        }
-    }
-    else if(statistic == gridpp::Std || statistic == gridpp::Variance) {
-        vec2 mean = gridpp::neighbourhood(input, halfwidth, gridpp::Mean);
-        vec2 input2(nY);
-        for(int y = 0; y < nY; y++) {
-            input2[y].resize(input[y].size(), 0);
-            for(int x = 0; x < nX; x++) {
-                input2[y][x] = input[y][x] * input[y][x];
-            }
-        }
-        vec2 mean2 = gridpp::neighbourhood(input2, halfwidth, gridpp::Mean);
-        if(statistic == gridpp::Std) {
-            for(int y = 0; y < nY; y++) {
-                for(int x = 0; x < nX; x++) {
-                    output[y][x] = sqrt(mean2[y][x] - mean[y][x] * mean[y][x]);
-                }
-            }
-        }
-        else {
-            for(int y = 0; y < nY; y++) {
-                for(int x = 0; x < nX; x++) {
-                    output[y][x] = mean2[y][x] - mean[y][x] * mean[y][x];
-                }
-            }
-        }
-    }
-    else {
-        output = gridpp::neighbourhood_brute_force(input, halfwidth, statistic);
-    }
-    double e_time = gridpp::clock() ;
-    // std::cout << count_stat << " " << e_time - s_time << " s" << std::endl;
-    return output;
+    return ::neighbourhood_2d(input, halfwidth, statistic).to_vec2();
+}
+Field2D gridpp::neighbourhood(const Field2D& input, int halfwidth, gridpp::Statistic statistic) {
+    if(halfwidth < 0)
+        throw std::invalid_argument("Half width must be > 0");
+    if(statistic == gridpp::Quantile)
+        throw std::invalid_argument("Use neighbourhood_quantile for computing neighbourhood quantiles");
+    if(input.size_y() == 0 || input.size_x() == 0)
+        return Field2D();
+
+    return ::neighbourhood_2d(input, halfwidth, statistic);
 }
 vec gridpp::get_neighbourhood_thresholds(const vec2& input, int num_thresholds) {
     if(num_thresholds <= 0)
@@ -321,91 +180,8 @@ vec2 gridpp::neighbourhood_quantile_fast(const vec2& input, const vec2& quantile
         }
     }
 
-    double s_time = gridpp::clock();
-
-    vec2 output(nY);
-    for(int y = 0; y < nY; y++) {
-        output[y].resize(nX, gridpp::MV);
-    }
-    if(thresholds.size() == 0)
-        return output;
-
-    // Compute neighbourhood means for each threshold
-    vec3 stats(thresholds.size());
-    for(int t = 0; t < thresholds.size(); t++) {
-        stats[t].resize(nY);
-    }
-
-    #pragma omp parallel for
-    for(int t = 0; t < thresholds.size(); t++) {
-        vec2 temp(nY);
-        for(int y = 0; y < nY; y++) {
-            temp[y].resize(nX, gridpp::MV);
-            for(int x = 0; x < nX; x++) {
-                int sum = 0;
-                int count = 0;
-                if(gridpp::is_valid(input[y][x])) {
-                    if(input[y][x] <= thresholds[t]) {
-                        sum++;
-                    }
-                    count++;
-                }
-                if(count > 0)
-                    temp[y][x] = float(sum) / count;
-            }
-        }
-        stats[t] = gridpp::neighbourhood(temp, halfwidth, gridpp::Mean);
-    }
-
-    const bool is_fixed_quantile = quantile.size() == 1 && quantile[0].size() == 1;
-    float fixed_quantile = gridpp::MV;
-    if(is_fixed_quantile)
-        fixed_quantile = quantile[0][0];
-
-    float curr_quantile = gridpp::MV;
-
-    #pragma omp parallel for
-    for(int y = 0; y < nY; y++) {
-        for(int x = 0; x < nX; x++) {
-            if(is_fixed_quantile)
-                curr_quantile = fixed_quantile;
-            else
-                curr_quantile = quantile[y][x];
-            vec yarray(thresholds.size(), gridpp::MV);
-            bool is_missing = false;
-            for(int t = 0; t < thresholds.size(); t++) {
-                float sum = 0;
-                int count = 0;
-                if(gridpp::is_valid(stats[t][y][x])) {
-                    sum = stats[t][y][x];
-                    count++;
-                }
-                if(count > 0) {
-                    yarray[t] = sum / count;
-                    // Small floating point errors can occur in neighbourhood. Force values to be
-                    // within [0, 1]
-                    if(yarray[t] > 1)
-                        yarray[t] = 1;
-                    else if(yarray[t] < 0)
-                        yarray[t] = 0;
-                }
-                else
-                    is_missing = true;
-            }
-            if(!is_missing) {
-                if(curr_quantile == 1 && yarray[0] == 1)
-                    output[y][x] = thresholds[0];
-                else if(curr_quantile == 0 && yarray[yarray.size() - 1] == 0)
-                    output[y][x] = thresholds[thresholds.size() - 1];
-                else
-                    output[y][x] = gridpp::interpolate(curr_quantile, yarray, thresholds);
-            }
-        }
-    }
-
-    double e_time = gridpp::clock() ;
-    // std::cout << e_time - s_time << " s" << std::endl;
-    return output;
+    Field2D field(input);
+    return ::neighbourhood_quantile_fast_single_pass(Field3D(nY, nX, 1, std::move(field.values())), quantile, halfwidth, thresholds);
 }
 
 vec2 gridpp::neighbourhood_quantile_fast(const vec3& input, float quantile, int halfwidth, const vec& thresholds) {
@@ -420,10 +196,8 @@ vec2 gridpp::neighbourhood_quantile_fast(const vec3& input, const vec2& quantile
 
     if(input.size() == 0 || input[0].size() == 0 || input[0][0].size() == 0)
         return vec2();
-    double s_time = gridpp::clock();
     int nY = input.size();
     int nX = input[0].size();
-    int nE = input[0][0].size();
 
     if(!(quantile.size() == 1 && quantile[0].size() == 1) && !(quantile.size() == nY && quantile[0].size() == nX))
         throw std::invalid_argument("Quantile must have the same Y, X size as input, or have size (1, 1)");
@@ -437,93 +211,7 @@ vec2 gridpp::neighbourhood_quantile_fast(const vec3& input, const vec2& quantile
         }
     }
 
-    vec2 output(nY);
-    for(int y = 0; y < nY; y++) {
-        output[y].resize(nX, gridpp::MV);
-    }
-    if(thresholds.size() == 0)
-        return output;
-
-    // Compute neighbourhood means for each threshold
-    vec3 stats(thresholds.size());
-    for(int t = 0; t < thresholds.size(); t++) {
-        stats[t].resize(nY);
-    }
-
-    #pragma omp parallel for
-    for(int t = 0; t < thresholds.size(); t++) {
-        vec2 temp(nY);
-        for(int y = 0; y < nY; y++) {
-            temp[y].resize(nX, gridpp::MV);
-            for(int x = 0; x < nX; x++) {
-                int sum = 0;
-                int count = 0;
-                for(int e = 0; e < nE; e++) {
-                    if(gridpp::is_valid(input[y][x][e])) {
-                        if(input[y][x][e] <= thresholds[t]) {
-                            sum++;
-                        }
-                        count++;
-                    }
-                }
-                if(count > 0)
-                    temp[y][x] = float(sum) / count;
-            }
-        }
-        stats[t] = gridpp::neighbourhood(temp, halfwidth, gridpp::Mean);
-    }
-
-    const bool is_fixed_quantile = quantile.size() == 1 && quantile[0].size() == 1;
-    float fixed_quantile = gridpp::MV;
-    if(is_fixed_quantile)
-        fixed_quantile = quantile[0][0];
-
-    float curr_quantile = gridpp::MV;
-
-    #pragma omp parallel for
-    for(int y = 0; y < nY; y++) {
-        for(int x = 0; x < nX; x++) {
-            if(is_fixed_quantile)
-                curr_quantile = fixed_quantile;
-            else
-                curr_quantile = quantile[y][x];
-            vec yarray(thresholds.size(), gridpp::MV);
-            bool is_missing = false;
-            for(int t = 0; t < thresholds.size(); t++) {
-                float sum = 0;
-                int count = 0;
-                for(int e = 0; e < nE; e++) {
-                    if(gridpp::is_valid(stats[t][y][x])) {
-                        sum += stats[t][y][x];
-                        count++;
-                    }
-                }
-                if(count > 0) {
-                    yarray[t] = sum / count;
-                    // Small floating point errors can occur in neighbourhood. Force values to be
-                    // within [0, 1]
-                    if(yarray[t] > 1)
-                        yarray[t] = 1;
-                    else if(yarray[t] < 0)
-                        yarray[t] = 0;
-                }
-                else
-                    is_missing = true;
-            }
-            if(!is_missing) {
-                if(curr_quantile == 1 && yarray[0] == 1)
-                    output[y][x] = thresholds[0];
-                else if(curr_quantile == 0 && yarray[yarray.size() - 1] == 0)
-                    output[y][x] = thresholds[thresholds.size() - 1];
-                else
-                    output[y][x] = gridpp::interpolate(curr_quantile, yarray, thresholds);
-            }
-        }
-    }
-
-    double e_time = gridpp::clock() ;
-    // std::cout << e_time - s_time << " s" << std::endl;
-    return output;
+    return ::neighbourhood_quantile_fast_single_pass(Field3D(input), quantile, halfwidth, thresholds);
 }
 vec2 gridpp::neighbourhood_brute_force(const vec2& input, int halfwidth, gridpp::Statistic statistic) {
     return ::neighbourhood_brute_force(input, halfwidth, statistic, 0);
@@ -532,10 +220,24 @@ vec2 gridpp::neighbourhood_brute_force(const vec3& input, int halfwidth, gridpp:
     return ::neighbourhood_brute_force(input, halfwidth, statistic, 0);
 }
 vec2 gridpp::neighbourhood_quantile(const vec2& input, float quantile, int halfwidth) {
-    return ::neighbourhood_brute_force(input, halfwidth, gridpp::Quantile, quantile);
+    if(halfwidth < 0)
+        throw std::invalid_argument("Half width must be > 0");
+    // Sorting all values up front does not pay off for the smallest windows
+    if(halfwidth <= 1)
+        return ::neighbourhood_brute_force(input, halfwidth, gridpp::Quantile, quantile);
+    if(input.size() == 0 || input[0].size() == 0)
+        return vec2();
+    Field2D field(input);
+    return ::neighbourhood_quantile_sliding(Field3D(field.size_y(), field.size_x(), 1, std::move(field.values())), quantile, halfwidth).to_vec2();
 }
 vec2 gridpp::neighbourhood_quantile(const vec3& input, float quantile, int halfwidth) {
-    return ::neighbourhood_brute_force(input, halfwidth, gridpp::Quantile, quantile);
+    if(halfwidth < 0)
+        throw std::invalid_argument("Half width must be > 0");
+    if(halfwidth <= 1)
+        return ::neighbourhood_brute_force(input, halfwidth, gridpp::Quantile, quantile);
+    if(input.size() == 0 || input[0].size() == 0 || input[0][0].size() == 0)
+        return vec2();
+    return ::neighbourhood_quantile_sliding(Field3D(input), quantile, halfwidth).to_vec2();
 }
 // Deprecated functions
 vec2 gridpp::neighbourhood_ens(const vec3& input, int halfwidth, gridpp::Statistic statistic) {
@@ -544,7 +246,7 @@ vec2 gridpp::neighbourhood_ens(const vec3& input, int halfwidth, gridpp::Statist
 }
 vec2 gridpp::neighbourhood_quantile_ens(const vec3& input, float quantile, int halfwidth) {
     gridpp::future_deprecation_warning("neighbourhood_quantile_ens", "neighbourhood_quantile");
-    return ::neighbourhood_brute_force(input, halfwidth, gridpp::Quantile, quantile);
+    return gridpp::neighbourhood_quantile(input, quantile, halfwidth);
 }
 vec2 gridpp::neighbourhood_quantile_ens_fast(const vec3& input, float quantile, int halfwidth, const vec& thresholds) {
     gridpp::future_deprecation_warning("neighbourhood_quantile_ens_fast", "neighbourhood_quantile_fast");
@@ -665,4 +367,453 @@ namespace {
         }
         return output;
     }
+    template<class T> Field2D neighbourhood_2d(const T& input, int halfwidth, gridpp::Statistic statistic) {
+        int nY = ::get_size_y(input);
+        int nX = ::get_size_x(input);
+        Field2D output(nY, nX, gridpp::MV);
+        if(statistic == gridpp::Mean || statistic == gridpp::Sum || statistic == gridpp::Count) {
+            output = gridpp::SummedAreaTable(input).neighbourhood(halfwidth, statistic);
+        }
+        else if(statistic == gridpp::Min || statistic == gridpp::Max) {
+            // The filter is separable, so first compute the min/max along each row and then along each
+            // column. Missing values are represented by -inf (for max) or +inf (for min) between the two
+            // passes, since these are not valid values.
+            bool is_max = statistic == gridpp::Max;
+            bool all_valid = !::has_missing(input);
+            int W = 2 * halfwidth + 1;
+            Field2D rows(nY, nX);
+            #pragma omp parallel
+            {
+                int L = (nX + 2 * halfwidth + W - 1) / W * W;
+                vec f(L), g(L), h(L);
+                #pragma omp for
+                for(int i = 0; i < nY; i++) {
+                    ::sliding_extreme(::get_row(input, i), rows.data() + size_t(i) * nX, nX, 1, 1, halfwidth, is_max, false, all_valid, f, g, h);
+                }
+            }
+            // Process the columns in blocks, so that the inner loop is over contiguous memory. The
+            // row pass only leaves valid values and -inf/inf, which need no validity test.
+            int block_size = 64;
+            int num_blocks = (nX + block_size - 1) / block_size;
+            #pragma omp parallel
+            {
+                int L = (nY + 2 * halfwidth + W - 1) / W * W;
+                vec f(L * block_size), g(L * block_size), h(L * block_size);
+                #pragma omp for
+                for(int b = 0; b < num_blocks; b++) {
+                    int j = b * block_size;
+                    int num_lanes = std::min(block_size, nX - j);
+                    ::sliding_extreme(rows.data() + j, output.data() + j, nY, num_lanes, nX, halfwidth, is_max, true, true, f, g, h);
+                }
+            }
+        }
+        else if(statistic == gridpp::Std || statistic == gridpp::Variance) {
+            output = gridpp::SummedAreaTable(input, true).neighbourhood(halfwidth, statistic);
+        }
+        else if(statistic == gridpp::Median && halfwidth > 1) {
+            Field3D values(nY, nX, 1);
+            for(int i = 0; i < nY; i++)
+                std::copy(::get_row(input, i), ::get_row(input, i) + nX, values.data() + size_t(i) * nX);
+            output = ::neighbourhood_quantile_sliding(values, 0.5, halfwidth);
+        }
+        else if(statistic == gridpp::Median) {
+            output = Field2D(gridpp::neighbourhood_brute_force(::to_vec2(input), halfwidth, statistic));
+        }
+        else {
+            // Unsupported statistics would otherwise throw inside the parallel loop of the brute force
+            // method
+            throw std::invalid_argument("Cannot compute this statistic");
+        }
+        return output;
+    }
+    template<class T> Field2D neighbourhood_ensemble(const T& input, int halfwidth, gridpp::Statistic statistic) {
+        // Check the statistic before the parallel loop, since exceptions cannot leave it
+        if(!gridpp::is_supported_statistic(statistic))
+            throw std::invalid_argument("Cannot compute this statistic");
+
+        Field2D flat = ::reduce_members(input, statistic);
+        return ::neighbourhood_2d(flat, halfwidth, statistic);
+    }
+    Field2D reduce_members(const vec3& input, gridpp::Statistic statistic) {
+        // The members of each gridpoint are already contiguous, so reduce them without copying
+        int Y = input.size();
+        int X = input[0].size();
+        Field2D flat(Y, X, 0);
+        #pragma omp parallel for
+        for(int y = 0; y < Y; y++) {
+            for(int x = 0; x < X; x++) {
+                flat(y, x) = gridpp::calc_statistic(input[y][x], statistic);
+            }
+        }
+        return flat;
+    }
+    Field2D reduce_members(const View3& input, gridpp::Statistic statistic) {
+        // Read the members directly from the view, without creating a vec3 copy
+        return gridpp::calc_statistic(input, statistic);
+    }
+    int get_size_y(const vec2& input) {
+        return input.size();
+    }
+    int get_size_x(const vec2& input) {
+        return input[0].size();
+    }
+    const float* get_row(const vec2& input, int y) {
+        return input[y].data();
+    }
+    bool has_missing(const vec2& input) {
+        for(int y = 0; y < input.size(); y++) {
+            for(int x = 0; x < input[y].size(); x++) {
+                if(!gridpp::is_valid(input[y][x]))
+                    return true;
+            }
+        }
+        return false;
+    }
+    const vec2& to_vec2(const vec2& input) {
+        return input;
+    }
+    int get_size_y(const Field2D& input) {
+        return input.size_y();
+    }
+    int get_size_x(const Field2D& input) {
+        return input.size_x();
+    }
+    const float* get_row(const Field2D& input, int y) {
+        return input.data() + size_t(y) * input.size_x();
+    }
+    bool has_missing(const Field2D& input) {
+        return input.has_missing();
+    }
+    vec2 to_vec2(const Field2D& input) {
+        return input.to_vec2();
+    }
+    void sliding_extreme(const float* input, float* output, int n, int num_lanes, long stride,
+            int halfwidth, bool is_max, bool missing_output, bool all_valid, vec& f, vec& g, vec& h) {
+        int W = 2 * halfwidth + 1;
+        // Pad the line with halfwidth missing values on each side, such that all windows have the
+        // same size. Then round up to a whole number of blocks of size W.
+        int L = (n + 2 * halfwidth + W - 1) / W * W;
+        float identity = is_max ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+        for(int k = 0; k < L; k++) {
+            float* fk = &f[k * num_lanes];
+            int index = k - halfwidth;
+            if(index < 0 || index >= n) {
+                for(int l = 0; l < num_lanes; l++)
+                    fk[l] = identity;
+            }
+            else if(all_valid) {
+                const float* curr = input + index * stride;
+                for(int l = 0; l < num_lanes; l++)
+                    fk[l] = curr[l];
+            }
+            else {
+                const float* curr = input + index * stride;
+                for(int l = 0; l < num_lanes; l++)
+                    fk[l] = gridpp::is_valid(curr[l]) ? curr[l] : identity;
+            }
+        }
+
+        // g is the running extreme from the start of each block, and h from the end of each block
+        for(int k = 0; k < L; k++) {
+            float* gk = &g[k * num_lanes];
+            const float* fk = &f[k * num_lanes];
+            if(k % W == 0) {
+                for(int l = 0; l < num_lanes; l++)
+                    gk[l] = fk[l];
+            }
+            else if(is_max) {
+                for(int l = 0; l < num_lanes; l++)
+                    gk[l] = std::max(gk[l - num_lanes], fk[l]);
+            }
+            else {
+                for(int l = 0; l < num_lanes; l++)
+                    gk[l] = std::min(gk[l - num_lanes], fk[l]);
+            }
+        }
+        for(int k = L - 1; k >= 0; k--) {
+            float* hk = &h[k * num_lanes];
+            const float* fk = &f[k * num_lanes];
+            if(k % W == W - 1) {
+                for(int l = 0; l < num_lanes; l++)
+                    hk[l] = fk[l];
+            }
+            else if(is_max) {
+                for(int l = 0; l < num_lanes; l++)
+                    hk[l] = std::max(hk[l + num_lanes], fk[l]);
+            }
+            else {
+                for(int l = 0; l < num_lanes; l++)
+                    hk[l] = std::min(hk[l + num_lanes], fk[l]);
+            }
+        }
+
+        // The padded window [k, k + W - 1] covers the end of one block and the start of the next
+        for(int k = 0; k < n; k++) {
+            const float* hk = &h[k * num_lanes];
+            const float* gk = &g[(k + W - 1) * num_lanes];
+            float* curr = output + k * stride;
+            for(int l = 0; l < num_lanes; l++) {
+                float value = is_max ? std::max(hk[l], gk[l]) : std::min(hk[l], gk[l]);
+                if(missing_output && value == identity)
+                    value = gridpp::MV;
+                curr[l] = value;
+            }
+        }
+    }
+    Field2D neighbourhood_quantile_sliding(const Field3D& input, float quantile, int halfwidth) {
+        if(quantile < 0 || quantile > 1)
+            throw std::invalid_argument("Quantile must be between 0 and 1 inclusive");
+        int nY = input.size_y();
+        int nX = input.size_x();
+        int nE = input.size_e();
+        Field2D output(nY, nX, gridpp::MV);
+        if(!gridpp::is_valid(quantile))
+            return output;
+
+        // Process the output in bands of rows. The ranks and the Fenwick tree only cover the input
+        // rows that a band needs, so memory use is bounded by the band and not by the whole field.
+        // The bands overlap by 2 * halfwidth input rows, so they are made at least that large to
+        // keep the repeated work low.
+        const vec& values = input.values();
+        int band_size = std::max(16, 2 * halfwidth);
+        int nBands = (nY + band_size - 1) / band_size;
+        size_t row_size = size_t(nX) * nE;
+
+        #pragma omp parallel
+        {
+            vec levels;
+            ivec ranks;
+            // Fenwick tree (1-based) counting the number of values with each rank inside the window
+            ivec tree;
+            #pragma omp for schedule(dynamic)
+            for(int b = 0; b < nBands; b++) {
+                int b0 = b * band_size;
+                int b1 = std::min(nY, b0 + band_size);
+                int r0 = std::max(0, b0 - halfwidth);
+                int r1 = std::min(nY, b1 + halfwidth);
+                const float* band_values = values.data() + r0 * row_size;
+                size_t S = (r1 - r0) * row_size;
+
+                // Replace each value by the rank of the value among the distinct valid values in the band
+                levels.clear();
+                for(size_t s = 0; s < S; s++) {
+                    if(gridpp::is_valid(band_values[s]))
+                        levels.push_back(band_values[s]);
+                }
+                std::sort(levels.begin(), levels.end());
+                levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+                int M = levels.size();
+                if(M == 0)
+                    continue;
+                ranks.resize(S);
+                for(size_t s = 0; s < S; s++) {
+                    if(gridpp::is_valid(band_values[s]))
+                        ranks[s] = std::lower_bound(levels.begin(), levels.end(), band_values[s]) - levels.begin();
+                    else
+                        ranks[s] = -1;
+                }
+                tree.assign(M + 1, 0);
+                int top = 1;
+                while(top * 2 <= M)
+                    top *= 2;
+
+                for(int i = b0; i < b1; i++) {
+                    int i0 = std::max(0, i - halfwidth);
+                    int i1 = std::min(nY - 1, i + halfwidth);
+                    int total = 0;
+                    // Add (delta = 1) or remove (delta = -1) the values in one column of the window
+                    auto update = [&](int column, int delta) {
+                        for(int ii = i0; ii <= i1; ii++) {
+                            const int* curr = &ranks[(size_t(ii - r0) * nX + column) * nE];
+                            for(int e = 0; e < nE; e++) {
+                                if(curr[e] >= 0) {
+                                    for(int k = curr[e] + 1; k <= M; k += k & -k)
+                                        tree[k] += delta;
+                                    total += delta;
+                                }
+                            }
+                        }
+                    };
+                    // Find the value with the given index (from 0) among the sorted values in the window,
+                    // by descending the tree
+                    auto kth = [&](int index) {
+                        int pos = 0;
+                        for(int step = top; step > 0; step /= 2) {
+                            if(pos + step <= M && tree[pos + step] <= index) {
+                                pos += step;
+                                index -= tree[pos];
+                            }
+                        }
+                        return levels[pos];
+                    };
+                    for(int jj = 0; jj <= std::min(nX - 1, halfwidth); jj++)
+                        update(jj, 1);
+                    for(int j = 0; j < nX; j++) {
+                        if(j > 0) {
+                            if(j + halfwidth < nX)
+                                update(j + halfwidth, 1);
+                            if(j - halfwidth - 1 >= 0)
+                                update(j - halfwidth - 1, -1);
+                        }
+                        if(total == 0)
+                            continue;
+
+                        // Find the values at the lower and upper index in the same way as calc_quantile
+                        int lowerIndex = 0;
+                        int upperIndex = 0;
+                        if(quantile == 1) {
+                            lowerIndex = total - 1;
+                            upperIndex = total - 1;
+                        }
+                        else if(quantile > 0) {
+                            lowerIndex = floor(quantile * (total - 1));
+                            upperIndex = ceil(quantile * (total - 1));
+                        }
+                        float lowerValue = kth(lowerIndex);
+                        float upperValue = upperIndex == lowerIndex ? lowerValue : kth(upperIndex);
+                        if(lowerIndex == upperIndex) {
+                            output(i, j) = lowerValue;
+                        }
+                        else {
+                            float lowerQuantile = (float) lowerIndex / (total - 1);
+                            float upperQuantile = (float) upperIndex / (total - 1);
+                            float f = (quantile - lowerQuantile) / (upperQuantile - lowerQuantile);
+                            output(i, j) = lowerValue + (upperValue - lowerValue) * f;
+                        }
+                    }
+                    // Empty the tree, so it can be reused for the next row
+                    for(int jj = std::max(0, nX - 1 - halfwidth); jj < nX; jj++)
+                        update(jj, -1);
+                }
+            }
+        }
+        return output;
+    }
+    vec2 neighbourhood_quantile_fast_single_pass(const Field3D& input, const vec2& quantile, int halfwidth, const vec& thresholds) {
+        int nY = input.size_y();
+        int nX = input.size_x();
+        int nE = input.size_e();
+        vec2 output(nY);
+        for(int y = 0; y < nY; y++) {
+            output[y].resize(nX, gridpp::MV);
+        }
+        if(thresholds.size() == 0)
+            return output;
+
+        // Sort the valid thresholds, so that the members below each threshold can be counted by
+        // placing each member in a bucket between two consecutive thresholds. Invalid thresholds
+        // never have any members below them.
+        ivec order;
+        for(int t = 0; t < thresholds.size(); t++) {
+            if(gridpp::is_valid(thresholds[t]))
+                order.push_back(t);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return thresholds[a] < thresholds[b]; });
+        int T = order.size();
+        vec sorted(T);
+        for(int k = 0; k < T; k++)
+            sorted[k] = thresholds[order[k]];
+
+        const bool is_fixed_quantile = quantile.size() == 1 && quantile[0].size() == 1;
+        // Process the field in bands of rows. Each band needs 2 * halfwidth extra rows, so use
+        // bands that are not much smaller than the neighbourhood.
+        int band_size = std::max(64, halfwidth);
+        int num_bands = (nY + band_size - 1) / band_size;
+
+        #pragma omp parallel
+        {
+            // Sum of the fractions below each threshold, for each column of the neighbourhood
+            std::vector<double> column_sums(size_t(nX) * T);
+            ivec column_counts(nX);
+            std::vector<double> window_sums(T);
+            ivec buckets(T + 1);
+            vec yarray(thresholds.size(), 0);
+
+            // Add (sign = 1) or remove (sign = -1) a gridpoint to the sums of its column
+            auto update_column = [&](int y, int x, int sign) {
+                const float* curr = input.data() + (size_t(y) * nX + x) * nE;
+                std::fill(buckets.begin(), buckets.end(), 0);
+                int count = 0;
+                for(int e = 0; e < nE; e++) {
+                    if(gridpp::is_valid(curr[e])) {
+                        buckets[std::lower_bound(sorted.begin(), sorted.end(), curr[e]) - sorted.begin()]++;
+                        count++;
+                    }
+                }
+                if(count == 0)
+                    return;
+                column_counts[x] += sign;
+                double* sums = &column_sums[size_t(x) * T];
+                int below = 0;
+                for(int k = 0; k < T; k++) {
+                    below += buckets[k];
+                    if(below > 0) {
+                        float fraction = float(below) / count;
+                        sums[k] += sign * fraction;
+                    }
+                }
+            };
+            // Add (sign = 1) or remove (sign = -1) a column to the sums of the neighbourhood
+            auto update_window = [&](int x, int sign, int& count) {
+                const double* sums = &column_sums[size_t(x) * T];
+                for(int k = 0; k < T; k++)
+                    window_sums[k] += sign * sums[k];
+                count += sign * column_counts[x];
+            };
+
+            #pragma omp for schedule(dynamic)
+            for(int b = 0; b < num_bands; b++) {
+                int y_start = b * band_size;
+                int y_end = std::min(nY, y_start + band_size);
+                std::fill(column_sums.begin(), column_sums.end(), 0);
+                std::fill(column_counts.begin(), column_counts.end(), 0);
+                for(int yy = std::max(0, y_start - halfwidth); yy < std::min(nY, y_start + halfwidth); yy++) {
+                    for(int x = 0; x < nX; x++)
+                        update_column(yy, x, 1);
+                }
+                for(int y = y_start; y < y_end; y++) {
+                    if(y + halfwidth < nY) {
+                        for(int x = 0; x < nX; x++)
+                            update_column(y + halfwidth, x, 1);
+                    }
+                    if(y > y_start && y - halfwidth - 1 >= 0) {
+                        for(int x = 0; x < nX; x++)
+                            update_column(y - halfwidth - 1, x, -1);
+                    }
+
+                    std::fill(window_sums.begin(), window_sums.end(), 0);
+                    int count = 0;
+                    for(int xx = 0; xx < std::min(nX, halfwidth); xx++)
+                        update_window(xx, 1, count);
+                    for(int x = 0; x < nX; x++) {
+                        if(x + halfwidth < nX)
+                            update_window(x + halfwidth, 1, count);
+                        if(x - halfwidth - 1 >= 0)
+                            update_window(x - halfwidth - 1, -1, count);
+                        if(count == 0)
+                            continue;
+
+                        float curr_quantile = is_fixed_quantile ? quantile[0][0] : quantile[y][x];
+                        for(int k = 0; k < T; k++) {
+                            float value = window_sums[k] / count;
+                            // Small floating point errors can occur in neighbourhood. Force values to be
+                            // within [0, 1]
+                            if(value > 1)
+                                value = 1;
+                            else if(value < 0)
+                                value = 0;
+                            yarray[order[k]] = value;
+                        }
+                        if(curr_quantile == 1 && yarray[0] == 1)
+                            output[y][x] = thresholds[0];
+                        else if(curr_quantile == 0 && yarray[yarray.size() - 1] == 0)
+                            output[y][x] = thresholds[thresholds.size() - 1];
+                        else
+                            output[y][x] = gridpp::interpolate(curr_quantile, yarray, thresholds);
+                    }
+                }
+            }
+        }
+        return output;
+    }
 }
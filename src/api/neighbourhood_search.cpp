@@ -27,15 +27,23 @@ vec2 gridpp::neighbourhood_search(const vec2& array, const vec2& search_array, i
     int nY = array.size();
     int nX = array[0].size();
 
-    for(int y = 0; y < array.size(); y++) {
-        for(int x = 0; x < array[y].size(); x++) {
-            /* Loop over each element in array */
-            float nearest_target = gridpp::MV;
-            int I_nearestSearchArray_Y = 0;
-            int I_nearestSearchArray_X = 0;
-            int counter = 0;
-            float accum_temp = 0;
+    // Values that are inside the search target range. Their neighbourhood mean is computed using
+    // a summed area table, so only the neighbourhoods without such values need to be searched.
+    Field2D in_range(nY, nX, gridpp::MV);
+    #pragma omp parallel for
+    for(int y = 0; y < nY; y++) {
+        for(int x = 0; x < nX; x++) {
+            if(gridpp::is_valid(search_array[y][x]) && gridpp::is_valid(array[y][x]) &&
+                    search_array[y][x] >= search_target_min && search_array[y][x] <= search_target_max)
+                in_range(y, x) = array[y][x];
+        }
+    }
+    gridpp::SummedAreaTable table(in_range);
 
+    #pragma omp parallel for schedule(dynamic)
+    for(int y = 0; y < nY; y++) {
+        for(int x = 0; x < nX; x++) {
+            /* Loop over each element in array */
             if(!gridpp::is_valid(search_array[y][x])) {
                 /* if current search_array is invalid, set output equal to array (input) */
                 output[y][x] = array[y][x];
@@ -48,57 +56,55 @@ vec2 gridpp::neighbourhood_search(const vec2& array, const vec2& search_array, i
                 continue;
             }
 
-            for(int yy = std::max(0, y - halfwidth); yy <= std::min(nY - 1, y + halfwidth); yy++) {
-                for(int xx = std::max(0, x - halfwidth); xx <= std::min(nX - 1, x + halfwidth); xx++) {
-                    /* Loop over neighbourhood of y and x */
-                    int I_SearchArray_Y = 0;
-                    int I_SearchArray_X = 0;
+            if(use_apply_array && apply_array[y][x] != 1) {
+                /* Neither use values inside nor outside the search target */
+                output[y][x] = array[y][x];
+                continue;
+            }
 
+            int y0 = y - halfwidth;
+            int x0 = x - halfwidth;
+            int y1 = y + halfwidth;
+            int x1 = x + halfwidth;
+            int counter = table.count(y0, x0, y1, x1);
+            if(counter > 0) {
+                /* find mean value of values inside the search target */
+                output[y][x] = table.sum(y0, x0, y1, x1) / counter;
+                continue;
+            }
+
+            /* No values inside the search target, so find the value nearest to the target that is
+               sufficiently different from the current search value */
+            float nearest_target = gridpp::MV;
+            int I_nearestSearchArray_Y = 0;
+            int I_nearestSearchArray_X = 0;
+            for(int yy = std::max(0, y0); yy <= std::min(nY - 1, y1); yy++) {
+                for(int xx = std::max(0, x0); xx <= std::min(nX - 1, x1); xx++) {
                     if(!gridpp::is_valid(search_array[yy][xx]) || !gridpp::is_valid(array[yy][xx])) {
                         continue;
                     }
-
-                    //else if(search_array[y][x] >= search_criteria_min && search_array[y][x] <= search_criteria_max) {
-                    if(!use_apply_array || apply_array[y][x] == 1){
-                        /*condition search array inside of scope */
-
-                        if(search_array[yy][xx] >= search_target_min && search_array[yy][xx] <= search_target_max) {
-                            /* Count all and add all values*/
-                            counter++;
-                            accum_temp = accum_temp + array[yy][xx];
+                    if(std::abs(search_array[yy][xx] - search_array[y][x]) >= search_delta) {
+                        if(!gridpp::is_valid(nearest_target)) {
+                            /* Set first value*/
+                            nearest_target = search_array[yy][xx];
+                            I_nearestSearchArray_Y = yy;
+                            I_nearestSearchArray_X = xx;
                         }
-                        else if (counter > 0)
-                            /*  We have decided that we will only use values within th search target */
-                            continue;
-                        else if(std::abs(search_array[yy][xx] - search_array[y][x]) >= search_delta) {
-                            /* Finding nearest value that's outside of the search target range */
-                            if(!gridpp::is_valid(nearest_target)) {
-                                /* Set first value*/
+                        else {
+                            float curr_dist_to_target = std::min(std::abs(search_array[yy][xx] - search_target_min), std::abs(search_array[yy][xx] - search_target_max));
+                            float best_dist_to_target = std::min(std::abs(nearest_target - search_target_min), std::abs(nearest_target - search_target_max));
+                            if(curr_dist_to_target < best_dist_to_target) {
+                                // If next search array is closer to search target, assign new value*
                                 nearest_target = search_array[yy][xx];
                                 I_nearestSearchArray_Y = yy;
                                 I_nearestSearchArray_X = xx;
                             }
-                            else {
-                                float curr_dist_to_target = std::min(std::abs(search_array[yy][xx] - search_target_min), std::abs(search_array[yy][xx] - search_target_max));
-                                float best_dist_to_target = std::min(std::abs(nearest_target - search_target_min), std::abs(nearest_target - search_target_max));
-                                if(curr_dist_to_target < best_dist_to_target) {
-                                    // If next search array is closer to search target, assign new value*
-                                    nearest_target = search_array[yy][xx];
-                                    I_nearestSearchArray_Y = yy;
-                                    I_nearestSearchArray_X = xx;
-                                }
-                            }
                         }
                     }
                 }
             }
 
-            if(counter > 0) {
-                /* find mean value of accumulated values */
-                output[y][x] = accum_temp / counter;
-            }
-
-            else if(gridpp::is_valid(nearest_target)) {
+            if(gridpp::is_valid(nearest_target)) {
                 /* If no values found inside target, and nearest target was used, assign the value from that location*/
                 output[y][x] = array[I_nearestSearchArray_Y][I_nearestSearchArray_X];
             }
@@ -110,4 +116,4 @@ vec2 gridpp::neighbourhood_search(const vec2& array, const vec2& search_array, i
         }
     }
     return output;
-}
\ No newline at end of file
+}
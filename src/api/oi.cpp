@@ -4,14 +4,22 @@
 #include <armadillo>
 #include <assert.h>
 #include <exception>
+#include <iterator>
+#include <utility>
 #include <boost/math/distributions/normal.hpp>
 
 using namespace gridpp;
 
 namespace {
+#ifdef GRIDPP_OI_FLOAT
+    typedef arma::fmat mattype;
+    typedef arma::fvec vectype;
+    typedef arma::cx_fmat cxtype;
+#else
     typedef arma::mat mattype;
     typedef arma::vec vectype;
     typedef arma::cx_mat cxtype;
+#endif
 
     void check_vec(vec2 input, int Y, int X);
     void check_vec(vec input, int S);
@@ -21,6 +29,34 @@ namespace {
             return left.first < right.first;
         };
     };
+
+    /** Cholesky factorization U'U = P + R of the observation part of the OI equations. The rows
+      * of U follow the observations in 'indices'. The factorization is kept between gridpoints,
+      * so that neighbouring gridpoints using the same observations can reuse or update it.
+    */
+    struct CholeskyCache {
+        CholeskyCache() : num_updates(0) {};
+        void clear();
+        ivec indices;
+        mattype U;
+        int num_updates;
+    };
+
+    /** Remove the observation at row 'position' from the factorization */
+    bool remove_from_cholesky(CholeskyCache& cache, int position);
+
+    /** Add an observation to the end of the factorization
+      * @param column Covariances between the new observation and the existing ones
+      * @param diag Variance of the new observation
+    */
+    bool append_to_cholesky(CholeskyCache& cache, int index, const vectype& column, double diag);
+
+    /** Solve U'U x = b */
+    vectype solve_cholesky(const mattype& U, const vectype& b);
+
+    /** Check if two correlations between the same pair of points, computed in opposite order,
+      * are equal. A tolerance is used since the order of operations can differ. */
+    bool is_symmetric_corr(float rho_ij, float rho_ji);
 }
 
 vec2 gridpp::optimal_interpolation(const gridpp::Grid& bgrid,
@@ -66,24 +102,9 @@ vec2 gridpp::optimal_interpolation(const gridpp::Grid& bgrid,
     int nX = background[0].size();
 
     gridpp::Points bpoints = bgrid.to_points();
-    vec background1(nY * nX);
-    int count = 0;
-    for(int y = 0; y < nY; y++) {
-        for(int x = 0; x < nX; x++) {
-            background1[count] = background[y][x];
-            count++;
-        }
-    }
-    vec output1 = optimal_interpolation(bpoints, background1, points, pobs, pratios, pbackground, structure, max_points, allow_extrapolation);
-    vec2 output = gridpp::init_vec2(nY, nX);
-    count = 0;
-    for(int y = 0; y < nY; y++) {
-        for(int x = 0; x < nX; x++) {
-            output[y][x] = output1[count];
-            count++;
-        }
-    }
-    return output;
+    Field2D background1(background);
+    vec output1 = optimal_interpolation(bpoints, background1.values(), points, pobs, pratios, pbackground, structure, max_points, allow_extrapolation);
+    return Field2D(nY, nX, std::move(output1)).to_vec2();
 }
 
 vec gridpp::optimal_interpolation(const gridpp::Points& bpoints,
@@ -211,7 +232,20 @@ vec gridpp::optimal_interpolation_full(const gridpp::Points& bpoints,
     // Compute the background value at observation points (Y)
     vec gY = pbackground;
 
-    #pragma omp parallel for
+    // Look up spatially varying structure parameters once, instead of for each correlation
+    ivec bindices = structure.get_parameter_indices(bpoints);
+    ivec pindices = structure.get_parameter_indices(points);
+
+    int num_not_spd_warning = 0;
+    int num_solve_warning = 0;
+
+    // Each thread works on a contiguous chunk of points, so that consecutive points (which are
+    // often neighbours) can share the factorization in the thread's cache
+    #pragma omp parallel reduction(+:num_not_spd_warning,num_solve_warning)
+    {
+    CholeskyCache cache;
+
+    #pragma omp for schedule(static)
     for(int y = 0; y < nY; y++) {
         if(!gridpp::is_valid(background[y])) {
             continue;
@@ -219,7 +253,7 @@ vec gridpp::optimal_interpolation_full(const gridpp::Points& bpoints,
         float lat = blats[y];
         float lon = blons[y];
         Point p1 = bpoints.get_point(y);
-        float localizationRadius = structure.localization_distance(p1);
+        float localizationRadius = structure.localization_distance_indexed(p1, bindices[y]);
 
         // Find observations within localization radius
         // TODO: Check that the chosen ones have elevation
@@ -238,7 +272,7 @@ vec gridpp::optimal_interpolation_full(const gridpp::Points& bpoints,
             int index = lLocIndices0[i];
             if(gridpp::is_valid(pobs[index]) && gridpp::is_valid(pbackground[index])) {
                 Point p2 = points.get_point(index);
-                float rho = structure.corr_background(p1, p2);
+                float rho = structure.corr_background_indexed(p1, p2, bindices[y]);
                 if(rho > 0) {
                     lRhos0.push_back(std::pair<float,int>(rho, i));
                 }
@@ -274,29 +308,140 @@ vec gridpp::optimal_interpolation_full(const gridpp::Points& bpoints,
             continue;
         }
 
+        // Find the observations that differ from the ones in the cached factorization
+        bool use_cache = false;
+        ivec removed;
+        ivec added;
+        if(cache.indices.size() > 0) {
+            ivec sorted_new = lLocIndices;
+            ivec sorted_cache = cache.indices;
+            std::sort(sorted_new.begin(), sorted_new.end());
+            std::sort(sorted_cache.begin(), sorted_cache.end());
+            std::set_difference(sorted_cache.begin(), sorted_cache.end(), sorted_new.begin(), sorted_new.end(), std::back_inserter(removed));
+            std::set_difference(sorted_new.begin(), sorted_new.end(), sorted_cache.begin(), sorted_cache.end(), std::back_inserter(added));
+            // Updating costs O(lS^2) per observation, whereas refactorizing costs O(lS^3). Also
+            // refactorize now and then to limit the accumulation of rounding errors.
+            int num_changes = removed.size() + added.size();
+            use_cache = num_changes <= lS / 4 && cache.num_updates + num_changes <= lS;
+        }
+        if(use_cache) {
+            for(int i = 0; i < removed.size() && use_cache; i++) {
+                int position = std::find(cache.indices.begin(), cache.indices.end(), removed[i]) - cache.indices.begin();
+                use_cache = remove_from_cholesky(cache, position);
+            }
+            for(int i = 0; i < added.size() && use_cache; i++) {
+                int index = added[i];
+                int nC = cache.indices.size();
+                vec lLats(nC);
+                vec lLons(nC);
+                vec lElevs(nC);
+                vec lLafs(nC);
+                for(int j = 0; j < nC; j++) {
+                    int index_j = cache.indices[j];
+                    lLats[j] = plats[index_j];
+                    lLons[j] = plons[index_j];
+                    lElevs[j] = pelevs[index_j];
+                    lLafs[j] = plafs[index_j];
+                }
+                Point p1 = points.get_point(index);
+                vec row;
+                structure.corr_row(p1, pindices[index], lLats, lLons, lElevs, lLafs, row);
+                vectype column(nC);
+                for(int j = 0; j < nC; j++) {
+                    // The factorization is only valid for symmetric covariances
+                    int index_j = cache.indices[j];
+                    if(!is_symmetric_corr(structure.corr_indexed(points.get_point(index_j), p1, pindices[index_j]), row[j])) {
+                        use_cache = false;
+                        break;
+                    }
+                    column(j) = row[j];
+                }
+                if(use_cache) {
+                    double diag = structure.corr_indexed(p1, p1, pindices[index]) + pratios[index];
+                    use_cache = append_to_cholesky(cache, index, column, diag);
+                }
+            }
+            if(use_cache)
+                cache.num_updates += removed.size() + added.size();
+            else
+                cache.clear();
+        }
+        if(use_cache) {
+            // Use the observation order of the factorization
+            std::vector<std::pair<int,float> > index_rhos(lS);
+            for(int i = 0; i < lS; i++)
+                index_rhos[i] = std::pair<int,float>(lLocIndices[i], lRhos(i));
+            std::sort(index_rhos.begin(), index_rhos.end());
+            lLocIndices = cache.indices;
+            for(int i = 0; i < lS; i++) {
+                std::vector<std::pair<int,float> >::const_iterator it = std::lower_bound(index_rhos.begin(), index_rhos.end(), std::pair<int,float>(lLocIndices[i], -1e30));
+                lRhos(i) = it->second;
+            }
+        }
+
         vectype lObs(lS);
         // Compute Y (model at obs-locations)
         vectype lY(lS);
         // Current grid-point to station error covariance matrix
         mattype lG(1, lS, arma::fill::zeros);
-        // Station to station error covariance matrix
-        mattype lP(lS, lS, arma::fill::zeros);
-        // Station variance
-        mattype lR(lS, lS, arma::fill::zeros);
         for(int i = 0; i < lS; i++) {
             int index = lLocIndices[i];
             lObs(i) = pobs[index];
             lY(i) = gY[index];
-            lR(i, i) = pratios[index];
             lG(0, i) = lRhos(i);
-            Point p1 = points.get_point(index);
-            for(int j = 0; j < lS; j++) {
-                int index_j = lLocIndices[j];
-                Point p2 = points.get_point(index_j);
-                lP(i, j) = structure.corr(p1, p2);
+        }
+
+        mattype lGSR;
+        if(use_cache) {
+            lGSR = solve_cholesky(cache.U, lG.t()).t();
+        }
+        else {
+            // Station to station error covariance matrix
+            mattype lP(lS, lS, arma::fill::zeros);
+            // Station variance
+            mattype lR(lS, lS, arma::fill::zeros);
+            vec lLats(lS);
+            vec lLons(lS);
+            vec lElevs(lS);
+            vec lLafs(lS);
+            ivec lIndices(lS);
+            for(int i = 0; i < lS; i++) {
+                int index = lLocIndices[i];
+                lR(i, i) = pratios[index];
+                lLats[i] = plats[index];
+                lLons[i] = plons[index];
+                lElevs[i] = pelevs[index];
+                lLafs[i] = plafs[index];
+                lIndices[i] = pindices[index];
+            }
+            vec2 lCorr;
+            structure.corr_matrix(lLats, lLons, lElevs, lLafs, points.get_coordinate_type(), lIndices, lCorr);
+            bool is_symmetric = true;
+            for(int i = 0; i < lS; i++) {
+                for(int j = 0; j < lS; j++) {
+                    lP(i, j) = lCorr[i][j];
+                    if(!is_symmetric_corr(lCorr[i][j], lCorr[j][i]))
+                        is_symmetric = false;
+                }
+            }
+            cache.clear();
+            if(is_symmetric && arma::chol(cache.U, lP + lR)) {
+                cache.indices = lLocIndices;
+                lGSR = solve_cholesky(cache.U, lG.t()).t();
+            }
+            else {
+                // lP + lR is not symmetric positive definite, use a general solver instead
+                if(is_symmetric)
+                    num_not_spd_warning++;
+                cache.clear();
+                mattype lGSRt;
+                if(!arma::solve(lGSRt, (lP + lR).t(), mattype(lG.t()))) {
+                    num_solve_warning++;
+                    continue;
+                }
+                lGSR = lGSRt.t();
             }
         }
-        mattype lGSR = lG * arma::inv(lP + lR);
         vectype dx = lGSR * (lObs - lY);
         float increment = dx[0];
         if(!allow_extrapolation) {
@@ -320,6 +465,18 @@ vec gridpp::optimal_interpolation_full(const gridpp::Points& bpoints,
         mattype a = (lGSR * lG.t());
         analysis_variance[y] = bvariance[y] * (1 - a(0, 0));
     }
+    }
+
+    if(num_not_spd_warning > 0) {
+        std::stringstream ss;
+        ss << "Observation covariance matrix was not positive definite in " << num_not_spd_warning << " points";
+        gridpp::warning(ss.str());
+    }
+    if(num_solve_warning > 0) {
+        std::stringstream ss;
+        ss << "Could not solve the analysis equations in " << num_solve_warning << " points. Using background values in those points.";
+        gridpp::warning(ss.str());
+    }
 
     return output;
 }
@@ -368,29 +525,110 @@ vec2 gridpp::optimal_interpolation_full(const gridpp::Grid& bgrid,
     int nX = background[0].size();
 
     gridpp::Points bpoints = bgrid.to_points();
-    vec background1(nY * nX);
-    vec bvariance1(nY * nX);
-    int count = 0;
-    for(int y = 0; y < nY; y++) {
-        for(int x = 0; x < nX; x++) {
-            background1[count] = background[y][x];
-            bvariance1[count] = bvariance[y][x];
-            count++;
+    Field2D background1(background);
+    Field2D bvariance1(bvariance);
+    if(bvariance1.size_y() != nY || bvariance1.size_x() != nX)
+        throw std::invalid_argument("Background variance is not the same size as the background");
+    vec analysis_variance1;
+    vec output1 = optimal_interpolation_full(bpoints, background1.values(), bvariance1.values(), points, obs, obs_variance, background_at_points, bvariance_at_points, structure, max_points, analysis_variance1, allow_extrapolation);
+    analysis_variance = Field2D(nY, nX, std::move(analysis_variance1)).to_vec2();
+    return Field2D(nY, nX, std::move(output1)).to_vec2();
+}
+namespace {
+    void CholeskyCache::clear() {
+        indices.clear();
+        U = mattype();
+        num_updates = 0;
+    }
+    bool remove_from_cholesky(CholeskyCache& cache, int position) {
+        int n = cache.indices.size();
+        if(position < 0 || position >= n)
+            return false;
+
+        // Removing the column gives an upper Hessenberg matrix to the right of 'position'
+        mattype H(n, n - 1);
+        for(int i = 0; i < n; i++) {
+            for(int j = 0; j < n - 1; j++) {
+                H(i, j) = cache.U(i, j < position ? j : j + 1);
+            }
+        }
+        // Restore the triangular form with Givens rotations
+        for(int j = position; j < n - 1; j++) {
+            double a = H(j, j);
+            double b = H(j + 1, j);
+            double r = sqrt(a * a + b * b);
+            if(!(r > 0))
+                return false;
+            double c = a / r;
+            double s = b / r;
+            for(int k = j; k < n - 1; k++) {
+                double t1 = H(j, k);
+                double t2 = H(j + 1, k);
+                H(j, k) = c * t1 + s * t2;
+                H(j + 1, k) = -s * t1 + c * t2;
+            }
         }
+        mattype U(n - 1, n - 1);
+        for(int i = 0; i < n - 1; i++) {
+            for(int j = 0; j < n - 1; j++) {
+                U(i, j) = j < i ? 0 : H(i, j);
+            }
+        }
+        cache.U = U;
+        cache.indices.erase(cache.indices.begin() + position);
+        return true;
     }
-    vec analysis_variance1;
-    vec output1 = optimal_interpolation_full(bpoints, background1, bvariance1, points, obs, obs_variance, background_at_points, bvariance_at_points, structure, max_points, analysis_variance1, allow_extrapolation);
-    vec2 output = gridpp::init_vec2(nY, nX);
-    analysis_variance.clear();
-    analysis_variance.resize(nY);
-    count = 0;
-    for(int y = 0; y < nY; y++) {
-        analysis_variance[y].resize(nX);
-        for(int x = 0; x < nX; x++) {
-            output[y][x] = output1[count];
-            analysis_variance[y][x] = analysis_variance1[count];
-            count++;
+    bool append_to_cholesky(CholeskyCache& cache, int index, const vectype& column, double diag) {
+        int n = cache.indices.size();
+
+        // Solve U' r = column
+        vectype r(n);
+        for(int i = 0; i < n; i++) {
+            double total = column(i);
+            for(int k = 0; k < i; k++)
+                total -= cache.U(k, i) * r(k);
+            r(i) = total / cache.U(i, i);
         }
+        double d = diag;
+        for(int i = 0; i < n; i++)
+            d -= r(i) * r(i);
+        if(!(d > 0))
+            return false;
+
+        mattype U(n + 1, n + 1, arma::fill::zeros);
+        for(int i = 0; i < n; i++) {
+            for(int j = i; j < n; j++) {
+                U(i, j) = cache.U(i, j);
+            }
+            U(i, n) = r(i);
+        }
+        U(n, n) = sqrt(d);
+        cache.U = U;
+        cache.indices.push_back(index);
+        return true;
+    }
+    vectype solve_cholesky(const mattype& U, const vectype& b) {
+        int n = b.n_elem;
+        // Forward substitution with U'
+        vectype z(n);
+        for(int i = 0; i < n; i++) {
+            double total = b(i);
+            for(int k = 0; k < i; k++)
+                total -= U(k, i) * z(k);
+            z(i) = total / U(i, i);
+        }
+        // Backward substitution with U
+        vectype x(n);
+        for(int i = n - 1; i >= 0; i--) {
+            double total = z(i);
+            for(int k = i + 1; k < n; k++)
+                total -= U(i, k) * x(k);
+            x(i) = total / U(i, i);
+        }
+        return x;
+    }
+    bool is_symmetric_corr(float rho_ij, float rho_ji) {
+        // Correlations are between 0 and 1, so an absolute tolerance suffices
+        return fabs(rho_ij - rho_ji) <= 1e-5;
     }
-    return output;
 }
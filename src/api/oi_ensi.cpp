@@ -8,9 +8,15 @@
 using namespace gridpp;
 
 namespace {
+#ifdef GRIDPP_OI_FLOAT
+    typedef arma::fmat mattype;
+    typedef arma::fvec vectype;
+    typedef arma::cx_fmat cxtype;
+#else
     typedef arma::mat mattype;
     typedef arma::vec vectype;
     typedef arma::cx_mat cxtype;
+#endif
 
     void check_vec(vec2 input, int Y, int X);
     void check_vec(vec input, int S);
@@ -137,7 +143,6 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
     if(nS == 0)
         return background;
 
-    int mY = -1;  // Write debug information for this station index
     int num_parameters = 2;
     float sigmac = 0.5;
     float delta = 1;
@@ -150,7 +155,7 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
     vec2 output = background;
 
     int num_condition_warning = 0;
-    int num_real_part_warning = 0;
+    int num_eigen_warning = 0;
 
     vec blats = bpoints.get_lats();
     vec blons = bpoints.get_lons();
@@ -192,17 +197,40 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
         }
     }
 
-    // This causes segmentation fault when building the gridpp pypi package
-    // 1) Tested removing num_condition_warning and num_real_part_warning from the parallel loop
-    //    but it doesnt seem to help
-    // #pragma omp parallel for
+    // Look up spatially varying structure parameters once, instead of for each correlation
+    ivec bindices = structure.get_parameter_indices(bpoints);
+
+    // Each thread keeps its own Armadillo workspaces, which are resized (rather than reallocated)
+    // from one gridpoint to the next. Nothing inside the loop writes to shared state other than
+    // the output row belonging to the gridpoint, so the result does not depend on the number of
+    // threads.
+    #pragma omp parallel reduction(+:num_condition_warning,num_eigen_warning)
+    {
+    ivec lLocIndices;
+    std::vector<std::pair<float,int> > lRhos0;
+    vectype lRhos;
+    vectype lObs;
+    mattype lY;
+    vectype lYhat;
+    mattype Rinv;
+    mattype C;
+    mattype Pinv;
+    mattype P;
+    vectype eigval;
+    vectype eigval_inv;
+    vectype eigval_sqrt;
+    mattype eigvec;
+    mattype W;
+    mattype PC;
+    vectype w;
+    vectype X;
+
+    #pragma omp for
     for(int y = 0; y < nY; y++) {
         float lat = blats[y];
         float lon = blons[y];
-        float elev = belevs[y];
-        float laf = blafs[y];
         Point p1 = bpoints.get_point(y);
-        float localizationRadius = structure.localization_distance(p1);
+        float localizationRadius = structure.localization_distance_indexed(p1, bindices[y]);
 
         // Create list of locations for this gridpoint
         ivec lLocIndices0 = points.get_neighbours(lat, lon, localizationRadius);
@@ -210,16 +238,16 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
             // If we have too few observations though, then use the background
             continue;
         }
-        ivec lLocIndices;
+        lLocIndices.clear();
         lLocIndices.reserve(lLocIndices0.size());
-        std::vector<std::pair<float,int> > lRhos0;
+        lRhos0.clear();
         // Calculate gridpoint to observation rhos
         lRhos0.reserve(lLocIndices0.size());
         for(int i = 0; i < lLocIndices0.size(); i++) {
             int index = lLocIndices0[i];
             if(gridpp::is_valid(pobs[index])) {
                 Point p2 = points.get_point(index);
-                float rho = structure.corr_background(p1, p2);
+                float rho = structure.corr_background_indexed(p1, p2, bindices[y]);
                 if(rho > 0) {
                     lRhos0.push_back(std::pair<float,int>(rho, i));
                 }
@@ -227,11 +255,10 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
         }
 
         // Make sure we don't use too many observations
-        arma::vec lRhos;
         if(max_points > 0 && lRhos0.size() > max_points) {
             // If sorting is enabled and we have too many locations, then only keep the best ones based on rho.
             // Otherwise, just use the last locations added
-            lRhos = arma::vec(max_points);
+            lRhos.set_size(max_points);
             std::sort(lRhos0.begin(), lRhos0.end(), ::sort_pair_first<float,int>());
             for(int i = 0; i < max_points; i++) {
                 // The best values start at the end of the array
@@ -241,7 +268,7 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
             }
         }
         else {
-            lRhos = arma::vec(lRhos0.size());
+            lRhos.set_size(lRhos0.size());
             for(int i = 0; i < lRhos0.size(); i++) {
                 int index = lRhos0[i].second;
                 lLocIndices.push_back(lLocIndices0[index]);
@@ -255,19 +282,15 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
             continue;
         }
 
-        vectype lObs(lS);
-        vectype lElevs(lS);
-        vectype lLafs(lS);
+        lObs.set_size(lS);
         for(int i = 0; i < lLocIndices.size(); i++) {
             int index = lLocIndices[i];
             lObs[i] = pobs[index];
-            lElevs[i] = pelevs[index];
-            lLafs[i] = plafs[index];
         }
 
         // Compute Y (model at obs-locations)
-        mattype lY(lS, nValidEns);
-        vectype lYhat(lS);
+        lY.set_size(lS, nValidEns);
+        lYhat.set_size(lS);
 
         for(int i = 0; i < lS; i++) {
             // Use the nearest neighbour for this location
@@ -280,7 +303,7 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
         }
 
         // Compute Rinv
-        mattype Rinv(lS, lS, arma::fill::zeros);
+        Rinv.zeros(lS, lS);
         if(num_parameters == 2) {
             for(int i = 0; i < lS; i++) {
                 int index = lLocIndices[i];
@@ -363,61 +386,37 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
 
         // Compute C matrix
         // k x nS * nS x nS
-        mattype C(nValidEns, lS);
         C = lY.t() * Rinv;
 
-        mattype Pinv(nValidEns, nValidEns);
         float diag = 1 / delta * (nValidEns - 1);
 
         Pinv = C * lY + diag * arma::eye<mattype>(nValidEns, nValidEns);
-        float cond = arma::rcond(Pinv);
-        if(cond <= 0) {
-            num_condition_warning++;
-            continue;
-        }
-
-        // Compute sqrt of matrix. Armadillo 6.6 has this function, but on many systems this
-        // is not available. Therefore, compute sqrt using the method found in 6.6
-        // cxtype Wcx(nValidEns, nValidEns);
-        // status = arma::sqrtmat(Wcx, (nValidEns - 1) * P);
-        // mattype W = arma::real(Wcx);
 
-        mattype P = arma::inv(Pinv);
-        vectype eigval;
-        mattype eigvec;
-        bool status = arma::eig_sym(eigval, eigvec, (nValidEns - 1) * P);
+        // Pinv is symmetric positive definite. Instead of inverting it and then computing the
+        // square root of (nValidEns - 1) * P, use the eigen decomposition Pinv = V D V', which
+        // gives both P = V D^-1 V' and W = V sqrt((nValidEns - 1) D^-1) V'.
+        bool status = arma::eig_sym(eigval, eigvec, Pinv);
         if(!status) {
-            std::cout << "Cannot find eigenvector:" << std::endl;
-            std::cout << "Lat: " << lat << std::endl;
-            std::cout << "Lon: " << lon << std::endl;
-            std::cout << "Elev: " << elev << std::endl;
-            std::cout << "Laf: " << laf << std::endl;
-            std::cout << "Pinv" << std::endl;
-            print_matrix<mattype>(Pinv);
-            std::cout << "P" << std::endl;
-            print_matrix<mattype>(P);
-            std::cout << "Y:" << std::endl;
-            print_matrix<mattype>(lY);
-            std::cout << "lObs:" << std::endl;
-            print_matrix<mattype>(lObs);
-            std::cout << "Yhat" << std::endl;
-            print_matrix<mattype>(lYhat);
+            num_eigen_warning++;
+            continue;
         }
-        eigval = sqrt(eigval);
-        mattype Wcx = eigvec * arma::diagmat(eigval) * eigvec.t();
-        mattype W = arma::real(Wcx);
-
-        if(W.n_rows == 0) {
-            num_real_part_warning++;
+        if(!(arma::min(eigval) > 0)) {
+            num_condition_warning++;
             continue;
         }
+        eigval_inv.set_size(nValidEns);
+        eigval_sqrt.set_size(nValidEns);
+        for(int e = 0; e < nValidEns; e++) {
+            eigval_inv(e) = 1 / eigval(e);
+            eigval_sqrt(e) = sqrt((nValidEns - 1) * eigval_inv(e));
+        }
+        P = eigvec * arma::diagmat(eigval_inv) * eigvec.t();
+        W = eigvec * arma::diagmat(eigval_sqrt) * eigvec.t();
 
         // Compute PC
-        mattype PC(nValidEns, lS);
         PC = P * C;
 
         // Compute w
-        vectype w(nValidEns);
         if(diagnose)
             w = PC * (arma::ones<vectype>(lS));
         else
@@ -431,7 +430,7 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
         }
 
         // Compute X (perturbations about model mean)
-        vectype X(nValidEns);
+        X.set_size(nValidEns);
         float total = 0;
         int count = 0;
         for(int e = 0; e < nValidEns; e++) {
@@ -448,47 +447,6 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
             X(e) -= ensMean;
         }
 
-        // Write debugging information
-        if(y == mY) {
-            std::cout << "Lat: " << lat << std::endl;
-            std::cout << "Lon: " << lon << " " << lat << " " << std::endl;
-            std::cout << "Elev: " << elev << std::endl;
-            std::cout << "Laf: " << laf << std::endl;
-            std::cout << "Num obs: " << lS << std::endl;
-            std::cout << "Num ens: " << nValidEns << std::endl;
-            std::cout << "rhos" << std::endl;
-            print_matrix<mattype>(lRhos);
-            std::cout << "P" << std::endl;
-            print_matrix<mattype>(P);
-            std::cout << "C" << std::endl;
-            print_matrix<mattype>(C);
-            std::cout << "C * lY" << std::endl;
-            print_matrix<mattype>(C * lY);
-            std::cout << "PC" << std::endl;
-            print_matrix<mattype>(PC);
-            std::cout << "W" << std::endl;
-            print_matrix<mattype>(W);
-            std::cout << "w" << std::endl;
-            print_matrix<mattype>(w);
-            std::cout << "Y:" << std::endl;
-            print_matrix<mattype>(lY);
-            std::cout << "Yhat" << std::endl;
-            print_matrix<mattype>(lYhat);
-            std::cout << "lObs" << std::endl;
-            print_matrix<mattype>(lObs);
-            std::cout << "lObs - Yhat" << std::endl;
-            print_matrix<mattype>(lObs - lYhat);
-            std::cout << "X" << std::endl;
-            print_matrix<mattype>(X);
-            std::cout << "elevs" << std::endl;
-            print_matrix<mattype>(lElevs);
-            std::cout << "lafs" << std::endl;
-            print_matrix<mattype>(lLafs);
-            std::cout << "Analysis increment:" << std::endl;
-            print_matrix<mattype>(X.t() * W);
-            std::cout << "My: " << arma::mean(arma::dot(lObs - lYhat, lRhos) / lS) << std::endl;
-        }
-
         // Compute analysis
         for(int e = 0; e < nValidEns; e++) {
             int ei = validEns[e];
@@ -509,18 +467,12 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
                 // at station points
                 float maxInc = arma::max(lObs - (lY[e] + lYhat));
                 float minInc = arma::min(lObs - (lY[e] + lYhat));
-                if(y == mY) {
-                    std::cout << "Increments: " << maxInc << " " << minInc << " " << currIncrement << std::endl;
-                }
 
                 // The increment for this member. currIncrement is the increment relative to
                 // ensemble mean
                 float memberIncrement = currIncrement - X(e);
                 // Adjust increment if it gives a member increment that is outside the range
                 // of the observation increments
-                if(y == mY) {
-                    std::cout << "Analysis increment: " << memberIncrement << " " << ensMean << " " << currIncrement << " " << X(e) << std::endl;
-                }
                 if(maxInc > 0 && memberIncrement > maxInc) {
                     currIncrement = maxInc + X(e);
                 }
@@ -533,22 +485,20 @@ vec2 gridpp::optimal_interpolation_ensi(const gridpp::Points& bpoints,
                 else if(minInc > 0 && memberIncrement < 0) {
                     currIncrement = 0 + X(e);
                 }
-                if(y == mY) {
-                    std::cout << "Final increment: " << currIncrement << " " << currIncrement - X(e) << std::endl;
-                }
             }
             output[y][ei] = ensMean + currIncrement;
         }
     }
+    }
 
     if(num_condition_warning > 0) {
         std::stringstream ss;
         ss << "Condition number error in " << num_condition_warning << " points. Using raw values in those points.";
         gridpp::warning(ss.str());
     }
-    if(num_real_part_warning > 0) {
+    if(num_eigen_warning > 0) {
         std::stringstream ss;
-        ss << "Could not find the real part of W in " << num_real_part_warning << " points. Using raw values in those points.";
+        ss << "Could not find eigenvectors in " << num_eigen_warning << " points. Using raw values in those points.";
         gridpp::warning(ss.str());
     }
     return output;
@@ -59,6 +59,12 @@ int gridpp::Points::get_nearest_neighbour(float lat, float lon, bool include_mat
     else
         return -1;
 }
+void gridpp::Points::get_nearest_neighbours(const vec& lats, const vec& lons, ivec& output, bool include_match) const {
+    mTree.get_nearest_neighbours(lats, lons, output, include_match);
+}
+void gridpp::Points::get_neighbours(const vec& lats, const vec& lons, float radius, ivec& offsets, ivec& indices, bool include_match) const {
+    mTree.get_neighbours(lats, lons, radius, offsets, indices, include_match);
+}
 vec gridpp::Points::get_lats() const {
     return mLats;
 }
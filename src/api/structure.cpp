@@ -2,6 +2,13 @@
 
 using namespace gridpp;
 
+namespace {
+    /** Distance from p1 to points[start:], computed in the same way as KDTree::calc_distance_fast
+      * but with the coordinate type resolved outside the loop
+    */
+    void calc_distances(const Point& p1, const vec& lats, const vec& lons, int start, vec& output);
+}
+
 const float gridpp::StructureFunction::default_min_rho = 0.0013;
 
 gridpp::StructureFunction::StructureFunction(float localization_distance) {
@@ -35,6 +42,41 @@ float gridpp::StructureFunction::cressman_rho(float dist, float length) const {
 float gridpp::StructureFunction::localization_distance(const Point& p) const {
     return m_localization_distance;
 }
+ivec gridpp::StructureFunction::get_parameter_indices(const Points& points) const {
+    return ivec(points.size(), -1);
+}
+int gridpp::StructureFunction::get_parameter_index(const Point& p) const {
+    return -1;
+}
+float gridpp::StructureFunction::corr_indexed(const Point& p1, const Point& p2, int index1) const {
+    return corr(p1, p2);
+}
+float gridpp::StructureFunction::corr_background_indexed(const Point& p1, const Point& p2, int index1) const {
+    // The default corr_background is corr. Structures that override corr_background must also
+    // override this function.
+    return corr_indexed(p1, p2, index1);
+}
+float gridpp::StructureFunction::localization_distance_indexed(const Point& p, int index) const {
+    return localization_distance(p);
+}
+void gridpp::StructureFunction::corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const {
+    int N = lats.size();
+    output.resize(N);
+    for(int i = 0; i < N; i++) {
+        Point p2(lats[i], lons[i], elevs[i], lafs[i], p1.type);
+        output[i] = corr_indexed(p1, p2, index1);
+    }
+}
+void gridpp::StructureFunction::corr_matrix(const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, CoordinateType type, const ivec& indices, vec2& output) const {
+    int N = lats.size();
+    if(lons.size() != N || elevs.size() != N || lafs.size() != N || indices.size() != N)
+        throw std::invalid_argument("Coordinate and index vectors must be the same size");
+    output.resize(N);
+    for(int i = 0; i < N; i++) {
+        Point p1(lats[i], lons[i], elevs[i], lafs[i], type);
+        corr_row(p1, indices[i], lats, lons, elevs, lafs, output[i]);
+    }
+}
 gridpp::MultipleStructure::MultipleStructure(const StructureFunction& structure_h, const StructureFunction& structure_v, const StructureFunction& structure_w) {
     m_structure_h = structure_h.clone();
     m_structure_v = structure_v.clone();
@@ -55,6 +97,36 @@ float gridpp::MultipleStructure::corr(const Point& p1, const Point& p2) const {
     float corr_w = m_structure_w->corr(p1_w, p2_w);
     return corr_h * corr_v * corr_w;
 }
+ivec gridpp::MultipleStructure::get_parameter_indices(const Points& points) const {
+    return m_structure_h->get_parameter_indices(points);
+}
+int gridpp::MultipleStructure::get_parameter_index(const Point& p) const {
+    return m_structure_h->get_parameter_index(p);
+}
+float gridpp::MultipleStructure::localization_distance_indexed(const Point& p, int index) const {
+    return m_structure_h->localization_distance_indexed(p, index);
+}
+void gridpp::MultipleStructure::corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const {
+    // Each component only sees differences in its own dimension, like in corr. Leaving out the
+    // elevation and land area fraction of p1 disables those terms in the horizontal component.
+    Point p1_h(p1.lat, p1.lon, gridpp::MV, gridpp::MV, p1.type);
+    m_structure_h->corr_row(p1_h, index1, lats, lons, elevs, lafs, output);
+
+    // The other points are at p1's location for the vertical and land/sea components, so their
+    // parameter indices are the same for the whole row
+    Point p1_v(p1.lat, p1.lon, p1.elev, gridpp::MV, p1.type);
+    Point p1_w(p1.lat, p1.lon, gridpp::MV, p1.laf, p1.type);
+    int index_v = m_structure_v->get_parameter_index(p1_v);
+    int index_w = m_structure_w->get_parameter_index(p1_w);
+    int N = lats.size();
+    for(int i = 0; i < N; i++) {
+        if(output[i] == 0)
+            continue;
+        Point p2_v(p1.lat, p1.lon, elevs[i], gridpp::MV, p1.type);
+        Point p2_w(p1.lat, p1.lon, gridpp::MV, lafs[i], p1.type);
+        output[i] *= m_structure_v->corr_indexed(p1_v, p2_v, index_v) * m_structure_w->corr_indexed(p1_w, p2_w, index_w);
+    }
+}
 gridpp::StructureFunction* gridpp::MultipleStructure::clone() const {
     gridpp::StructureFunction* val = new gridpp::MultipleStructure(*m_structure_h, *m_structure_v, *m_structure_w);
     return val;
@@ -104,36 +176,23 @@ gridpp::BarnesStructure::BarnesStructure(Grid grid, vec2 h, vec2 v, vec2 w, floa
     }
 }
 float gridpp::BarnesStructure::corr(const Point& p1, const Point& p2) const {
+    return corr_indexed(p1, p2, get_parameter_index(p1));
+}
+float gridpp::BarnesStructure::corr_indexed(const Point& p1, const Point& p2, int index1) const {
+    if(index1 < 0)
+        index1 = get_parameter_index(p1);
     float hdist = gridpp::KDTree::calc_distance_fast(p1, p2);
-    if(hdist > localization_distance(p1))
+    if(hdist > localization_distance_indexed(p1, index1))
         return 0;
     float rho = 1;
     if(m_is_spatial) {
-        ivec I = m_grid.get_nearest_neighbour(p1.lat, p1.lon);
-        if(I[0] > mH.size())
-            throw std::runtime_error("Invalid I[0]");
-        if(I[1] > mH[I[0]].size())
-            throw std::runtime_error("Invalid I[1]");
-        float h1 = mH[I[0]][I[1]];
-        float v1 = mV[I[0]][I[1]];
-        float w1 = mW[I[0]][I[1]];
-#if 0
-        I = m_grid.get_nearest_neighbour(p2.lat, p2.lon);
-        if(I[0] > mH.size())
-            throw std::runtime_error("Invalid i[0]");
-        if(I[1] > mH[I[0]].size())
-            throw std::runtime_error("Invalid I[1]");
-        float h2 = mH[I[0]][I[1]];
-        float v2 = mV[I[0]][I[1]];
-        float w2 = mW[I[0]][I[1]];
-        float h = (h1 + h2) / 2;
-        float v = (v1 + v2) / 2;
-        float w = (w1 + w2) / 2;
-#else
-        float h = h1;
-        float v = v1;
-        float w = w1;
-#endif
+        int nX = mH[0].size();
+        int Y = index1 / nX;
+        int X = index1 % nX;
+        // Only the scales at p1 are used
+        float h = mH[Y][X];
+        float v = mV[Y][X];
+        float w = mW[Y][X];
 
         rho = gridpp::StructureFunction::barnes_rho(hdist, h);
         if(gridpp::is_valid(p1.elev) && gridpp::is_valid(p2.elev)) {
@@ -158,6 +217,111 @@ float gridpp::BarnesStructure::corr(const Point& p1, const Point& p2) const {
     }
     return rho;
 }
+void gridpp::BarnesStructure::corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const {
+    int N = lats.size();
+    output.resize(N);
+    if(index1 < 0)
+        index1 = get_parameter_index(p1);
+    float h = mH[0][0];
+    float v = mV[0][0];
+    float w = mW[0][0];
+    if(m_is_spatial) {
+        int nX = mH[0].size();
+        h = mH[index1 / nX][index1 % nX];
+        v = mV[index1 / nX][index1 % nX];
+        w = mW[index1 / nX][index1 % nX];
+    }
+    float hmax = localization_distance_indexed(p1, index1);
+    bool has_elev = gridpp::is_valid(p1.elev);
+    bool has_laf = gridpp::is_valid(p1.laf);
+
+    ::calc_distances(p1, lats, lons, 0, output);
+    for(int i = 0; i < N; i++) {
+        float hdist = output[i];
+        if(hdist > hmax) {
+            output[i] = 0;
+            continue;
+        }
+        float rho = gridpp::StructureFunction::barnes_rho(hdist, h);
+        if(has_elev && gridpp::is_valid(elevs[i])) {
+            float vdist = p1.elev - elevs[i];
+            rho *= gridpp::StructureFunction::barnes_rho(vdist, v);
+        }
+        if(has_laf && gridpp::is_valid(lafs[i])) {
+            float lafdist = p1.laf - lafs[i];
+            rho *= gridpp::StructureFunction::barnes_rho(lafdist, w);
+        }
+        output[i] = rho;
+    }
+}
+void gridpp::BarnesStructure::corr_matrix(const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, CoordinateType type, const ivec& indices, vec2& output) const {
+    if(m_is_spatial) {
+        // The scales at the first point are used, so the matrix is not symmetric
+        StructureFunction::corr_matrix(lats, lons, elevs, lafs, type, indices, output);
+        return;
+    }
+    int N = lats.size();
+    if(lons.size() != N || elevs.size() != N || lafs.size() != N || indices.size() != N)
+        throw std::invalid_argument("Coordinate and index vectors must be the same size");
+    output.resize(N);
+    for(int i = 0; i < N; i++)
+        output[i].resize(N);
+
+    // Only compute the upper triangle
+    float hmax = sqrt(-2*log(m_min_rho)) * mH[0][0];
+    for(int i = 0; i < N; i++) {
+        Point p1(lats[i], lons[i], elevs[i], lafs[i], type);
+        vec& row = output[i];
+        ::calc_distances(p1, lats, lons, i, row);
+        for(int j = i; j < N; j++) {
+            float hdist = row[j];
+            float rho = 0;
+            if(hdist <= hmax) {
+                rho = gridpp::StructureFunction::barnes_rho(hdist, mH[0][0]);
+                if(gridpp::is_valid(p1.elev) && gridpp::is_valid(elevs[j])) {
+                    float vdist = p1.elev - elevs[j];
+                    rho *= gridpp::StructureFunction::barnes_rho(vdist, mV[0][0]);
+                }
+                if(gridpp::is_valid(p1.laf) && gridpp::is_valid(lafs[j])) {
+                    float lafdist = p1.laf - lafs[j];
+                    rho *= gridpp::StructureFunction::barnes_rho(lafdist, mW[0][0]);
+                }
+            }
+            row[j] = rho;
+            output[j][i] = rho;
+        }
+    }
+}
+int gridpp::BarnesStructure::get_parameter_index(const Point& p) const {
+    if(!m_is_spatial)
+        return 0;
+    ivec I = m_grid.get_nearest_neighbour(p.lat, p.lon);
+    if(I.size() != 2)
+        throw std::runtime_error("Could not find nearest neighbour in structure grid");
+    if(I[0] < 0 || I[0] >= mH.size() || I[0] >= mV.size() || I[0] >= mW.size())
+        throw std::runtime_error("Invalid I[0]");
+    if(I[1] < 0 || I[1] >= mH[I[0]].size() || I[1] >= mV[I[0]].size() || I[1] >= mW[I[0]].size())
+        throw std::runtime_error("Invalid I[1]");
+    return I[0] * mH[0].size() + I[1];
+}
+ivec gridpp::BarnesStructure::get_parameter_indices(const Points& points) const {
+    int N = points.size();
+    ivec indices(N, 0);
+    if(!m_is_spatial)
+        return indices;
+
+    vec lats = points.get_lats();
+    vec lons = points.get_lons();
+    #pragma omp parallel for
+    for(int i = 0; i < N; i++) {
+        ivec I = m_grid.get_nearest_neighbour(lats[i], lons[i]);
+        if(I.size() == 2)
+            indices[i] = I[0] * mH[0].size() + I[1];
+        else
+            indices[i] = -1;
+    }
+    return indices;
+}
 /*
 float gridpp::BarnesStructure::corr_background(const Point& p1, const Point& p2) const {
     return corr(p1, p2);
@@ -175,9 +339,14 @@ gridpp::StructureFunction* gridpp::BarnesStructure::clone() const {
     return val;
 }
 float gridpp::BarnesStructure::localization_distance(const Point& p) const {
+    return localization_distance_indexed(p, get_parameter_index(p));
+}
+float gridpp::BarnesStructure::localization_distance_indexed(const Point& p, int index) const {
     if(m_is_spatial) {
-        ivec I = m_grid.get_nearest_neighbour(p.lat, p.lon);
-        float curr = sqrt(-2*log(m_min_rho)) * mH[I[0]][I[1]];
+        if(index < 0)
+            index = get_parameter_index(p);
+        int nX = mH[0].size();
+        float curr = sqrt(-2*log(m_min_rho)) * mH[index / nX][index % nX];
         return curr;
     }
     else {
@@ -210,6 +379,23 @@ float gridpp::CressmanStructure::corr(const Point& p1, const Point& p2) const {
     }
     return rho;
 }
+void gridpp::CressmanStructure::corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const {
+    int N = lats.size();
+    output.resize(N);
+    ::calc_distances(p1, lats, lons, 0, output);
+    for(int i = 0; i < N; i++) {
+        float rho = gridpp::StructureFunction::cressman_rho(output[i], mH);
+        if(gridpp::is_valid(p1.elev) && gridpp::is_valid(elevs[i])) {
+            float vdist = p1.elev - elevs[i];
+            rho *= gridpp::StructureFunction::cressman_rho(vdist, mV);
+        }
+        if(gridpp::is_valid(p1.laf) && gridpp::is_valid(lafs[i])) {
+            float lafdist = p1.laf - lafs[i];
+            rho *= gridpp::StructureFunction::cressman_rho(lafdist, mW);
+        }
+        output[i] = rho;
+    }
+}
 gridpp::StructureFunction* gridpp::CressmanStructure::clone() const {
     gridpp::StructureFunction* val = new gridpp::CressmanStructure(mH, mV, mW);
     return val;
@@ -241,3 +427,56 @@ gridpp::StructureFunction* gridpp::CrossValidation::clone() const {
 float gridpp::CrossValidation::localization_distance(const Point& p) const {
     return m_structure->localization_distance(p);
 }
+ivec gridpp::CrossValidation::get_parameter_indices(const Points& points) const {
+    return m_structure->get_parameter_indices(points);
+}
+int gridpp::CrossValidation::get_parameter_index(const Point& p) const {
+    return m_structure->get_parameter_index(p);
+}
+float gridpp::CrossValidation::corr_indexed(const Point& p1, const Point& p2, int index1) const {
+    return m_structure->corr_indexed(p1, p2, index1);
+}
+float gridpp::CrossValidation::corr_background_indexed(const Point& p1, const Point& p2, int index1) const {
+    float hdist = gridpp::KDTree::calc_distance_fast(p1, p2);
+    if(gridpp::is_valid(m_dist)) {
+        if(hdist <= m_dist)
+            return 0;
+    }
+    return m_structure->corr_background_indexed(p1, p2, index1);
+}
+float gridpp::CrossValidation::localization_distance_indexed(const Point& p, int index) const {
+    return m_structure->localization_distance_indexed(p, index);
+}
+void gridpp::CrossValidation::corr_row(const Point& p1, int index1, const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, vec& output) const {
+    m_structure->corr_row(p1, index1, lats, lons, elevs, lafs, output);
+}
+void gridpp::CrossValidation::corr_matrix(const vec& lats, const vec& lons, const vec& elevs, const vec& lafs, CoordinateType type, const ivec& indices, vec2& output) const {
+    m_structure->corr_matrix(lats, lons, elevs, lafs, type, indices, output);
+}
+
+namespace {
+    void calc_distances(const Point& p1, const vec& lats, const vec& lons, int start, vec& output) {
+        int N = lats.size();
+        if(p1.type == gridpp::Cartesian) {
+            for(int i = start; i < N; i++) {
+                float dx = p1.lon - lons[i];
+                float dy = p1.lat - lats[i];
+                output[i] = sqrt(dx * dx + dy * dy);
+            }
+        }
+        else if(p1.type == gridpp::Geodetic) {
+            double lat1r = gridpp::KDTree::deg2rad(p1.lat);
+            double lon1r = gridpp::KDTree::deg2rad(p1.lon);
+            for(int i = start; i < N; i++) {
+                double lat2r = float(lats[i] * M_PI / 180);
+                double lon2r = float(lons[i] * M_PI / 180);
+                float dx2 = pow(cos((lat1r+lat2r)/2),2)*(lon1r-lon2r)*(lon1r-lon2r);
+                float dy2 = (lat1r-lat2r)*(lat1r-lat2r);
+                output[i] = gridpp::radius_earth*sqrt(dx2+dy2);
+            }
+        }
+        else {
+            throw std::runtime_error("Unknown coordinate type");
+        }
+    }
+}
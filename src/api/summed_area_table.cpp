@@ -0,0 +1,173 @@
+#include "gridpp.h"
+#include <cmath>
+
+using namespace gridpp;
+
+namespace {
+    /** Total of a table in a rectangle that is inside the field, with corners (y0, x0) and (y1, x1) */
+    template <class T> T query(const std::vector<T>& table, int X, int y0, int x0, int y1, int x1);
+}
+
+gridpp::SummedAreaTable::SummedAreaTable() : mY(0), mX(0), mHasSquares(false) {
+}
+gridpp::SummedAreaTable::SummedAreaTable(const Field2D& input, bool compute_squares) :
+    mY(input.size_y()), mX(input.size_x()), mHasSquares(compute_squares) {
+    std::vector<const float*> rows(mY);
+    for(int y = 0; y < mY; y++)
+        rows[y] = input.data() + size_t(y) * mX;
+    build(rows, !input.has_missing());
+}
+gridpp::SummedAreaTable::SummedAreaTable(const vec2& input, bool compute_squares) :
+    mY(input.size()), mX(0), mHasSquares(compute_squares) {
+    if(mY > 0)
+        mX = input[0].size();
+    // Read the rows in place, instead of copying them into a Field2D
+    bool all_valid = true;
+    std::vector<const float*> rows(mY);
+    for(int y = 0; y < mY; y++) {
+        if(input[y].size() != mX)
+            throw std::invalid_argument("Cannot create a summed area table from a 2D vector with rows of different length");
+        rows[y] = input[y].data();
+        for(int x = 0; x < mX && all_valid; x++) {
+            all_valid = gridpp::is_valid(rows[y][x]);
+        }
+    }
+    build(rows, all_valid);
+}
+void gridpp::SummedAreaTable::build(const std::vector<const float*>& rows, bool all_valid) {
+    size_t N = size_t(mY) * mX;
+    mSums.resize(N);
+    mCounts.resize(N);
+    if(mHasSquares)
+        mSquares.resize(N);
+
+    int block_size = 256;
+    int num_blocks = (mX + block_size - 1) / block_size;
+    #pragma omp parallel
+    {
+        // Accumulate along each row
+        #pragma omp for
+        for(int y = 0; y < mY; y++) {
+            double sum = 0;
+            double sum_squares = 0;
+            int count = 0;
+            for(int x = 0; x < mX; x++) {
+                size_t index = size_t(y) * mX + x;
+                float value = rows[y][x];
+                if(all_valid || gridpp::is_valid(value)) {
+                    sum += value;
+                    // Square in single precision, like when squaring the input field
+                    sum_squares += value * value;
+                    count++;
+                }
+                mSums[index] = sum;
+                mCounts[index] = count;
+                if(mHasSquares)
+                    mSquares[index] = sum_squares;
+            }
+        }
+
+        // Accumulate down each column, in blocks of columns so that the inner loop is contiguous
+        #pragma omp for
+        for(int b = 0; b < num_blocks; b++) {
+            int x_start = b * block_size;
+            int x_end = std::min(mX, x_start + block_size);
+            for(int y = 1; y < mY; y++) {
+                size_t curr = size_t(y) * mX;
+                size_t prev = size_t(y - 1) * mX;
+                for(int x = x_start; x < x_end; x++) {
+                    mSums[curr + x] += mSums[prev + x];
+                    mCounts[curr + x] += mCounts[prev + x];
+                }
+                if(mHasSquares) {
+                    for(int x = x_start; x < x_end; x++) {
+                        mSquares[curr + x] += mSquares[prev + x];
+                    }
+                }
+            }
+        }
+    }
+}
+bool gridpp::SummedAreaTable::clip(int& y0, int& x0, int& y1, int& x1) const {
+    y0 = std::max(y0, 0);
+    x0 = std::max(x0, 0);
+    y1 = std::min(y1, mY - 1);
+    x1 = std::min(x1, mX - 1);
+    return y0 <= y1 && x0 <= x1;
+}
+double gridpp::SummedAreaTable::sum(int y0, int x0, int y1, int x1) const {
+    if(!clip(y0, x0, y1, x1))
+        return 0;
+    return query(mSums, mX, y0, x0, y1, x1);
+}
+int gridpp::SummedAreaTable::count(int y0, int x0, int y1, int x1) const {
+    if(!clip(y0, x0, y1, x1))
+        return 0;
+    return query(mCounts, mX, y0, x0, y1, x1);
+}
+double gridpp::SummedAreaTable::sum_squares(int y0, int x0, int y1, int x1) const {
+    if(!mHasSquares)
+        throw std::invalid_argument("Summed area table was created without squares");
+    if(!clip(y0, x0, y1, x1))
+        return 0;
+    return query(mSquares, mX, y0, x0, y1, x1);
+}
+Field2D gridpp::SummedAreaTable::neighbourhood(int halfwidth, Statistic statistic) const {
+    if(halfwidth < 0)
+        throw std::invalid_argument("Half width must be > 0");
+    bool is_std = statistic == gridpp::Std || statistic == gridpp::Variance;
+    if(statistic != gridpp::Mean && statistic != gridpp::Sum && statistic != gridpp::Count && !is_std)
+        throw std::invalid_argument("Summed area tables only support Mean, Sum, Count, Std, and Variance");
+    if(is_std && !mHasSquares)
+        throw std::invalid_argument("Summed area table was created without squares");
+
+    Field2D output(mY, mX, gridpp::MV);
+    #pragma omp parallel for
+    for(int i = 0; i < mY; i++) {
+        int i0 = std::max(0, i - halfwidth);
+        int i1 = std::min(mY - 1, i + halfwidth);
+        for(int j = 0; j < mX; j++) {
+            int j0 = std::max(0, j - halfwidth);
+            int j1 = std::min(mX - 1, j + halfwidth);
+            int count = query(mCounts, mX, i0, j0, i1, j1);
+            if(statistic == gridpp::Count) {
+                output(i, j) = count;
+            }
+            else if(count > 0) {
+                double value = query(mSums, mX, i0, j0, i1, j1);
+                if(statistic == gridpp::Sum) {
+                    output(i, j) = value;
+                }
+                else if(statistic == gridpp::Mean) {
+                    output(i, j) = value / count;
+                }
+                else {
+                    float mean = value / count;
+                    float mean2 = query(mSquares, mX, i0, j0, i1, j1) / count;
+                    float variance = mean2 - mean * mean;
+                    if(statistic == gridpp::Std)
+                        output(i, j) = sqrt(variance);
+                    else
+                        output(i, j) = variance;
+                }
+            }
+        }
+    }
+    return output;
+}
+
+namespace {
+    template <class T> T query(const std::vector<T>& table, int X, int y0, int x0, int y1, int x1) {
+        T value11 = table[size_t(y1) * X + x1];
+        T value00 = 0;
+        T value10 = 0;
+        T value01 = 0;
+        if(y0 > 0 && x0 > 0)
+            value00 = table[size_t(y0 - 1) * X + x0 - 1];
+        if(x0 > 0)
+            value10 = table[size_t(y1) * X + x0 - 1];
+        if(y0 > 0)
+            value01 = table[size_t(y0 - 1) * X + x1];
+        return value11 + value00 - value10 - value01;
+    }
+}
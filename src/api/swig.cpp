@@ -42,6 +42,26 @@ float gridpp::test_vec3_input(const vec3& input) {
     }
     return total;
 }
+float gridpp::test_view2_input(const View2& input) {
+    float total = 0;
+    for(int i = 0; i < input.size_y(); i++) {
+        for(int j = 0; j < input.size_x(); j++) {
+            total += input(i, j);
+        }
+    }
+    return total;
+}
+float gridpp::test_view3_input(const View3& input) {
+    float total = 0;
+    for(int i = 0; i < input.size_y(); i++) {
+        for(int j = 0; j < input.size_x(); j++) {
+            for(int k = 0; k < input.size_e(); k++) {
+                total += input(i, j, k);
+            }
+        }
+    }
+    return total;
+}
 vec gridpp::test_vec_output() {
     vec output(3, swig_default_value);
     return output;
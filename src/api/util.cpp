@@ -10,6 +10,7 @@
 #include <iomanip>
 #include <cstdio>
 #include <exception>
+#include <algorithm>
 
 #ifdef DEBUG
 extern "C" void __gcov_flush();
@@ -17,146 +18,122 @@ extern "C" void __gcov_flush();
 
 using namespace gridpp;
 
-bool gridpp::is_valid(float value) {
-    return !std::isnan(value) && !std::isinf(value) && value != gridpp::MV;
+namespace {
+    /** Copies the valid values in array into a buffer that is reused between calls in the same
+      * thread, so that computing quantiles does not allocate memory
+      * @return Pointer to the first value. The number of values is written to N.
+      */
+    float* copy_valid(const float* array, int size, long stride, vec& temp, int& N);
+    /** Computes a statistic of size values spaced stride apart */
+    float calc_statistic(const float* array, int size, long stride, gridpp::Statistic statistic);
+    /** Computes a quantile of size values spaced stride apart */
+    float calc_quantile(const float* array, int size, long stride, float quantile);
+    /** Reduces the ensemble dimension of input using a statistic, or a quantile if statistic is Quantile */
+    Field2D reduce_members(const View3& input, gridpp::Statistic statistic, float quantile);
+    /** Sorts a small array in place, using insertion sort */
+    void sort_small(float* values, int N);
+    /** Finds the indices into the sorted array needed to compute a quantile, in the same way as calc_quantile */
+    void get_quantile_indices(float quantile, int N, int& lowerIndex, int& upperIndex);
+    /** Interpolates between the values at the lower and upper index */
+    float interpolate_quantile(float quantile, int N, int lowerIndex, int upperIndex, float lowerValue, float upperValue);
+
+    // Arrays up to this size are fully sorted, since this is faster than selection for small
+    // ensembles
+    const int small_array_size = 16;
+    // Arrays larger than this use a temporary buffer, so that large buffers are not kept alive
+    const int max_buffer_size = 65536;
 }
-float gridpp::calc_statistic(const vec& array, gridpp::Statistic statistic) {
-    // Initialize to missing
-    float value = gridpp::MV;
-    if(statistic == gridpp::Mean || statistic == gridpp::Sum || statistic == gridpp::Count) {
-        float total = 0;
-        int count = 0;
-        for(int n = 0; n < array.size(); n++) {
-            if(gridpp::is_valid(array[n])) {
-                total += array[n];
-                count++;
-            }
-        }
-        if (statistic == gridpp::Count)
-            value = count;
-        else if(count > 0) {
-            if(statistic == gridpp::Mean)
-                value = total / count;
-            else
-                value = total;
-        }
-    }
-    else if(statistic == gridpp::Std || statistic == gridpp::Variance) {
-        // STD = sqrt(E[X^2] - E[X]^2)
-        // The above formula is unstable when the variance is small and the mean is large.
-        // Use the property that VAR(X) = VAR(X-K). Provided K is any element in the array,
-        // the resulting calculation of VAR(X-K) is stable. Set K to the first non-missing value.
-        float total  = 0;
-        float total2 = 0;
-        float K = gridpp::MV;
-        int count = 0;
-        for(int n = 0; n < array.size(); n++) {
-            if(gridpp::is_valid(array[n])) {
-                if(!gridpp::is_valid(K))
-                    K = array[n];
-                assert(gridpp::is_valid(K));
 
-                total  += array[n] - K;
-                total2 += (array[n] - K)*(array[n] - K);
-                count++;
-            }
-        }
-        if(count > 0) {
-            float mean  = total / count;
-            float mean2 = total2 / count;
-            float var   = mean2 - mean*mean;
-            if(var < 0) {
-                // This should never happen
-                var = 0;
-                // Util::warning("CalibratorNeighbourhood: Problems computing std, unstable result. Setting value to 0");
-            }
-            value = var;
-            if(statistic == gridpp::Std) {
-                value = sqrt(var);
-            }
-        }
-    }
-    else {
-        float quantile = gridpp::MV;
-        if(statistic == gridpp::Min)
-            quantile = 0;
-        else if(statistic == gridpp::Median)
-            quantile = 0.5;
-        else if(statistic == gridpp::Max)
-            quantile = 1;
-        else
-            throw std::runtime_error("Internal error. Cannot compute statistic");
-        value = gridpp::calc_quantile(array, quantile);
+float gridpp::calc_statistic(const vec& array, gridpp::Statistic statistic) {
+    return ::calc_statistic(array.size() > 0 ? &array[0] : NULL, array.size(), 1, statistic);
+}
+bool gridpp::is_supported_statistic(gridpp::Statistic statistic) {
+    switch(statistic) {
+        case gridpp::Mean:
+        case gridpp::Min:
+        case gridpp::Median:
+        case gridpp::Max:
+        case gridpp::Std:
+        case gridpp::Variance:
+        case gridpp::Sum:
+        case gridpp::Count:
+            return true;
+        default:
+            return false;
     }
-    return value;
 }
-float gridpp::calc_quantile(const vec& array, float quantile) {
-    int T = array.size();
-    if(quantile < 0 || quantile > 1) {
+Field2D gridpp::calc_statistic(const View3& input, gridpp::Statistic statistic) {
+    // Check the statistic before the parallel loop, since exceptions cannot leave it
+    if(!gridpp::is_supported_statistic(statistic))
+        throw std::invalid_argument("Cannot compute this statistic. Use calc_quantile for quantiles.");
+    return ::reduce_members(input, statistic, gridpp::MV);
+}
+Field2D gridpp::calc_quantile(const View3& input, float quantile) {
+    if(quantile < 0 || quantile > 1)
         throw std::invalid_argument("calc_quantile: Quantile must be between 0 and 1 inclusive");
+    return ::reduce_members(input, gridpp::Quantile, quantile);
+}
+float gridpp::calc_quantile(const vec& array, float quantile) {
+    return ::calc_quantile(array.size() > 0 ? &array[0] : NULL, array.size(), 1, quantile);
+}
+vec gridpp::calc_quantiles(const vec& array, const vec& quantiles) {
+    for(int q = 0; q < quantiles.size(); q++) {
+        if(quantiles[q] < 0 || quantiles[q] > 1)
+            throw std::invalid_argument("calc_quantiles: Quantiles must be between 0 and 1 inclusive");
     }
-    if(!gridpp::is_valid(quantile))
-        return gridpp::MV;
+    vec output(quantiles.size(), gridpp::MV);
+    vec temp;
+    int N = 0;
+    float* values = ::copy_valid(array.size() > 0 ? &array[0] : NULL, array.size(), 1, temp, N);
+    if(N == 0)
+        return output;
 
-    if(T == 0)
-        return gridpp::MV;
-    if(quantile == 0) {
-        float min = gridpp::MV;
-        for(int i = 0; i < T; i++) {
-            float val = array[i];
-            if(!gridpp::is_valid(val))
-                continue;
-            else if(!gridpp::is_valid(min))
-                min = val;
-            else if(val < min)
-                min = val;
-        }
-        return min;
-    }
-    else if(quantile == 1) {
-        float max = gridpp::MV;
-        for(int i = 0; i < T; i++) {
-            float val = array[i];
-            if(!gridpp::is_valid(val))
-                continue;
-            else if(!gridpp::is_valid(max))
-                max = val;
-            else if(val > max)
-                max = val;
+    // Find all indices needed, and select them in increasing order so that each selection only
+    // needs to search the values above the previous index
+    ivec indices;
+    indices.reserve(2 * quantiles.size());
+    for(int q = 0; q < quantiles.size(); q++) {
+        if(gridpp::is_valid(quantiles[q])) {
+            int lowerIndex, upperIndex;
+            ::get_quantile_indices(quantiles[q], N, lowerIndex, upperIndex);
+            indices.push_back(lowerIndex);
+            indices.push_back(upperIndex);
         }
-        return max;
-    }
-    // Initialize to missing
-    float value = gridpp::MV;
-    // Remove missing
-    vec cleanHood;
-    cleanHood.reserve(array.size());
-    for(int i = 0; i < array.size(); i++) {
-        if(gridpp::is_valid(array[i]))
-            cleanHood.push_back(array[i]);
-    }
-    int N = cleanHood.size();
-    if(N > 0) {
-        std::sort(cleanHood.begin(), cleanHood.end());
-        int lowerIndex = floor(quantile * (N-1));
-        int upperIndex = ceil(quantile * (N-1));
-        float lowerQuantile = (float) lowerIndex / (N-1);
-        float upperQuantile = (float) upperIndex / (N-1);
-        float lowerValue = cleanHood[lowerIndex];
-        float upperValue = cleanHood[upperIndex];
-        if(lowerIndex == upperIndex) {
-            value = lowerValue;
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    if(N <= ::small_array_size) {
+        ::sort_small(values, N);
+    }
+    else {
+        int start = 0;
+        for(int i = 0; i < indices.size(); i++) {
+            std::nth_element(values + start, values + indices[i], values + N);
+            start = indices[i] + 1;
         }
-        else {
-            assert(upperQuantile > lowerQuantile);
-            assert(quantile >= lowerQuantile);
-            float f = (quantile - lowerQuantile)/(upperQuantile - lowerQuantile);
-            assert(f >= 0);
-            assert(f <= 1);
-            value   = lowerValue + (upperValue - lowerValue) * f;
+    }
+
+    for(int q = 0; q < quantiles.size(); q++) {
+        if(gridpp::is_valid(quantiles[q])) {
+            int lowerIndex, upperIndex;
+            ::get_quantile_indices(quantiles[q], N, lowerIndex, upperIndex);
+            output[q] = ::interpolate_quantile(quantiles[q], N, lowerIndex, upperIndex, values[lowerIndex], values[upperIndex]);
         }
     }
-    return value;
+    return output;
+}
+vec2 gridpp::calc_quantiles(const vec2& array, const vec& quantiles) {
+    for(int q = 0; q < quantiles.size(); q++) {
+        if(quantiles[q] < 0 || quantiles[q] > 1)
+            throw std::invalid_argument("calc_quantiles: Quantiles must be between 0 and 1 inclusive");
+    }
+    int N = array.size();
+    vec2 output(N);
+    #pragma omp parallel for
+    for(int n = 0; n < N; n++) {
+        output[n] = gridpp::calc_quantiles(array[n], quantiles);
+    }
+    return output;
 }
 vec gridpp::calc_quantile(const vec2& array, float quantile) {
     int N = array.size();
@@ -167,7 +144,17 @@ vec gridpp::calc_quantile(const vec2& array, float quantile) {
     return output;
 }
 vec2 gridpp::calc_quantile(const vec3& array, const vec2& quantile) {
-    gridpp::compatible_size(quantile, array);
+    if(!gridpp::compatible_size(quantile, array))
+        throw std::invalid_argument("calc_quantile: Quantile array does not have the same size as the input array");
+    // Check all quantiles before the parallel loop, since exceptions cannot leave it
+    for(int y = 0; y < quantile.size(); y++) {
+        if(quantile[y].size() != array[y].size())
+            throw std::invalid_argument("calc_quantile: Quantile array does not have the same size as the input array");
+        for(int x = 0; x < quantile[y].size(); x++) {
+            if(quantile[y][x] < 0 || quantile[y][x] > 1)
+                throw std::invalid_argument("calc_quantile: Quantile must be between 0 and 1 inclusive");
+        }
+    }
     int Y = array.size();
     if(Y == 0)
         return vec2();
@@ -178,6 +165,7 @@ vec2 gridpp::calc_quantile(const vec3& array, const vec2& quantile) {
     if(T == 0)
         return vec2();
     vec2 output = gridpp::init_vec2(Y, X);
+    #pragma omp parallel for
     for(int y = 0; y < Y; y++) {
         for(int x = 0; x < X; x++) {
             output[y][x] = gridpp::calc_quantile(array[y][x], quantile[y][x]);
@@ -519,3 +507,194 @@ bool gridpp::point_in_rectangle(const Point& A, const Point& B, const Point& C,
     bool opt2 = 0 <= D1 && 0 <= D4 && 0 >= D2 && 0 <= D3;
     return opt1 || opt2;
 }
+namespace {
+    float* copy_valid(const float* array, int size, long stride, vec& temp, int& N) {
+        static thread_local vec buffer;
+        vec& values = size > ::max_buffer_size ? temp : buffer;
+        if(values.size() < size)
+            values.resize(size);
+        N = 0;
+        for(int i = 0; i < size; i++) {
+            float value = array[i * stride];
+            if(gridpp::is_valid(value)) {
+                values[N] = value;
+                N++;
+            }
+        }
+        return values.size() > 0 ? &values[0] : NULL;
+    }
+    void sort_small(float* values, int N) {
+        for(int i = 1; i < N; i++) {
+            float value = values[i];
+            int j = i - 1;
+            while(j >= 0 && values[j] > value) {
+                values[j + 1] = values[j];
+                j--;
+            }
+            values[j + 1] = value;
+        }
+    }
+    void get_quantile_indices(float quantile, int N, int& lowerIndex, int& upperIndex) {
+        lowerIndex = floor(quantile * (N-1));
+        upperIndex = ceil(quantile * (N-1));
+    }
+    float interpolate_quantile(float quantile, int N, int lowerIndex, int upperIndex, float lowerValue, float upperValue) {
+        if(lowerIndex == upperIndex)
+            return lowerValue;
+        float lowerQuantile = (float) lowerIndex / (N-1);
+        float upperQuantile = (float) upperIndex / (N-1);
+        assert(upperQuantile > lowerQuantile);
+        assert(quantile >= lowerQuantile);
+        float f = (quantile - lowerQuantile)/(upperQuantile - lowerQuantile);
+        assert(f >= 0);
+        assert(f <= 1);
+        return lowerValue + (upperValue - lowerValue) * f;
+    }
+    float calc_statistic(const float* array, int size, long stride, gridpp::Statistic statistic) {
+        // Initialize to missing
+        float value = gridpp::MV;
+        if(statistic == gridpp::Mean || statistic == gridpp::Sum || statistic == gridpp::Count) {
+            float total = 0;
+            int count = 0;
+            for(int n = 0; n < size; n++) {
+                if(gridpp::is_valid(array[n * stride])) {
+                    total += array[n * stride];
+                    count++;
+                }
+            }
+            if (statistic == gridpp::Count)
+                value = count;
+            else if(count > 0) {
+                if(statistic == gridpp::Mean)
+                    value = total / count;
+                else
+                    value = total;
+            }
+        }
+        else if(statistic == gridpp::Std || statistic == gridpp::Variance) {
+            // STD = sqrt(E[X^2] - E[X]^2)
+            // The above formula is unstable when the variance is small and the mean is large.
+            // Use the property that VAR(X) = VAR(X-K). Provided K is any element in the array,
+            // the resulting calculation of VAR(X-K) is stable. Set K to the first non-missing value.
+            float total  = 0;
+            float total2 = 0;
+            float K = gridpp::MV;
+            int count = 0;
+            for(int n = 0; n < size; n++) {
+                if(gridpp::is_valid(array[n * stride])) {
+                    if(!gridpp::is_valid(K))
+                        K = array[n * stride];
+                    assert(gridpp::is_valid(K));
+
+                    total  += array[n * stride] - K;
+                    total2 += (array[n * stride] - K)*(array[n * stride] - K);
+                    count++;
+                }
+            }
+            if(count > 0) {
+                float mean  = total / count;
+                float mean2 = total2 / count;
+                float var   = mean2 - mean*mean;
+                if(var < 0) {
+                    // This should never happen
+                    var = 0;
+                    // Util::warning("CalibratorNeighbourhood: Problems computing std, unstable result. Setting value to 0");
+                }
+                value = var;
+                if(statistic == gridpp::Std) {
+                    value = sqrt(var);
+                }
+            }
+        }
+        else {
+            float quantile = gridpp::MV;
+            if(statistic == gridpp::Min)
+                quantile = 0;
+            else if(statistic == gridpp::Median)
+                quantile = 0.5;
+            else if(statistic == gridpp::Max)
+                quantile = 1;
+            else
+                throw std::runtime_error("Internal error. Cannot compute statistic");
+            value = ::calc_quantile(array, size, stride, quantile);
+        }
+        return value;
+    }
+    float calc_quantile(const float* array, int T, long stride, float quantile) {
+        if(quantile < 0 || quantile > 1) {
+            throw std::invalid_argument("calc_quantile: Quantile must be between 0 and 1 inclusive");
+        }
+        if(!gridpp::is_valid(quantile))
+            return gridpp::MV;
+
+        if(T == 0)
+            return gridpp::MV;
+        if(quantile == 0) {
+            float min = gridpp::MV;
+            for(int i = 0; i < T; i++) {
+                float val = array[i * stride];
+                if(!gridpp::is_valid(val))
+                    continue;
+                else if(!gridpp::is_valid(min))
+                    min = val;
+                else if(val < min)
+                    min = val;
+            }
+            return min;
+        }
+        else if(quantile == 1) {
+            float max = gridpp::MV;
+            for(int i = 0; i < T; i++) {
+                float val = array[i * stride];
+                if(!gridpp::is_valid(val))
+                    continue;
+                else if(!gridpp::is_valid(max))
+                    max = val;
+                else if(val > max)
+                    max = val;
+            }
+            return max;
+        }
+        vec temp;
+        int N = 0;
+        float* values = ::copy_valid(array, T, stride, temp, N);
+        if(N == 0)
+            return gridpp::MV;
+
+        int lowerIndex, upperIndex;
+        ::get_quantile_indices(quantile, N, lowerIndex, upperIndex);
+        float lowerValue, upperValue;
+        if(N <= ::small_array_size) {
+            ::sort_small(values, N);
+            lowerValue = values[lowerIndex];
+            upperValue = values[upperIndex];
+        }
+        else {
+            // Only the values at the lower and upper index are needed, so use selection instead of
+            // sorting. The upper index is at most one above the lower index.
+            std::nth_element(values, values + lowerIndex, values + N);
+            lowerValue = values[lowerIndex];
+            upperValue = lowerValue;
+            if(upperIndex != lowerIndex)
+                upperValue = *std::min_element(values + lowerIndex + 1, values + N);
+        }
+        return ::interpolate_quantile(quantile, N, lowerIndex, upperIndex, lowerValue, upperValue);
+    }
+    Field2D reduce_members(const View3& input, gridpp::Statistic statistic, float quantile) {
+        int Y = input.size_y();
+        int X = input.size_x();
+        int E = input.size_e();
+        Field2D output(Y, X, gridpp::MV);
+        #pragma omp parallel for
+        for(int y = 0; y < Y; y++) {
+            for(int x = 0; x < X; x++) {
+                const float* values = input.data() + y * input.stride_y() + x * input.stride_x();
+                if(statistic == gridpp::Quantile)
+                    output(y, x) = ::calc_quantile(values, E, input.stride_e(), quantile);
+                else
+                    output(y, x) = ::calc_statistic(values, E, input.stride_e(), statistic);
+            }
+        }
+        return output;
+    }
+}
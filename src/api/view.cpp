@@ -0,0 +1,70 @@
+#include "gridpp.h"
+
+using namespace gridpp;
+
+gridpp::View2::View2() : mData(NULL), mY(0), mX(0), mStrideY(0), mStrideX(0) {
+}
+gridpp::View2::View2(const float* data, int Y, int X, long stride_y, long stride_x) :
+    mData(data), mY(Y), mX(X), mStrideY(stride_y), mStrideX(stride_x) {
+    if(Y < 0 || X < 0)
+        throw std::invalid_argument("View dimensions must be >= 0");
+    if(data == NULL && long(Y) * X > 0)
+        throw std::invalid_argument("Cannot create a non-empty view of a NULL pointer");
+}
+gridpp::View2::View2(const float* data, int Y, int X) :
+    View2(data, Y, X, X, 1) {
+}
+bool gridpp::View2::is_contiguous() const {
+    return mStrideX == 1 && mStrideY == mX;
+}
+vec2 gridpp::View2::to_vec2() const {
+    vec2 output(mY);
+    for(int y = 0; y < mY; y++) {
+        if(mStrideX == 1) {
+            const float* start = mData + y * mStrideY;
+            output[y].assign(start, start + mX);
+        }
+        else {
+            output[y].resize(mX);
+            for(int x = 0; x < mX; x++) {
+                output[y][x] = (*this)(y, x);
+            }
+        }
+    }
+    return output;
+}
+
+gridpp::View3::View3() : mData(NULL), mY(0), mX(0), mE(0), mStrideY(0), mStrideX(0), mStrideE(0) {
+}
+gridpp::View3::View3(const float* data, int Y, int X, int E, long stride_y, long stride_x, long stride_e) :
+    mData(data), mY(Y), mX(X), mE(E), mStrideY(stride_y), mStrideX(stride_x), mStrideE(stride_e) {
+    if(Y < 0 || X < 0 || E < 0)
+        throw std::invalid_argument("View dimensions must be >= 0");
+    if(data == NULL && long(Y) * X * E > 0)
+        throw std::invalid_argument("Cannot create a non-empty view of a NULL pointer");
+}
+gridpp::View3::View3(const float* data, int Y, int X, int E) :
+    View3(data, Y, X, E, long(X) * E, E, 1) {
+}
+bool gridpp::View3::is_contiguous() const {
+    return mStrideE == 1 && mStrideX == mE && mStrideY == long(mX) * mE;
+}
+vec3 gridpp::View3::to_vec3() const {
+    vec3 output(mY);
+    for(int y = 0; y < mY; y++) {
+        output[y].resize(mX);
+        for(int x = 0; x < mX; x++) {
+            if(mStrideE == 1) {
+                const float* start = mData + y * mStrideY + x * mStrideX;
+                output[y][x].assign(start, start + mE);
+            }
+            else {
+                output[y][x].resize(mE);
+                for(int e = 0; e < mE; e++) {
+                    output[y][x][e] = (*this)(y, x, e);
+                }
+            }
+        }
+    }
+    return output;
+}
@@ -3,143 +3,247 @@
 
 using namespace gridpp;
 
+namespace {
+    /** Computes a window statistic along the second dimension of array, or a quantile if statistic
+     *  is Quantile. Output is resized to the size of array. */
+    void compute_window(const vec2& array, int length, gridpp::Statistic statistic, float quantile,
+            bool before, bool keep_missing, bool missing_edges, vec2& output);
+}
+
 vec2 gridpp::window(const vec2& array,
     int length, gridpp::Statistic statistic, bool before,
     bool keep_missing, bool missing_edges) {
 
-    vec2 output = gridpp::init_vec2(array.size(), array[0].size(), gridpp::MV);
+    vec2 output;
+    gridpp::window(array, length, statistic, output, before, keep_missing, missing_edges);
+    return output;
+}
 
-    int nY = array.size();
-    int nX = array[0].size();
+void gridpp::window(const vec2& array,
+    int length, gridpp::Statistic statistic, vec2& output, bool before,
+    bool keep_missing, bool missing_edges) {
 
-    if(length % 2 == 0 && !before) {
-        throw std::invalid_argument("Length variable must be an odd number");
+    if(statistic == gridpp::Quantile || statistic == gridpp::Unknown) {
+        throw std::invalid_argument("Cannot compute this statistic. Use window_quantile for quantiles.");
     }
+    ::compute_window(array, length, statistic, gridpp::MV, before, keep_missing, missing_edges, output);
+}
 
-    #pragma omp parallel for
-    for(int y = 0; y < array.size(); y++) {
-        // Use the accumulation/deaccumulation trick for Mean and Sum
-        if (statistic == gridpp::Mean || statistic == gridpp::Sum || statistic == gridpp::Count) {
-            vec values = vec(array[y].size(), 0);
-            vec counts = vec(array[y].size(), 0);
+vec2 gridpp::window_quantile(const vec2& array,
+    int length, float quantile, bool before,
+    bool keep_missing, bool missing_edges) {
 
-            for(int x = 0; x < array[y].size(); x++) {
-                if(x == 0) {
-                    if(gridpp::is_valid(array[y][x])) {
-                        values[x] = array[y][x];
-                        counts[x] = 1;
-                    }
-                }
-                else{
-                    if(gridpp::is_valid(array[y][x])) {
-                        values[x] = array[y][x] + values[x-1];
-                        counts[x] = counts[x-1] + 1;
-                    }
-                    else{
-                        values[x] = values[x-1];
-                        counts[x] = counts[x-1];
-                    }
-                }
-            }
+    if(quantile < 0 || quantile > 1) {
+        throw std::invalid_argument("Quantile must be between 0 and 1 inclusive");
+    }
+    vec2 output;
+    ::compute_window(array, length, gridpp::Quantile, quantile, before, keep_missing, missing_edges, output);
+    return output;
+}
 
-            for(int x = 0; x < array[y].size(); x++) {
-                int start;
-                int end;
+namespace {
+    void compute_window(const vec2& array, int length, gridpp::Statistic statistic, float quantile,
+            bool before, bool keep_missing, bool missing_edges, vec2& output) {
+        if(length % 2 == 0 && !before) {
+            throw std::invalid_argument("Length variable must be an odd number");
+        }
+        if(length < 1) {
+            throw std::invalid_argument("Length must be at least 1");
+        }
 
-                // Compute Start and End points
-                if(before) {
-                    start = std::max(0, x - length + 1);
-                    end = x;
-                }
+        int nY = array.size();
+        output.resize(nY);
+        if(nY == 0)
+            return;
+        int nX = array[0].size();
+        for(int y = 0; y < nY; y++) {
+            if(array[y].size() != nX)
+                throw std::invalid_argument("All rows in array must have the same length");
+            output[y].resize(nX);
+        }
 
-                else{
-                    start = std::max(0, x - length / 2);
-                    end = std::min(nX - 1, x + length / 2);
-                }
+        if(statistic == gridpp::Median)
+            quantile = 0.5;
+        bool use_quantile = statistic == gridpp::Quantile || statistic == gridpp::Median;
+        bool use_extreme = statistic == gridpp::Min || statistic == gridpp::Max;
+        if(use_quantile && !gridpp::is_valid(quantile)) {
+            for(int y = 0; y < nY; y++)
+                std::fill(output[y].begin(), output[y].end(), gridpp::MV);
+            return;
+        }
 
-                if(start - 1 >= 0) {
-                    if(counts[end] - counts[start-1] != 0) {
-                        output[y][x] = values[end] - values[start - 1];
+        #pragma omp parallel
+        {
+            // Buffers are reused for all rows processed by this thread, so that the loop over
+            // times does not allocate any memory
+            vec sums(nX + 1, 0);
+            ivec counts(nX + 1, 0);
+            ivec queue(nX);
+            vec levels;
+            ivec ranks(nX);
+            ivec tree;
+            vec stat_array;
+
+            #pragma omp for
+            for(int y = 0; y < nY; y++) {
+                const vec& row = array[y];
+                vec& out = output[y];
+
+                // Accumulated sums and counts of valid values, such that the sum over times
+                // start to end is sums[end + 1] - sums[start]
+                for(int x = 0; x < nX; x++) {
+                    if(gridpp::is_valid(row[x])) {
+                        sums[x + 1] = row[x] + sums[x];
+                        counts[x + 1] = counts[x] + 1;
                     }
-                }
-                else{
-                    if(counts[end] != 0) {
-                        output[y][x] = values[end];
+                    else {
+                        sums[x + 1] = sums[x];
+                        counts[x + 1] = counts[x];
                     }
                 }
 
-                if(statistic == gridpp::Count) {
-                    output[y][x] = counts[end] - counts[start - 1];
+                // For quantiles, replace each value by its rank among the distinct valid values
+                // in the row. The window is represented by a Fenwick tree counting the number of
+                // values with each rank.
+                int M = 0;
+                int top = 1;
+                if(use_quantile) {
+                    levels.clear();
+                    for(int x = 0; x < nX; x++) {
+                        if(gridpp::is_valid(row[x]))
+                            levels.push_back(row[x]);
+                    }
+                    std::sort(levels.begin(), levels.end());
+                    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+                    M = levels.size();
+                    for(int x = 0; x < nX; x++) {
+                        ranks[x] = -1;
+                        if(gridpp::is_valid(row[x]))
+                            ranks[x] = std::lower_bound(levels.begin(), levels.end(), row[x]) - levels.begin();
+                    }
+                    tree.assign(M + 1, 0);
+                    while(top * 2 <= M)
+                        top *= 2;
                 }
-                else {
-                    if(statistic == gridpp::Mean) {
-                        if(counts[end] != 0) {
-                            output[y][x] = output[y][x] / (counts[end] - counts[start-1]);
-                        }
+                auto update = [&](int x, int delta) {
+                    if(ranks[x] >= 0) {
+                        for(int k = ranks[x] + 1; k <= M; k += k & -k)
+                            tree[k] += delta;
                     }
-                    if(keep_missing) {
-                        if(counts[end] - counts[start - 1] < (end - (start - 1 ))) {
-                            output[y][x] = gridpp::MV;
+                };
+                auto kth = [&](int index) {
+                    int pos = 0;
+                    for(int step = top; step > 0; step /= 2) {
+                        if(pos + step <= M && tree[pos + step] <= index) {
+                            pos += step;
+                            index -= tree[pos];
                         }
                     }
-
-                    if(missing_edges) {
-                        if(before == false) {
-                            if(x < length / 2 || x + length / 2  + 1 > array[y].size()) {
-                                output[y][x] = gridpp::MV;
+                    return levels[pos];
+                };
+
+                // For Min and Max, keep the valid times in the window whose values can still
+                // become the extreme value, in monotonic order of value. The earliest of equal
+                // values is kept, in the same way as calc_statistic.
+                int head = 0;
+                int tail = 0;
+
+                // Times up to (but not including) next have been added to the window, and times
+                // before first have been removed
+                int next = 0;
+                int first = 0;
+                for(int x = 0; x < nX; x++) {
+                    int start;
+                    int end;
+
+                    // Compute Start and End points
+                    if(before) {
+                        start = x - length + 1;
+                        end = x;
+                    }
+                    else {
+                        start = x - length / 2;
+                        end = x + length / 2;
+                    }
+                    bool outside = start < 0 || end > nX - 1;
+                    start = std::max(0, start);
+                    end = std::min(nX - 1, end);
+
+                    if(use_extreme) {
+                        for(; next <= end; next++) {
+                            if(!gridpp::is_valid(row[next]))
+                                continue;
+                            if(statistic == gridpp::Min) {
+                                while(tail > head && row[queue[tail - 1]] > row[next])
+                                    tail--;
                             }
-                        }
-                        else{
-                            if(x < length - 1) {
-                                output[y][x] = gridpp::MV;
+                            else {
+                                while(tail > head && row[queue[tail - 1]] < row[next])
+                                    tail--;
                             }
+                            queue[tail] = next;
+                            tail++;
                         }
+                        while(tail > head && queue[head] < start)
+                            head++;
+                    }
+                    else if(use_quantile) {
+                        for(; next <= end; next++)
+                            update(next, 1);
+                        for(; first < start; first++)
+                            update(first, -1);
                     }
-                }
-            }
-        }
-        else {
-            for(int x = 0; x < array[y].size(); x++) {
-                int start;
-                int end;
-                bool outside = false;
-
-                if(before) {
-                    start = x - length + 1;
-                    end = x;
-                }
-                else {
-                    start = x - length / 2;
-                    end = x + length / 2;
-                }
-                if(start < 0) {
-                    start = 0;
-                    outside = true;
-                }
-                if(end > nX - 1) {
-                    end = nX - 1;
-                    outside = true;
-                }
-                int array_size = end - start + 1;
-
-                vec stat_array(array_size, 0);
-                int count_missing = 0;
-                for(int i = start; i <= end; i++) {
-                    float curr = array[y][i];
-                    count_missing += !gridpp::is_valid(curr);
-                    stat_array[i - start] = curr;
-                }
 
-                if(keep_missing && count_missing > 0)
-                    output[y][x] = gridpp::MV;
-                else if(missing_edges && outside)
-                    output[y][x] = gridpp::MV;
-                else {
-                    float value = gridpp::calc_statistic(stat_array, statistic);
-                    output[y][x] = value;
+                    int num_valid = counts[end + 1] - counts[start];
+                    int num_missing = end - start + 1 - num_valid;
+                    if(statistic == gridpp::Count) {
+                        out[x] = num_valid;
+                        continue;
+                    }
+                    if((keep_missing && num_missing > 0) || (missing_edges && outside) || num_valid == 0) {
+                        out[x] = gridpp::MV;
+                        continue;
+                    }
+
+                    if(statistic == gridpp::Sum) {
+                        out[x] = sums[end + 1] - sums[start];
+                    }
+                    else if(statistic == gridpp::Mean) {
+                        out[x] = (sums[end + 1] - sums[start]) / num_valid;
+                    }
+                    else if(use_extreme) {
+                        out[x] = row[queue[head]];
+                    }
+                    else if(use_quantile) {
+                        // Find the values at the lower and upper index in the same way as calc_quantile
+                        int lowerIndex = 0;
+                        int upperIndex = 0;
+                        if(quantile == 1) {
+                            lowerIndex = num_valid - 1;
+                            upperIndex = num_valid - 1;
+                        }
+                        else if(quantile > 0) {
+                            lowerIndex = floor(quantile * (num_valid - 1));
+                            upperIndex = ceil(quantile * (num_valid - 1));
+                        }
+                        float lowerValue = kth(lowerIndex);
+                        if(lowerIndex == upperIndex) {
+                            out[x] = lowerValue;
+                        }
+                        else {
+                            float upperValue = kth(upperIndex);
+                            float lowerQuantile = (float) lowerIndex / (num_valid - 1);
+                            float upperQuantile = (float) upperIndex / (num_valid - 1);
+                            float f = (quantile - lowerQuantile) / (upperQuantile - lowerQuantile);
+                            out[x] = lowerValue + (upperValue - lowerValue) * f;
+                        }
+                    }
+                    else {
+                        stat_array.assign(row.begin() + start, row.begin() + end + 1);
+                        out[x] = gridpp::calc_statistic(stat_array, statistic);
+                    }
                 }
             }
         }
     }
-    return output;
 }
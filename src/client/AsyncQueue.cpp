@@ -0,0 +1,94 @@
+#include "AsyncQueue.h"
+#include <sstream>
+#include "Util.h"
+
+AsyncQueue::AsyncQueue(int iMaxSize) :
+      mMaxSize(iMaxSize),
+      mBusy(false),
+      mStop(false) {
+   if(mMaxSize < 1) {
+      std::stringstream ss;
+      ss << "Queue size (" << iMaxSize << ") must be at least 1";
+      Util::error(ss.str());
+   }
+   // Start the thread after all members have been initialized
+   mThread = std::thread(&AsyncQueue::work, this);
+}
+
+AsyncQueue::~AsyncQueue() {
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mTasks.clear();
+      mStop = true;
+   }
+   mCondition.notify_all();
+   mThread.join();
+}
+
+void AsyncQueue::push(std::function<void()> iTask) {
+   std::unique_lock<std::mutex> lock(mMutex);
+   mCondition.wait(lock, [&] { return mTasks.size() < mMaxSize; });
+   mTasks.push_back(iTask);
+   mCondition.notify_all();
+}
+
+bool AsyncQueue::tryPush(std::function<void()> iTask) {
+   std::lock_guard<std::mutex> lock(mMutex);
+   if(mTasks.size() >= mMaxSize)
+      return false;
+   mTasks.push_back(iTask);
+   mCondition.notify_all();
+   return true;
+}
+
+void AsyncQueue::wait() {
+   std::unique_lock<std::mutex> lock(mMutex);
+   mCondition.wait(lock, [&] { return mTasks.size() == 0 && !mBusy; });
+   if(mException) {
+      std::exception_ptr exception = mException;
+      mException = std::exception_ptr();
+      std::rethrow_exception(exception);
+   }
+}
+
+void AsyncQueue::clear() {
+   std::lock_guard<std::mutex> lock(mMutex);
+   mTasks.clear();
+   mCondition.notify_all();
+}
+
+int AsyncQueue::size() const {
+   std::lock_guard<std::mutex> lock(mMutex);
+   return mTasks.size();
+}
+
+int AsyncQueue::getMaxSize() const {
+   return mMaxSize;
+}
+
+void AsyncQueue::work() {
+   std::unique_lock<std::mutex> lock(mMutex);
+   while(true) {
+      mCondition.wait(lock, [&] { return mTasks.size() > 0 || mStop; });
+      if(mStop)
+         break;
+      std::function<void()> task = mTasks.front();
+      mTasks.pop_front();
+      mBusy = true;
+      // Wake up threads waiting for room in the queue
+      mCondition.notify_all();
+      lock.unlock();
+      try {
+         task();
+      }
+      catch(...) {
+         lock.lock();
+         if(!mException)
+            mException = std::current_exception();
+         lock.unlock();
+      }
+      lock.lock();
+      mBusy = false;
+      mCondition.notify_all();
+   }
+}
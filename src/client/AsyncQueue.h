@@ -0,0 +1,48 @@
+#ifndef ASYNC_QUEUE_H
+#define ASYNC_QUEUE_H
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+
+//! Runs tasks one at a time, in the order they were added, on a background thread. Used to
+//! overlap file input/output with computations.
+class AsyncQueue {
+   public:
+      //! @param iMaxSize Maximum number of tasks waiting to be run
+      AsyncQueue(int iMaxSize);
+      //! Discards tasks that have not started and waits for the running task to finish
+      ~AsyncQueue();
+
+      //! Add a task to the end of the queue. Waits until there is room in the queue.
+      void push(std::function<void()> iTask);
+
+      //! Add a task to the end of the queue, unless the queue is full
+      //! @return True if the task was added
+      bool tryPush(std::function<void()> iTask);
+
+      //! Wait until all tasks have finished. If a task threw an exception, the first such
+      //! exception is rethrown.
+      void wait();
+
+      //! Discard tasks that have not started yet
+      void clear();
+
+      //! Number of tasks that have not started yet
+      int size() const;
+      int getMaxSize() const;
+   private:
+      void work();
+      int mMaxSize;
+      std::deque<std::function<void()> > mTasks;
+      //! Is a task currently running?
+      bool mBusy;
+      bool mStop;
+      std::exception_ptr mException;
+      mutable std::mutex mMutex;
+      std::condition_variable mCondition;
+      std::thread mThread;
+};
+#endif
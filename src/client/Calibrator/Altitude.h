@@ -10,6 +10,7 @@ class CalibratorAltitude : public Calibrator {
       CalibratorAltitude(const Variable& iVariable, const Options& iOptions);
       static std::string description(bool full=true);
       std::string name() const {return "altitude";};
+      bool modifiesFile() const {return true;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
 };
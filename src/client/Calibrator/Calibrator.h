@@ -44,6 +44,14 @@ class Calibrator : public Scheme {
 
       // Does this calibrator require a parameter file?
       virtual bool requiresParameterFile() const { return true;};
+
+      //! Names of other variables that the calibrator reads from the file. Used to determine
+      //! which variables can be processed at the same time.
+      virtual std::vector<std::string> getDependencies() const { return std::vector<std::string>();};
+
+      //! Does the calibrator change state of the file that all variables use (e.g. the altitudes)?
+      //! Such variables are not processed at the same time as any other variable.
+      virtual bool modifiesFile() const { return false;};
       Options getOptions() const;
    protected:
       virtual bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const = 0;
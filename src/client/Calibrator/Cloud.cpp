@@ -55,3 +55,9 @@ std::string CalibratorCloud::description(bool full) {
       ss << Util::formatDescription("-c cloud", "Ensure clouds when precip is present") << std::endl;
    return ss.str();
 }
+std::vector<std::string> CalibratorCloud::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mPrecipVariable != "")
+      dependencies.push_back(mPrecipVariable);
+   return dependencies;
+}
@@ -9,6 +9,7 @@ class CalibratorCloud : public Calibrator {
       CalibratorCloud(const Variable& iVariable, const Options& iOptions);
       static std::string description(bool full=true);
       std::string name() const {return "cloud";};
+      std::vector<std::string> getDependencies() const;
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
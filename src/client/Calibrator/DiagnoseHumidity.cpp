@@ -212,4 +212,15 @@ std::string CalibratorDiagnoseHumidity::description(bool full) {
       ss << Util::formatDescription("-c diagnoseHumidity","Diagnose dewpoint, wetbulb, or relative humidity") << std::endl;
    return ss.str();
 }
-
+std::vector<std::string> CalibratorDiagnoseHumidity::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mTemperature != "")
+      dependencies.push_back(mTemperature);
+   if(mRh != "")
+      dependencies.push_back(mRh);
+   if(mDewpoint != "")
+      dependencies.push_back(mDewpoint);
+   if(mPressure != "")
+      dependencies.push_back(mPressure);
+   return dependencies;
+}
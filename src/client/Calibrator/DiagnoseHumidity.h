@@ -7,6 +7,7 @@ class CalibratorDiagnoseHumidity : public Calibrator {
    public:
       CalibratorDiagnoseHumidity(const Variable& iVariable, const Options& iOptions);
       std::string name() const {return "diagnoseHumidity";};
+      std::vector<std::string> getDependencies() const;
       bool requiresParameterFile() const { return false;};
       static std::string description(bool full=true);
       // Temperature in K, RH in [0,1], Returns TD in K
@@ -127,4 +127,15 @@ std::string CalibratorDiagnoseWind::description(bool full) {
       ss << Util::formatDescription("-c diagnoseWind","Diagnose wind speed/direction or x/y components") << std::endl;
    return ss.str();
 }
-
+std::vector<std::string> CalibratorDiagnoseWind::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mX != "")
+      dependencies.push_back(mX);
+   if(mY != "")
+      dependencies.push_back(mY);
+   if(mSpeed != "")
+      dependencies.push_back(mSpeed);
+   if(mDirection != "")
+      dependencies.push_back(mDirection);
+   return dependencies;
+}
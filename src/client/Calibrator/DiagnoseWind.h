@@ -7,6 +7,7 @@ class CalibratorDiagnoseWind : public Calibrator {
    public:
       CalibratorDiagnoseWind(const Variable& iVariable, const Options& iOptions);
       std::string name() const {return "diagnoseWind";};
+      std::vector<std::string> getDependencies() const;
       bool requiresParameterFile() const { return false;};
       static std::string description(bool full=true);
    private:
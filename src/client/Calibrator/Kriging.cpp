@@ -492,3 +492,9 @@ std::string CalibratorKriging::description(bool full) {
       ss << Util::formatDescription("-c kriging","Spreads bias in space by using kriging")<< std::endl;
    return ss.str();
 }
+std::vector<std::string> CalibratorKriging::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mAuxVariable != "")
+      dependencies.push_back(mAuxVariable);
+   return dependencies;
+}
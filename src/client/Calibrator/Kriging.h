@@ -24,6 +24,7 @@ class CalibratorKriging : public Calibrator {
       float mMaxElevDiff;
       float mEfoldDist;
       std::string name() const {return "kriging";};
+      std::vector<std::string> getDependencies() const;
       File* mPrevious;
       std::string mAuxVariable;
       float mLowerThreshold;
@@ -10,6 +10,7 @@ class CalibratorMask : public Calibrator {
       CalibratorMask(const Variable& iVariable, const Options& iOptions);
       static std::string description(bool full=true);
       std::string name() const {return "mask";};
+      bool modifiesFile() const {return true;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
       bool mUseNearestOnly;
@@ -1216,3 +1216,13 @@ std::string CalibratorOi::description(bool full) {
       ss << Util::formatDescription("-c oi","Merging of observations and background using Optimal interpolation")<< std::endl;
    return ss.str();
 }
+std::vector<std::string> CalibratorOi::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mBiasVariable != "")
+      dependencies.push_back(mBiasVariable);
+   if(mDeltaVariable != "")
+      dependencies.push_back(mDeltaVariable);
+   if(mNumVariable != "")
+      dependencies.push_back(mNumVariable);
+   return dependencies;
+}
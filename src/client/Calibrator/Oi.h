@@ -16,6 +16,7 @@ class CalibratorOi : public Calibrator {
       float calcRho(float iHdist, float iVdist, float iLdist, RhoType iType=RhoTypeGaussian) const;
       static std::string description(bool full=true);
       std::string name() const {return "oi";};
+      std::vector<std::string> getDependencies() const;
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
       enum Type {TypeTemperature, TypePrecipitation};
@@ -80,3 +80,11 @@ std::string CalibratorPhase::description(bool full) {
       ss << Util::formatDescription("-c phase", "Compute precipitation phase based on temperature") << std::endl;
    return ss.str();
 }
+std::vector<std::string> CalibratorPhase::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mTemperatureVariable != "")
+      dependencies.push_back(mTemperatureVariable);
+   if(mPrecipitationVariable != "")
+      dependencies.push_back(mPrecipitationVariable);
+   return dependencies;
+}
@@ -70,3 +70,9 @@ float CalibratorQnh::calcQnh(float iElev, float iPressure) {
       return Util::MV;
    }
 }
+std::vector<std::string> CalibratorQnh::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mPressureVariable != "")
+      dependencies.push_back(mPressureVariable);
+   return dependencies;
+}
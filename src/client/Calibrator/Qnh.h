@@ -9,6 +9,7 @@ class CalibratorQnh : public Calibrator {
       CalibratorQnh(const Variable& iVariable, const Options& iOptions);
       static std::string description(bool full=true);
       std::string name() const {return "qnh";};
+      std::vector<std::string> getDependencies() const;
       static float calcQnh(float iElev, float iPressure);
       bool requiresParameterFile() const { return false;};
    private:
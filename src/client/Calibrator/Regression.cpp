@@ -169,6 +169,15 @@ Parameters CalibratorRegression::train(const std::vector<ObsEns>& iData) const {
    return par;
 }
 
+std::vector<std::string> CalibratorRegression::getDependencies() const {
+   std::vector<std::string> dependencies;
+   for(int i = 0; i < mVariables.size(); i++) {
+      if(mVariables[i] != "1")
+         dependencies.push_back(mVariables[i]);
+   }
+   return dependencies;
+}
+
 std::string CalibratorRegression::description(bool full) {
    std::stringstream ss;
    if(full) {
@@ -10,6 +10,7 @@ class CalibratorRegression : public Calibrator {
       CalibratorRegression(const Variable& iVariable, const Options& iOptions);
       static std::string description(bool full=true);
       std::string name() const {return "regression";};
+      std::vector<std::string> getDependencies() const;
       Parameters train(const std::vector<ObsEns>& iData) const;
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
@@ -87,3 +87,9 @@ float CalibratorWindDirection::getFactor(float iWindDirection, const Parameters&
       factor = 0;
    return factor;
 }
+std::vector<std::string> CalibratorWindDirection::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mDirectionVariable != "")
+      dependencies.push_back(mDirectionVariable);
+   return dependencies;
+}
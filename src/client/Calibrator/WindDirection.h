@@ -14,6 +14,7 @@ class CalibratorWindDirection : public Calibrator {
       CalibratorWindDirection(const Variable& iVariable, const Options& iOptions);
       static std::string description(bool full=true);
       std::string name() const {return "windDirection";};
+      std::vector<std::string> getDependencies() const;
       //! Get multiplication factor for given wind direction
       //! @param iWindDirection in degrees, meteorological wind direction (0 degrees is from North)
       static float getFactor(float iWindDirection, const Parameters& iPar);
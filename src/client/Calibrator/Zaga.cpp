@@ -681,3 +681,15 @@ std::string CalibratorZaga::description(bool full) {
       ss << Util::formatDescription("-c zaga", "Calibrates an ensemble using a zero-adjusted gamma distribution") << std::endl;
    return ss.str();
 }
+std::vector<std::string> CalibratorZaga::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mPopVariable != "")
+      dependencies.push_back(mPopVariable);
+   if(mLowVariable != "")
+      dependencies.push_back(mLowVariable);
+   if(mMiddleVariable != "")
+      dependencies.push_back(mMiddleVariable);
+   if(mHighVariable != "")
+      dependencies.push_back(mHighVariable);
+   return dependencies;
+}
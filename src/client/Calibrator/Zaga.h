@@ -28,6 +28,7 @@ class CalibratorZaga : public Calibrator {
 
       static std::string description(bool full=true);
       std::string name() const {return "zaga";};
+      std::vector<std::string> getDependencies() const;
       Parameters train(const std::vector<ObsEns>& iData) const;
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
@@ -6,6 +6,7 @@
 #include "../KDTree.h"
 
 std::map<Uuid, std::map<Uuid, std::pair<vec2Int, vec2Int> > > Downscaler::mNeighbourCache;
+std::mutex Downscaler::mNeighbourCacheMutex;
 
 Downscaler::Downscaler(const Variable& iInputVariable, const Variable& iOutputVariable, const Options& iOptions) : Scheme(iOptions),
       mInputVariable(iInputVariable),
@@ -205,6 +206,7 @@ void Downscaler::getNearestNeighbour(const File& iFrom, const File& iTo, vec2Int
 }
 
 bool Downscaler::isCached(const File& iFrom, const File& iTo) {
+   std::lock_guard<std::mutex> lock(mNeighbourCacheMutex);
    std::map<Uuid, std::map<Uuid, std::pair<vec2Int, vec2Int> > >::const_iterator it = mNeighbourCache.find(iFrom.getUniqueTag());
    if(it == mNeighbourCache.end()) {
       return false;
@@ -217,14 +219,20 @@ bool Downscaler::isCached(const File& iFrom, const File& iTo) {
 }
 
 void Downscaler::addToCache(const File& iFrom, const File& iTo, vec2Int iI, vec2Int iJ) {
+   std::lock_guard<std::mutex> lock(mNeighbourCacheMutex);
    std::pair<vec2Int, vec2Int> pair(iI, iJ);
    mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()] = pair;
 }
 bool Downscaler::getFromCache(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ) {
-   if(!isCached(iFrom, iTo))
+   std::lock_guard<std::mutex> lock(mNeighbourCacheMutex);
+   std::map<Uuid, std::map<Uuid, std::pair<vec2Int, vec2Int> > >::const_iterator it = mNeighbourCache.find(iFrom.getUniqueTag());
+   if(it == mNeighbourCache.end())
+      return false;
+   std::map<Uuid, std::pair<vec2Int, vec2Int> >::const_iterator it2 = it->second.find(iTo.getUniqueTag());
+   if(it2 == it->second.end())
       return false;
-   iI = mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()].first;
-   iJ = mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()].second;
+   iI = it2->second.first;
+   iJ = it2->second.second;
    return true;
 }
 
@@ -265,5 +273,6 @@ std::string Downscaler::getDescriptions(bool full) {
 }
 
 void Downscaler::clearCache() {
+   std::lock_guard<std::mutex> lock(mNeighbourCacheMutex);
    mNeighbourCache.clear();
 }
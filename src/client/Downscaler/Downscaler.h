@@ -2,6 +2,7 @@
 #define DOWNSCALER_H
 #include <string>
 #include <map>
+#include <mutex>
 #include "../Options.h"
 #include "../Variable.h"
 #include "../Scheme.h"
@@ -18,6 +19,10 @@ class Downscaler : public Scheme {
       static Downscaler* getScheme(std::string iName, const Variable& iInputVariable, const Variable& iOutputVariable, const Options& iOptions);
       virtual std::string name() const = 0;
 
+      //! Names of variables, other than the input variable, that the downscaler reads from the
+      //! input file. Used to keep their fields in the cache while the downscaler runs.
+      virtual std::vector<std::string> getDependencies() const { return std::vector<std::string>();};
+
       //! Create a nearest-neighbour map. For each grid point in iTo, find the index into the grid
       //! in iFrom of the nearest neighbour. Uses a 2-d BST for search speedup.
       //! @param iI I-indices of nearest point. Set to Util::MV if no nearest neighbour.
@@ -50,6 +55,8 @@ class Downscaler : public Scheme {
       static void addToCache(const File& iFrom, const File& iTo, vec2Int iI, vec2Int iJ);
       static bool getFromCache(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
       static std::map<Uuid, std::map<Uuid, std::pair<vec2Int, vec2Int> > > mNeighbourCache;
+      //! Protects mNeighbourCache, since variables can be downscaled in parallel
+      static std::mutex mNeighbourCacheMutex;
 };
 #include "NearestNeighbour.h"
 #include "Gradient.h"
@@ -64,6 +64,13 @@ DownscalerGradient::~DownscalerGradient() {
    // delete mDownscaler;
 }
 
+std::vector<std::string> DownscalerGradient::getDependencies() const {
+   std::vector<std::string> dependencies;
+   if(mElevGradientVariableName != "")
+      dependencies.push_back(mElevGradientVariableName);
+   return dependencies;
+}
+
 void DownscalerGradient::downscaleCore(const File& iInput, File& iOutput) const {
    int nLat = iOutput.getNumY();
    int nLon = iOutput.getNumX();
@@ -18,6 +18,7 @@ class DownscalerGradient : public Downscaler {
       ~DownscalerGradient();
       static std::string description(bool full=true);
       std::string name() const {return "gradient";};
+      std::vector<std::string> getDependencies() const;
    private:
       void downscaleCore(const File& iInput, File& iOutput) const;
       int   mElevRadius;
@@ -8,11 +8,17 @@
 #include "../Util.h"
 #include "../Options.h"
 #include "../Setup.h"
+#include "../Scheduler.h"
+#include <mutex>
+#include <set>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 void writeUsage(bool full) {
    std::cout << "Post-processes gridded forecasts. For more information see https://github.com/metno/gridpp." << std::endl;
    std::cout << std::endl;
-   std::cout << "usage:  gridpp inputs [options] outputs [options] [-v var [options] [-d downscaler [options] [-p parameters [options]]] [-c calibrator [options] [-p parameters [options]]]*]+ [--debug <level>]" << std::endl;
+   std::cout << "usage:  gridpp inputs [options] outputs [options] [-v var [options] [-d downscaler [options] [-p parameters [options]]] [-c calibrator [options] [-p parameters [options]]]*]+ [--debug <level>] [--jobs <n>]" << std::endl;
    std::cout << "        gridpp [--version]" << std::endl;
    std::cout << "        gridpp [--help]" << std::endl;
    std::cout << std::endl;
@@ -29,6 +35,8 @@ void writeUsage(bool full) {
    std::cout << "   options       Options of the form key=value" << std::endl;
    std::cout << "   --version     Print the program's version" << std::endl;
    std::cout << "   --debug lvl   Set debug level: quiet, error, warn (default), info" << std::endl;
+   std::cout << "   --jobs n      Post-process up to n variables at the same time (default 1). The OMP" << std::endl;
+   std::cout << "                 threads are divided between the variables." << std::endl;
    std::cout << "   --help        Print usage information including all options" << std::endl;
    std::cout << std::endl;
    std::cout << "Inputs/Outputs:" << std::endl;
@@ -39,6 +47,7 @@ void writeUsage(bool full) {
    std::cout << Util::formatDescription("write=1", "Set to 0 to prevent the variable to be written to output") << std::endl;
    std::cout << Util::formatDescription("units=undef", "Write this to the units attribute in the output.") << std::endl;
    std::cout << Util::formatDescription("standardName=1", "Write this to the standard_name attribute in the output.") << std::endl;
+   std::cout << Util::formatDescription("pin=0", "Set to 1 to never remove the variable from memory when cacheSize is set.") << std::endl;
    std::cout << std::endl;
    if(full)
       std::cout << "Downscalers with options (and default values):" << std::endl;
@@ -81,6 +90,7 @@ int main(int argc, const char *argv[]) {
    // Retrieve setup
    std::vector<std::string> args;
    std::string debugMode = "warn";
+   int numJobs = 1;
    Util::setShowError(true);
    for(int i = 1; i < argc; i++) {
       if(std::string(argv[i]) == "--debug") {
@@ -90,6 +100,16 @@ int main(int argc, const char *argv[]) {
          }
          debugMode = std::string(argv[i]);
       }
+      else if(std::string(argv[i]) == "--jobs") {
+         i++;
+         if(argc <= i) {
+            Util::error("Missing number of jobs");
+         }
+         std::stringstream ss(argv[i]);
+         if(!(ss >> numJobs) || numJobs < 1) {
+            Util::error("Number of jobs must be at least 1");
+         }
+      }
       else {
          args.push_back(std::string(argv[i]));
       }
@@ -132,64 +152,146 @@ int main(int argc, const char *argv[]) {
 
       // Post-process file
       std::vector<Variable> writeVariables;
+      std::vector<bool> writeFlags(setup.variableConfigurations.size(), false);
       for(int v = 0; v < setup.variableConfigurations.size(); v++) {
-         double s = Util::clock();
-         VariableConfiguration varconf = setup.variableConfigurations[v];
-         Variable inputVariable = varconf.inputVariable;
-         Variable outputVariable = varconf.outputVariable;
-
+         const VariableConfiguration& varconf = setup.variableConfigurations[v];
          bool write = 1;
          varconf.outputVariableOptions.getValue("write", write);
          if(write) {
-            writeVariables.push_back(outputVariable);
+            writeVariables.push_back(varconf.outputVariable);
          }
-         setup.outputFiles[f]->initNewVariable(outputVariable);
-
-         Util::status("Processing " + outputVariable.name());
-
-         // Downscale
-         Util::status("   Downscaler " +  varconf.downscaler->name() + ": ", false);
-         double ss = Util::clock();
-         varconf.downscaler->downscale(*setup.inputFiles[f], *setup.outputFiles[f]);
-         double ee = Util::clock();
-         std::stringstream ss0;
-         ss0 << ee-ss << " seconds";
-         Util::status(ss0.str());
-
-         // Calibrate
-         for(int c = 0; c < varconf.calibrators.size(); c++) {
-            double s = Util::clock();
-            Util::status("   Calibrator " + varconf.calibrators[c]->name() + ": ", false);
-            varconf.calibrators[c]->calibrate(*setup.outputFiles[f], varconf.parameterFileCalibrators[c]);
-            double e = Util::clock();
-            std::stringstream ss;
-            ss << e-s << " seconds";
-            Util::status(ss.str());
+         writeFlags[v] = write;
+         bool pin = 0;
+         varconf.outputVariableOptions.getValue("pin", pin);
+         if(pin) {
+            setup.inputFiles[f]->setPinned(varconf.inputVariable);
+            setup.outputFiles[f]->setPinned(varconf.outputVariable);
          }
-         double e = Util::clock();
-         std::stringstream ss1;
-         ss1 << "   Total: " << e-s << " seconds";
-         Util::status(ss1.str());
-
-         std::stringstream ss2;
-         ss2 << "Mem usage input: " << setup.inputFiles[f]->getCacheSize() / 1e6;
-         Util::status(ss2.str());
-
-         std::stringstream ss3;
-         ss3 << "Mem usage output: " << setup.outputFiles[f]->getCacheSize() / 1e6;
-         Util::status(ss3.str());
-         // setup.inputFile->clear();
+         setup.outputFiles[f]->initNewVariable(varconf.outputVariable);
       }
 
-      // Write to output
-      double s = Util::clock();
+      // Read the next timestep of input variables while the current one is processed, and write
+      // each output variable as soon as it is finished
       std::stringstream ssMessage;
       for(int i = 1; i < argc; i++) {
          if(i > 1)
             ssMessage << " ";
          ssMessage << argv[i];
       }
+      setup.inputFiles[f]->setReadAhead(true);
+      setup.outputFiles[f]->startWrite(writeVariables, ssMessage.str());
 
+      // Variables are processed concurrently when they do not depend on each other. Status
+      // messages are then collected and shown when the variable is finished, so that messages
+      // from different variables are not mixed.
+      std::vector<std::vector<int> > dependencies = setup.getVariableDependencies(f);
+      Scheduler scheduler(numJobs);
+      std::mutex statusMutex;
+
+      // Fields are only removed from the caches between variables, since downscalers and
+      // calibrators keep references to the fields they use. Variables used by other running
+      // variables, including those that their downscalers and calibrators read, are kept.
+      std::mutex cacheMutex;
+      std::multiset<std::string> inUse;
+      std::vector<std::vector<std::string> > usedNames(setup.variableConfigurations.size());
+      for(int v = 0; v < setup.variableConfigurations.size(); v++) {
+         const VariableConfiguration& varconf = setup.variableConfigurations[v];
+         usedNames[v].push_back(varconf.inputVariable.name());
+         usedNames[v].push_back(varconf.outputVariable.name());
+         std::vector<std::string> downscalerNames = varconf.downscaler->getDependencies();
+         usedNames[v].insert(usedNames[v].end(), downscalerNames.begin(), downscalerNames.end());
+         for(int c = 0; c < varconf.calibrators.size(); c++) {
+            std::vector<std::string> names = varconf.calibrators[c]->getDependencies();
+            usedNames[v].insert(usedNames[v].end(), names.begin(), names.end());
+         }
+      }
+#ifdef _OPENMP
+      int numThreadsPerJob = std::max(1, omp_get_max_threads() / numJobs);
+#endif
+      for(int v = 0; v < setup.variableConfigurations.size(); v++) {
+         scheduler.addTask([&, v]() {
+#ifdef _OPENMP
+            if(numJobs > 1)
+               omp_set_num_threads(numThreadsPerJob);
+#endif
+            double s = Util::clock();
+            const VariableConfiguration& varconf = setup.variableConfigurations[v];
+            Variable outputVariable = varconf.outputVariable;
+            {
+               std::lock_guard<std::mutex> lock(cacheMutex);
+               inUse.insert(usedNames[v].begin(), usedNames[v].end());
+            }
+
+            std::stringstream messages;
+            auto status = [&](const std::string& iMessage, bool iNewLine) {
+               if(numJobs == 1) {
+                  Util::status(iMessage, iNewLine);
+               }
+               else {
+                  messages << iMessage;
+                  if(iNewLine)
+                     messages << std::endl;
+               }
+            };
+
+            status("Processing " + outputVariable.name(), true);
+
+            // Downscale
+            status("   Downscaler " +  varconf.downscaler->name() + ": ", false);
+            double ss = Util::clock();
+            varconf.downscaler->downscale(*setup.inputFiles[f], *setup.outputFiles[f]);
+            double ee = Util::clock();
+            std::stringstream ss0;
+            ss0 << ee-ss << " seconds";
+            status(ss0.str(), true);
+
+            // Calibrate
+            for(int c = 0; c < varconf.calibrators.size(); c++) {
+               double s = Util::clock();
+               status("   Calibrator " + varconf.calibrators[c]->name() + ": ", false);
+               varconf.calibrators[c]->calibrate(*setup.outputFiles[f], varconf.parameterFileCalibrators[c]);
+               double e = Util::clock();
+               std::stringstream ss;
+               ss << e-s << " seconds";
+               status(ss.str(), true);
+            }
+            double e = Util::clock();
+            std::stringstream ss1;
+            ss1 << "   Total: " << e-s << " seconds";
+            status(ss1.str(), true);
+
+            std::stringstream ss2;
+            ss2 << "Mem usage input: " << setup.inputFiles[f]->getCacheSize() / 1e6
+                << " (" << setup.inputFiles[f]->getCacheSummary() << ")";
+            status(ss2.str(), true);
+
+            std::stringstream ss3;
+            ss3 << "Mem usage output: " << setup.outputFiles[f]->getCacheSize() / 1e6
+                << " (" << setup.outputFiles[f]->getCacheSummary() << ")";
+            status(ss3.str(), true);
+
+            if(writeFlags[v])
+               setup.outputFiles[f]->writeVariable(outputVariable);
+
+            {
+               std::lock_guard<std::mutex> lock(cacheMutex);
+               for(int i = 0; i < usedNames[v].size(); i++)
+                  inUse.erase(inUse.find(usedNames[v][i]));
+               std::set<std::string> inUseNames(inUse.begin(), inUse.end());
+               setup.inputFiles[f]->trimCache(inUseNames);
+               setup.outputFiles[f]->trimCache(inUseNames);
+            }
+
+            if(numJobs > 1) {
+               std::lock_guard<std::mutex> lock(statusMutex);
+               Util::status(messages.str(), false);
+            }
+         }, dependencies[v]);
+      }
+      scheduler.run();
+
+      // Write to output
+      double s = Util::clock();
       setup.outputFiles[f]->write(writeVariables, ssMessage.str());
       double e = Util::clock();
       std::stringstream ss1;
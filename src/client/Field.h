@@ -41,6 +41,10 @@ class Field {
       bool operator==(const Field& iField) const;
       bool operator!=(const Field& iField) const;
 
+      //! Direct access to the data values. The ensemble index changes fastest, then x, then y.
+      float* getData() {return mValues.data();};
+      const float* getData() const {return mValues.data();};
+
       //! Number of gridpoints in the y direction
       int getNumY() const;
 
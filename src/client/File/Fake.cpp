@@ -73,6 +73,10 @@ FileFake::FileFake(const Options& iOptions) :
    setTimes(times);
 }
 
+FileFake::~FileFake() {
+   stopIo();
+}
+
 FieldPtr FileFake::getFieldCore(const Variable& iVariable, int iTime) const {
    FieldPtr field = getEmptyField();
 
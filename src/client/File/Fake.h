@@ -6,6 +6,7 @@
 class FileFake : public File {
    public:
       FileFake(const Options& iOptions);
+      ~FileFake();
       static std::string description();
       std::string name() const {return "fake";};
    protected:
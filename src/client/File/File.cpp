@@ -6,14 +6,32 @@
 #include <cmath>
 #include "../Util.h"
 #include "../Options.h"
+#include "../AsyncQueue.h"
 Uuid File::mNextTag = 0;
+std::recursive_mutex File::mCoreMutex;
 
 File::File(std::string iFilename, const Options& iOptions) :
       mFilename(iFilename),
       mHasElevs(false),
-      mReferenceTime(Util::MV) {
+      mReferenceTime(Util::MV),
+      mReadAhead(false),
+      mWriteStarted(false),
+      mCacheLimit(Util::MV),
+      mSpill(false),
+      mCacheSize(0),
+      mUseCounter(0),
+      mNumHits(0),
+      mNumMisses(0),
+      mNumEvictions(0) {
    createNewTag();
 
+   float cacheSize = Util::MV;
+   if(iOptions.getValue("cacheSize", cacheSize)) {
+      if(!Util::isValid(cacheSize) || cacheSize < 0)
+         Util::error("cacheSize must be 0 or higher");
+      setCacheLimit(cacheSize * 1e6);
+   }
+   iOptions.getValue("spill", mSpill);
 }
 
 File* File::getScheme(std::string iFilename, const Options& iOptions, bool iReadOnly) {
@@ -59,10 +77,9 @@ File* File::getScheme(std::string iFilename, const Options& iOptions, bool iRead
 
 FieldPtr File::getField(std::string iVariable, int iTime) const {
    // Check internal variables first
-   for(int i = 0; i < mVariables.size(); i++) {
-      if(mVariables[i].name() == iVariable)
-         return getField(mVariables[i], iTime);
-   }
+   Variable variable;
+   if(getVariable(iVariable, variable))
+      return getField(variable, iTime);
 
    // Check aliases
    std::map<std::string, Variable>::const_iterator it = mVariableAliases.find(iVariable);
@@ -77,10 +94,47 @@ FieldPtr File::getField(std::string iVariable, int iTime) const {
    return getField(Variable(iVariable), iTime);
 }
 FieldPtr File::getField(const Variable& iVariable, int iTime, bool iSkipRead) const {
+   FieldPtr field = getCachedField(iVariable, iTime, true);
+   if(mReadAhead && !iSkipRead && iTime + 1 < getNumTime())
+      readAhead(iVariable, iTime + 1);
+   if(field != NULL)
+      return field;
+
+   // Only one thread reads at a time. Another thread may have read the field while this thread
+   // was waiting, so check again.
+   std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+   field = getCachedField(iVariable, iTime);
+   if(field != NULL)
+      return field;
+
+   // Load non-derived variable from file
+   if(!iSkipRead && hasVariableCore(iVariable)) {
+      storeField(getFieldCore(iVariable, iTime), iVariable, iTime, true);
+      std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+      mNumMisses++;
+   }
+   else if (iSkipRead) {
+      for(int t = 0; t < getNumTime(); t++) {
+         FieldPtr field = getEmptyField();
+         addField(field, iVariable, t);
+      }
+   }
+   else {
+      std::string variableType = iVariable.name();
+      Util::warning(variableType + " not available in '" + getFilename() + "'");
+      for(int t = 0; t < getNumTime(); t++) {
+         FieldPtr field = getEmptyField();
+         addField(field, iVariable, t);
+      }
+   }
+   return getCachedField(iVariable, iTime);
+}
+FieldPtr File::getCachedField(const Variable& iVariable, int iTime, bool iCountHit) const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+
    // Determine if values have been cached
    std::map<Variable, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
-   bool needsReading = it == mFields.end();
-   if(!needsReading) {
+   if(it != mFields.end()) {
       // The variable has at least been partly read
       if(mFields[iVariable].size() <= iTime) {
          // This is an internal error. The variable has been partly read, but space has not
@@ -90,8 +144,6 @@ FieldPtr File::getField(const Variable& iVariable, int iTime, bool iSkipRead) co
             << " in file '" << getFilename() << "'";
          Util::error(ss.str());
       }
-
-      needsReading = mFields[iVariable][iTime] == NULL;
    }
    else {
       // The variable has never been read or diagnosed. Allocate space for it.
@@ -104,46 +156,129 @@ FieldPtr File::getField(const Variable& iVariable, int iTime, bool iSkipRead) co
       mFields[iVariable].resize(getNumTime());
    }
 
-   if(needsReading) {
-      // Load non-derived variable from file
-      if(!iSkipRead && hasVariableCore(iVariable)) {
-         addField(getFieldCore(iVariable, iTime), iVariable, iTime);
-      }
-      else if (iSkipRead) {
-         for(int t = 0; t < getNumTime(); t++) {
-            FieldPtr field = getEmptyField();
-            addField(field, iVariable, t);
-         }
-      }
-      else {
-         std::string variableType = iVariable.name();
-         Util::warning(variableType + " not available in '" + getFilename() + "'");
-         for(int t = 0; t < getNumTime(); t++) {
-            FieldPtr field = getEmptyField();
-            addField(field, iVariable, t);
-         }
-      }
+   FieldKey key(iVariable, iTime);
+   FieldPtr field = mFields[iVariable][iTime];
+   if(field != NULL) {
+      touchField(key);
+      if(iCountHit)
+         mNumHits++;
    }
-   if(mFields[iVariable].size() <= iTime) {
-      std::stringstream ss;
-      ss << "Attempted to access variable '" << iVariable.name() << "' for time " << iTime
-         << " in file '" << getFilename() << "'";
-      Util::error(ss.str());
+   else if(mSpillFile.spilled.count(key) > 0) {
+      // The field has been removed from memory, but is stored in the scratch file
+      field = unspillField(key);
+      storeField(field, iVariable, iTime, false);
+      mNumMisses++;
    }
-   FieldPtr field = mFields[iVariable][iTime];
-   if(!hasDefinedVariable(iVariable))
+   if(field != NULL && !hasDefinedVariable(iVariable))
       mVariables.push_back(iVariable);
    return field;
 }
 
+void File::readAhead(const Variable& iVariable, int iTime) const {
+   {
+      std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+      std::pair<Variable, int> key(iVariable, iTime);
+      if(mReadingAhead.count(key) > 0)
+         return;
+      std::map<Variable, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
+      if(it != mFields.end() && it->second[iTime] != NULL)
+         return;
+      mReadingAhead.insert(key);
+   }
+   // Skip reading ahead if the queue is busy, the field will then be read when needed
+   if(!getIoQueue().tryPush(std::bind(&File::readAheadCore, this, iVariable, iTime))) {
+      std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+      mReadingAhead.erase(std::pair<Variable, int>(iVariable, iTime));
+   }
+}
+
+void File::readAheadCore(const Variable& iVariable, int iTime) const {
+   std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+   bool read = false;
+   if(hasVariableCore(iVariable) && getCachedField(iVariable, iTime) == NULL) {
+      storeField(getFieldCore(iVariable, iTime), iVariable, iTime, true);
+      read = true;
+   }
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   if(read)
+      mNumMisses++;
+   mReadingAhead.erase(std::pair<Variable, int>(iVariable, iTime));
+}
+
+AsyncQueue& File::getIoQueue() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   if(mIoQueue.queue == NULL)
+      mIoQueue.queue.reset(new AsyncQueue(mMaxIoQueueSize));
+   return *mIoQueue.queue;
+}
+
+void File::stopIo() {
+   boost::shared_ptr<AsyncQueue> queue;
+   {
+      std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+      mReadAhead = false;
+      queue = mIoQueue.queue;
+   }
+   if(queue != NULL) {
+      // Writes must be completed, but fields that have not been read ahead yet can be skipped
+      queue->wait();
+   }
+}
+
+void File::setReadAhead(bool iReadAhead) {
+   mReadAhead = iReadAhead;
+}
+bool File::getReadAhead() const {
+   return mReadAhead;
+}
+
 File::~File() {
+   stopIo();
 }
 
 void File::write(std::vector<Variable> iVariables, std::string iMessage) {
-   writeCore(iVariables, iMessage);
+   if(mIoQueue.queue != NULL)
+      mIoQueue.queue->wait();
+   std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+   if(mWriteStarted) {
+      // Write the variables that have not been written by writeVariable
+      for(int v = 0; v < iVariables.size(); v++) {
+         if(mWritten.count(iVariables[v]) == 0) {
+            writeVariableCore(iVariables[v]);
+            mWritten.insert(iVariables[v]);
+         }
+      }
+      finishWriteCore();
+      mWriteStarted = false;
+      mWritten.clear();
+   }
+   else {
+      writeCore(iVariables, iMessage);
+   }
    // mCache.clear();
 }
 
+void File::startWrite(std::vector<Variable> iVariables, std::string iMessage) {
+   std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+   mWriteStarted = defineCore(iVariables, iMessage);
+   mWritten.clear();
+}
+
+void File::writeVariable(const Variable& iVariable) {
+   if(!mWriteStarted)
+      return;
+   {
+      std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+      if(mWritten.count(iVariable) > 0)
+         return;
+      mWritten.insert(iVariable);
+   }
+   getIoQueue().push([this, iVariable]() {
+      std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+      writeVariableCore(iVariable);
+   });
+}
+
 
 FieldPtr File::getEmptyField(float iFillValue) const {
    return getEmptyField(getNumY(), getNumX(), getNumEns(), iFillValue);
@@ -154,6 +289,11 @@ FieldPtr File::getEmptyField(int nY, int nX, int nEns, float iFillValue) const {
 }
 
 void File::addField(FieldPtr iField, const Variable& iVariable, int iTime) const {
+   storeField(iField, iVariable, iTime, false);
+}
+
+void File::storeField(FieldPtr iField, const Variable& iVariable, int iTime, bool iFromFile) const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    std::map<Variable, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
    if(it == mFields.end()) {
       mFields[iVariable].resize(getNumTime());
@@ -161,7 +301,180 @@ void File::addField(FieldPtr iField, const Variable& iVariable, int iTime) const
    if(!hasDefinedVariable(iVariable))
       mVariables.push_back(iVariable);
 
-   mFields[iVariable][iTime] = iField;
+   FieldKey key(iVariable, iTime);
+   FieldPtr& field = mFields[iVariable][iTime];
+   if(field != NULL)
+      mCacheSize -= getFieldSize(*field);
+   field = iField;
+   mSpillFile.spilled.erase(key);
+   if(iFromFile)
+      mFromFile.insert(key);
+   else
+      mFromFile.erase(key);
+
+   if(field != NULL) {
+      mCacheSize += getFieldSize(*field);
+      touchField(key);
+   }
+   else {
+      std::map<FieldKey, long>::iterator it = mLastUse.find(key);
+      if(it != mLastUse.end()) {
+         mLeastRecentlyUsed.erase(it->second);
+         mLastUse.erase(it);
+      }
+   }
+}
+
+void File::touchField(const FieldKey& iKey) const {
+   std::map<FieldKey, long>::iterator it = mLastUse.find(iKey);
+   if(it != mLastUse.end()) {
+      mLeastRecentlyUsed.erase(it->second);
+   }
+   mUseCounter++;
+   mLastUse[iKey] = mUseCounter;
+   mLeastRecentlyUsed[mUseCounter] = iKey;
+}
+
+void File::trimCache(const std::set<std::string>& iInUse) {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   if(!Util::isValid(mCacheLimit))
+      return;
+
+   std::map<long, FieldKey>::iterator it = mLeastRecentlyUsed.begin();
+   while(mCacheSize > mCacheLimit && it != mLeastRecentlyUsed.end()) {
+      FieldKey key = it->second;
+      std::map<long, FieldKey>::iterator curr = it;
+      it++;
+      if(mPinned.count(key.first) > 0 || iInUse.count(key.first.name()) > 0)
+         continue;
+
+      // Someone else holds the field, so removing it would not free any memory. It could also be
+      // changed after it was stored in the scratch file.
+      FieldPtr& field = mFields[key.first][key.second];
+      if(field.use_count() > 1)
+         continue;
+
+      // Fields that cannot be read again unchanged from the file must be kept or spilled
+      bool canReread = isReadOnly() && mFromFile.count(key) > 0;
+      if(!canReread) {
+         if(!mSpill)
+            continue;
+         spillField(key, *field);
+      }
+      mCacheSize -= getFieldSize(*field);
+      field.reset();
+      mFromFile.erase(key);
+      mLastUse.erase(key);
+      mLeastRecentlyUsed.erase(curr);
+      mNumEvictions++;
+   }
+}
+
+long File::getFieldSize(const Field& iField) const {
+   return (long) iField.getNumY() * iField.getNumX() * iField.getNumEns() * sizeof(float);
+}
+
+void File::spillField(const FieldKey& iKey, const Field& iField) const {
+   if(mSpillFile.file == NULL) {
+      mSpillFile.file = tmpfile();
+      if(mSpillFile.file == NULL)
+         Util::error("Could not create scratch file for the cache of '" + getFilename() + "'");
+   }
+   int nY = iField.getNumY();
+   int nX = iField.getNumX();
+   int nEns = iField.getNumEns();
+   long size = (long) nY * nX * nEns;
+
+   // Reuse the space if the field has been spilled before
+   long offset = mSpillFile.size;
+   std::map<FieldKey, long>::const_iterator it = mSpillFile.offsets.find(iKey);
+   if(it != mSpillFile.offsets.end())
+      offset = it->second;
+   else {
+      mSpillFile.offsets[iKey] = offset;
+      mSpillFile.size += size * sizeof(float);
+   }
+
+   std::vector<float> values(size);
+   long i = 0;
+   for(int y = 0; y < nY; y++) {
+      for(int x = 0; x < nX; x++) {
+         for(int e = 0; e < nEns; e++) {
+            values[i] = iField(y, x, e);
+            i++;
+         }
+      }
+   }
+   if(fseek(mSpillFile.file, offset, SEEK_SET) != 0 || fwrite(&values[0], sizeof(float), size, mSpillFile.file) != size)
+      Util::error("Could not write to scratch file for the cache of '" + getFilename() + "'");
+   mSpillFile.spilled.insert(iKey);
+}
+
+FieldPtr File::unspillField(const FieldKey& iKey) const {
+   FieldPtr field = getEmptyField();
+   int nY = field->getNumY();
+   int nX = field->getNumX();
+   int nEns = field->getNumEns();
+   long size = (long) nY * nX * nEns;
+   std::vector<float> values(size);
+   long offset = mSpillFile.offsets[iKey];
+   if(fseek(mSpillFile.file, offset, SEEK_SET) != 0 || fread(&values[0], sizeof(float), size, mSpillFile.file) != size)
+      Util::error("Could not read from scratch file for the cache of '" + getFilename() + "'");
+   long i = 0;
+   for(int y = 0; y < nY; y++) {
+      for(int x = 0; x < nX; x++) {
+         for(int e = 0; e < nEns; e++) {
+            (*field)(y, x, e) = values[i];
+            i++;
+         }
+      }
+   }
+   mSpillFile.spilled.erase(iKey);
+   return field;
+}
+
+void File::setCacheLimit(long iBytes) {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   mCacheLimit = iBytes;
+}
+long File::getCacheLimit() const {
+   return mCacheLimit;
+}
+void File::setSpill(bool iSpill) {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   mSpill = iSpill;
+}
+bool File::getSpill() const {
+   return mSpill;
+}
+void File::setPinned(const Variable& iVariable, bool iPinned) {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   if(iPinned)
+      mPinned.insert(iVariable);
+   else
+      mPinned.erase(iVariable);
+}
+bool File::isPinned(const Variable& iVariable) const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   return mPinned.count(iVariable) > 0;
+}
+long File::getNumCacheHits() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   return mNumHits;
+}
+long File::getNumCacheMisses() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   return mNumMisses;
+}
+long File::getNumCacheEvictions() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   return mNumEvictions;
+}
+std::string File::getCacheSummary() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   std::stringstream ss;
+   ss << mNumHits << " hits, " << mNumMisses << " misses, " << mNumEvictions << " evictions";
+   return ss.str();
 }
 
 bool File::hasSameDimensions(const File& iOther) const {
@@ -191,29 +504,42 @@ void File::initNewVariable(const Variable& iVariable) {
    }
 }
 void File::setVariables(std::vector<Variable> iVariables) {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    mVariables = iVariables;
 }
 bool File::hasVariable(const Variable& iVariable) const {
-   bool status = hasVariableCore(iVariable);
-   if(status)
-      return true;
+   {
+      std::lock_guard<std::recursive_mutex> coreLock(mCoreMutex);
+      bool status = hasVariableCore(iVariable);
+      if(status)
+         return true;
+   }
 
    // Check if field has been initialized
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    std::map<Variable, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
    return it != mFields.end();
 }
 
 void File::clear() {
+   // Wait for fields that are being read ahead, so that they are not added after clearing
+   if(mIoQueue.queue != NULL)
+      mIoQueue.queue->wait();
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    mFields.clear();
+   mCacheSize = 0;
+   mLastUse.clear();
+   mLeastRecentlyUsed.clear();
+   mFromFile.clear();
+   // Keep the scratch file, but reuse its space
+   mSpillFile.size = 0;
+   mSpillFile.offsets.clear();
+   mSpillFile.spilled.clear();
 }
 
 long File::getCacheSize() const {
-   long size = 0;
-   std::map<Variable, std::vector<FieldPtr> >::const_iterator it;
-   for(it = mFields.begin(); it != mFields.end(); it++) {
-      size += it->second.size() * getNumY()*getNumX()*getNumEns()*sizeof(float);
-   }
-   return size;
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
+   return mCacheSize;
 }
 
 Uuid File::getUniqueTag() const {
@@ -282,6 +608,7 @@ bool File::setLons(vec2 iLons) {
 bool File::setElevs(vec2 iElevs) {
    if(iElevs.size() != getNumY() || iElevs[0].size() != getNumX())
       return false;
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    mElevs = iElevs;
    mHasElevs = true;
    return true;
@@ -289,6 +616,7 @@ bool File::setElevs(vec2 iElevs) {
 bool File::setLandFractions(vec2 iLandFractions) {
    if(iLandFractions.size() != getNumY() || iLandFractions[0].size() != getNumX())
       return false;
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    mLandFractions = iLandFractions;
    return true;
 }
@@ -299,6 +627,7 @@ vec2 File::getLons() const {
    return mLons;
 }
 vec2 File::getElevs() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    // Elevations not set, return a grid of missing values
    if(mElevs.size() == 0) {
       vec2 elevs;
@@ -311,6 +640,7 @@ vec2 File::getElevs() const {
       return mElevs;
 }
 vec2 File::getLandFractions() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    if(mLandFractions.size() != getNumY() || mLandFractions[0].size() != getNumX()) {
       vec2 landFractions;
       landFractions.resize(getNumY());
@@ -363,6 +693,7 @@ std::vector<double> File::getTimes() const {
 }
 
 bool File::getVariable(std::string iVariableName, Variable& iVariable) const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    for(int i = 0; i < mVariables.size(); i++) {
       if(mVariables[i].name() == iVariableName) {
          iVariable = mVariables[i];
@@ -373,6 +704,7 @@ bool File::getVariable(std::string iVariableName, Variable& iVariable) const {
 }
 
 bool File::hasDefinedVariable(Variable iVariable) const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    for(int i = 0; i < mVariables.size(); i++) {
       if(mVariables[i] == iVariable) {
          return true;
@@ -382,6 +714,7 @@ bool File::hasDefinedVariable(Variable iVariable) const {
 }
 
 bool File::hasElevs() const {
+   std::lock_guard<std::recursive_mutex> lock(mFieldsMutex);
    return mHasElevs;
 }
 
@@ -395,5 +728,8 @@ std::string File::getDescriptions() {
    ss << FilePoint::description();
    ss << FileNorcomQnh::description();
    ss << FileText::description();
+   ss << "   Options for all types:" << std::endl;
+   ss << Util::formatDescription("   cacheSize=undef", "Keep at most this many MB of fields in memory, removing the least recently used fields. Fields read from an input file are read again when needed. Unlimited if unspecified.") << std::endl;
+   ss << Util::formatDescription("   spill=0", "Store removed fields that cannot be read again (e.g. output fields) in a temporary file, instead of keeping them in memory.") << std::endl;
    return ss.str();
 }
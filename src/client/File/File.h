@@ -2,17 +2,22 @@
 #define FILE_H
 #include <vector>
 #include <map>
+#include <set>
+#include <mutex>
+#include <stdio.h>
 #include <boost/shared_ptr.hpp>
 #include "../Variable.h"
 #include "../Uuid.h"
 #include "../Field.h"
 
 class Options;
+class AsyncQueue;
 
 // 3D array of data: [y][x][ensemble_member]
 typedef std::vector<std::vector<float> > vec2; // Y, X
 
-//! Represents a data file containing spatial and temporal data initialized at one particular time
+//! Represents a data file containing spatial and temporal data initialized at one particular time.
+//! Fields can be retrieved and added by several threads at the same time.
 class File {
    public:
       File(std::string iFilename, const Options& iOptions);
@@ -37,6 +42,21 @@ class File {
       // Write these variables to file
       void write(std::vector<Variable> iVariables, std::string iMessage="");
 
+      //! Prepare writing the variables one at a time, as soon as each is finished. write() must
+      //! still be called with the same variables at the end, which waits for the writing to
+      //! finish. Files that cannot write one variable at a time write everything in write().
+      void startWrite(std::vector<Variable> iVariables, std::string iMessage="");
+
+      //! Write a finished variable in the background, after startWrite has been called. Waits
+      //! if several variables are already waiting to be written. The fields of the variable
+      //! must not be changed afterwards.
+      void writeVariable(const Variable& iVariable);
+
+      //! When a field is retrieved, read the next timestep of the variable in the background,
+      //! so that it is ready when it is needed. Off by default.
+      void setReadAhead(bool iReadAhead);
+      bool getReadAhead() const;
+
       // Dimension sizes
 
       // Latitudes and longitudes must be set early on in the code, as this sets
@@ -71,6 +91,35 @@ class File {
       //! @return Number of bytes
       long getCacheSize() const;
 
+      //! Limit the memory used by the cache. The limit is applied by trimCache.
+      //! @param iBytes Maximum number of bytes, or Util::MV for no limit
+      void setCacheLimit(long iBytes);
+      long getCacheLimit() const;
+      //! Remove the least recently used fields until the cache is within the limit. Fields read
+      //! from a read-only file are read again when needed. Other fields are only removed when
+      //! spilling is enabled. Callers often keep references to fields (Field& f = *getField(...)),
+      //! so this must only be called when no one uses the fields of other variables than those
+      //! listed.
+      //! @param iInUse Names of variables whose fields must not be removed
+      void trimCache(const std::set<std::string>& iInUse=std::set<std::string>());
+      //! Store removed fields that cannot be read again from the file in a scratch file
+      void setSpill(bool iSpill);
+      bool getSpill() const;
+      //! Never remove fields of this variable from the cache
+      void setPinned(const Variable& iVariable, bool iPinned=true);
+      bool isPinned(const Variable& iVariable) const;
+      //! Number of fields retrieved from the cache
+      long getNumCacheHits() const;
+      //! Number of fields that were read from the file or the scratch file
+      long getNumCacheMisses() const;
+      //! Number of fields removed from the cache to stay within the limit
+      long getNumCacheEvictions() const;
+      //! Summary of the cache usage, for status messages
+      std::string getCacheSummary() const;
+
+      //! Can fields read from the file be read again unchanged?
+      virtual bool isReadOnly() const {return false;};
+
       //! Returns a tag that uniquely identifies the latitude/longitude grid
       //! If the grid changes, a new tag is issued. Two files with the same grid
       //! will not have the same unique tag.
@@ -94,6 +143,16 @@ class File {
       virtual void writeCore(std::vector<Variable> iVariables, std::string iMessage="") = 0;
       //! Does the subclass provide this variable without deriving it?
       virtual bool hasVariableCore(const Variable& iVariable) const = 0;
+      //! Prepare writing the variables one at a time with writeVariableCore
+      //! @return False if the file cannot write one variable at a time
+      virtual bool defineCore(std::vector<Variable> iVariables, std::string iMessage) {return false;};
+      //! Write one variable that has been prepared by defineCore
+      virtual void writeVariableCore(const Variable& iVariable) {};
+      //! Write the altitudes after all variables have been written, since calibrators can change them
+      virtual void finishWriteCore() {};
+      //! Wait for background writes to finish and stop reading ahead. Subclasses must call this
+      //! in their destructor, since the background thread uses the *Core functions.
+      void stopIo();
 
       // Subclasses must fill these fields in the constructor:
       vec2 mLandFractions;
@@ -103,8 +162,92 @@ class File {
       mutable std::vector<Variable> mVariables;
       std::map<std::string, Variable> mVariableAliases;
    private:
+      //! Mutex that keeps File copyable. A copy gets its own unlocked mutex.
+      class FieldsMutex : public std::recursive_mutex {
+         public:
+            FieldsMutex() {};
+            FieldsMutex(const FieldsMutex&) {};
+            FieldsMutex& operator=(const FieldsMutex&) { return *this; };
+      };
       std::string mFilename;
       mutable std::map<Variable, std::vector<FieldPtr> > mFields;  // Variable, offset
+      //! Protects mFields and mVariables, and the altitudes and land fractions, which calibrators
+      //! can change while other variables are processed
+      mutable FieldsMutex mFieldsMutex;
+      //! Serializes calls to the *Core functions of all files, since the NetCDF library is not
+      //! thread-safe. Must not be locked by a thread that holds mFieldsMutex.
+      static std::recursive_mutex mCoreMutex;
+      //! Queue for reading and writing in the background, created on first use. A copy of a
+      //! File gets its own queue.
+      class IoQueue {
+         public:
+            IoQueue() {};
+            IoQueue(const IoQueue&) {};
+            IoQueue& operator=(const IoQueue&) { return *this; };
+            boost::shared_ptr<AsyncQueue> queue;
+      };
+      mutable IoQueue mIoQueue;
+      AsyncQueue& getIoQueue() const;
+      //! Maximum number of reads and writes waiting in the background queue. Limits the memory
+      //! used by variables waiting to be written.
+      static const int mMaxIoQueueSize = 4;
+      bool mReadAhead;
+      //! Fields that have been queued for reading ahead
+      mutable std::set<std::pair<Variable, int> > mReadingAhead;
+      //! Queue reading of a field in the background, if it has not been read already
+      void readAhead(const Variable& iVariable, int iTime) const;
+      //! Read a field that has been queued by readAhead
+      void readAheadCore(const Variable& iVariable, int iTime) const;
+      //! Has startWrite prepared the file for writing one variable at a time?
+      bool mWriteStarted;
+      //! Variables that have been written by writeVariable
+      std::set<Variable> mWritten;
+      typedef std::pair<Variable, int> FieldKey;
+      //! Store a field in the cache
+      //! @param iFromFile Was the field read from the file by getFieldCore?
+      void storeField(FieldPtr iField, const Variable& iVariable, int iTime, bool iFromFile) const;
+      //! Mark the field as the most recently used
+      void touchField(const FieldKey& iKey) const;
+      long getFieldSize(const Field& iField) const;
+      long mCacheLimit;
+      bool mSpill;
+      std::set<Variable> mPinned;
+      //! Number of bytes in fields stored in the cache
+      mutable long mCacheSize;
+      //! Counter used to order fields by when they were last used
+      mutable long mUseCounter;
+      mutable std::map<FieldKey, long> mLastUse;
+      mutable std::map<long, FieldKey> mLeastRecentlyUsed;
+      //! Fields that were read from the file and have not been replaced
+      mutable std::set<FieldKey> mFromFile;
+      mutable long mNumHits;
+      mutable long mNumMisses;
+      mutable long mNumEvictions;
+      //! Scratch file for fields removed from the cache, created on first use. A copy of a File
+      //! starts with an empty scratch file, so spilled fields are not copied.
+      class SpillFile {
+         public:
+            SpillFile() : file(NULL), size(0) {};
+            SpillFile(const SpillFile&) : file(NULL), size(0) {};
+            SpillFile& operator=(const SpillFile&) { return *this; };
+            ~SpillFile() { if(file != NULL) fclose(file); };
+            FILE* file;
+            //! Number of bytes used in the file
+            long size;
+            //! Position of each field in the file
+            std::map<FieldKey, long> offsets;
+            //! Fields whose current values are in the file
+            std::set<FieldKey> spilled;
+      };
+      mutable SpillFile mSpillFile;
+      //! Write the field to the scratch file
+      void spillField(const FieldKey& iKey, const Field& iField) const;
+      //! Read a field from the scratch file
+      FieldPtr unspillField(const FieldKey& iKey) const;
+      //! Get a field that has been read or added, allocating space for the variable if needed
+      //! @return NULL if the field is not available
+      //! @param iCountHit Count the retrieval as a cache hit if the field is in memory
+      FieldPtr getCachedField(const Variable& iVariable, int iTime, bool iCountHit=false) const;
       mutable Uuid mTag;
       void createNewTag() const;
       FieldPtr getEmptyField(int nY, int nX, int nEns, float iFillValue=Util::MV) const;
@@ -3,10 +3,16 @@
 #include <netcdf.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <algorithm>
 #include "../Util.h"
 
 FileNetcdf::FileNetcdf(std::string iFilename, const Options& iOptions, bool iReadOnly) : File(iFilename, iOptions),
-      mInDataMode(true)
+      mInDataMode(true),
+      mReadOnly(iReadOnly),
+      mDeflate(0),
+      mShuffle(false),
+      mSignificantDigits(Util::MV),
+      mTimesPerWrite(1)
 {
    int status = nc_open(getFilename().c_str(), iReadOnly ? NC_NOWRITE: NC_WRITE, &mFile);
    if(status != NC_NOERR) {
@@ -95,8 +101,41 @@ FileNetcdf::FileNetcdf(std::string iFilename, const Options& iOptions, bool iRea
    if(!iOptions.getValue("lafVar", lafVar)) {
       lafVar = "land_area_fraction";
    }
+
+   // Output layout
+   if(iOptions.getValues("chunks", mChunks)) {
+      if(mChunks.size() != 4)
+         Util::error("'chunks' must have 4 values (time, ensemble, y, x)");
+      for(int i = 0; i < mChunks.size(); i++) {
+         if(mChunks[i] < 0)
+            Util::error("'chunks' cannot have negative values");
+      }
+   }
+   iOptions.getValue("deflate", mDeflate);
+   if(mDeflate < 0 || mDeflate > 9)
+      Util::error("'deflate' must be between 0 and 9");
+   iOptions.getValue("shuffle", mShuffle);
+   iOptions.getValue("significantDigits", mSignificantDigits);
+   if(Util::isValid(mSignificantDigits) && (mSignificantDigits < 1 || mSignificantDigits > 7))
+      Util::error("'significantDigits' must be between 1 and 7");
+   iOptions.getValue("timesPerWrite", mTimesPerWrite);
+   if(mTimesPerWrite < 1)
+      Util::error("'timesPerWrite' must be 1 or more");
    iOptions.check();
 
+   if(mChunks.size() > 0 || mDeflate > 0 || mShuffle || Util::isValid(mSignificantDigits)) {
+      int format;
+      status = nc_inq_format(mFile, &format);
+      handleNetcdfError(status, "could not determine file format");
+      if(format != NC_FORMAT_NETCDF4 && format != NC_FORMAT_NETCDF4_CLASSIC) {
+         Util::warning("Chunking and compression require a NetCDF-4 file. '" + getFilename() + "' is written without.");
+         mChunks.clear();
+         mDeflate = 0;
+         mShuffle = false;
+         mSignificantDigits = Util::MV;
+      }
+   }
+
    // Done reading options
 
    // Retrieve lat/lon grid
@@ -224,6 +263,7 @@ FileNetcdf::FileNetcdf(std::string iFilename, const Options& iOptions, bool iRea
 }
 
 FileNetcdf::~FileNetcdf() {
+   stopIo();
    nc_close(mFile);
 }
 
@@ -284,20 +324,11 @@ FieldPtr FileNetcdf::getFieldCore(const Variable& iVariable, int iTime) const {
       Util::warning(ss.str());
    }
 
-   // Initialize vector
-   size_t size = 1;
-   for(int d = 0; d < dims.size(); d++) {
-      size *= count[d];
-   }
-   float* values = new float[size];
-   nc_get_vara_float(mFile, var, start, count, values);
-
    float MV = getMissingValue(var);
    float offset = getOffset(var);
    float scale = getScale(var);
 
    FieldPtr field = getEmptyField();
-   std::vector<int> countVector(count, count + dims.size());
    int nEns = 1;
    if(Util::isValid(ensPos))
       nEns = count[ensPos];
@@ -307,74 +338,108 @@ FieldPtr FileNetcdf::getFieldCore(const Variable& iVariable, int iTime) const {
    int nX = 1;
    if(Util::isValid(xPos))
       nX = count[xPos];
-   std::vector<int> indices(dims.size(), 0);
-   for(int e = 0; e < nEns; e++) {
-      if(Util::isValid(ensPos))
-         indices[ensPos] = e;
+
+   // Position of the ensemble, y, and x dimensions in the retrieved slice. The other dimensions
+   // have a count of 1.
+   long size = 1;
+   long strideEns = 0;
+   long strideY = 0;
+   long strideX = 0;
+   for(int d = dims.size() - 1; d >= 0; d--) {
+      if(d == ensPos)
+         strideEns = size;
+      else if(d == yPos)
+         strideY = size;
+      else if(d == xPos)
+         strideX = size;
+      size *= count[d];
+   }
+
+   // Read directly into the field if the slice has the same layout
+   int fieldEns = field->getNumEns();
+   int fieldX = field->getNumX();
+   bool sameLayout = nEns == fieldEns && nX == fieldX && nY == field->getNumY()
+                     && (nEns == 1 || strideEns == 1)
+                     && (nX == 1 || strideX == nEns)
+                     && (nY == 1 || strideY == nX * nEns);
+   float* data = field->getData();
+   if(sameLayout) {
+      nc_get_vara_float(mFile, var, start, count, data);
+      #pragma omp parallel for
       for(int y = 0; y < nY; y++) {
-         if(Util::isValid(yPos))
-            indices[yPos] = y;
-         for(int x = 0; x < nX; x++) {
-            if(Util::isValid(xPos))
-               indices[xPos] = x;
-            int i = getIndex(countVector, indices);
-            float value = values[i];
-            if(Util::isValid(MV) && value == MV) {
-               // Field has missing value indicator and the value is missing
-               // Save values using our own internal missing value indicator
-               value = Util::MV;
+         float* row = data + (long) y * nX * nEns;
+         unpack(row, row, nX * nEns, MV, scale, offset);
+      }
+      return field;
+   }
+
+   std::vector<float> values(size);
+   nc_get_vara_float(mFile, var, start, count, &values[0]);
+
+   // Transpose in blocks along x, so that the part of the field being written stays in cache
+   // while the members are copied in. The values of one member are then read contiguously when
+   // x changes fastest in the file.
+   const int blockSize = 64;
+   #pragma omp parallel for
+   for(int y = 0; y < nY; y++) {
+      float* row = data + (long) y * fieldX * fieldEns;
+      std::vector<float> block(blockSize);
+      for(int xStart = 0; xStart < nX; xStart += blockSize) {
+         int numX = std::min(blockSize, nX - xStart);
+         for(int e = 0; e < nEns; e++) {
+            const float* source = &values[y * strideY + e * strideEns + xStart * strideX];
+            for(int x = 0; x < numX; x++) {
+               block[x] = source[x * strideX];
             }
-            else {
-               value = scale*value + offset;
+            unpack(&block[0], &block[0], numX, MV, scale, offset);
+            for(int x = 0; x < numX; x++) {
+               row[(xStart + x) * fieldEns + e] = block[x];
             }
-            (*field)(y,x,e) = value;
-            // std::cout << e << " " << y << " " << x << " " << i << " " << value << std::endl;
          }
       }
    }
-   // Alternative, but slower way. This loops over the vector and fills values into
-   // the 3D array, instead of the otherway around.
-   /*
-   std::vector<int> indices(dims.size(), 0);
-   for(int i = 0; i < size; i++) {
-      getIndices(i, countVector, indices);
-      int e = 0;
-      int y = 0;
-      int x = 0;
-      if(Util::isValid(ensPos))
-         e = indices[ensPos];
-      if(Util::isValid(yPos))
-         y = indices[yPos];
-      if(Util::isValid(xPos))
-         x = indices[xPos];
-      float value = values[i];
-      if(Util::isValid(MV) && value == MV) {
-         // Field has missing value indicator and the value is missing
+   return field;
+}
+void FileNetcdf::unpack(const float* iValues, float* oValues, int iSize, float iMV, float iScale, float iOffset) {
+   if(Util::isValid(iMV)) {
+      #pragma omp simd
+      for(int i = 0; i < iSize; i++) {
+         float value = iValues[i];
          // Save values using our own internal missing value indicator
-         value = Util::MV;
+         oValues[i] = (value == iMV) ? Util::MV : iScale * value + iOffset;
       }
-      else {
-         value = scale*value + offset;
+   }
+   else if(iScale != 1 || iOffset != 0) {
+      #pragma omp simd
+      for(int i = 0; i < iSize; i++) {
+         oValues[i] = iScale * iValues[i] + iOffset;
       }
-      (*field)(y,x,e) = value;
    }
-  */
-   delete[] values;
-   return field;
+   else if(oValues != iValues) {
+      std::copy(iValues, iValues + iSize, oValues);
+   }
+}
+void FileNetcdf::pack(const float* iValues, float* oValues, int iSize, float iMV, float iScale, float iOffset) {
+   #pragma omp simd
+   for(int i = 0; i < iSize; i++) {
+      float value = iValues[i];
+      // Save values using the file's missing indicator value
+      oValues[i] = Util::isValid(value) ? (value - iOffset) / iScale : iMV;
+   }
 }
 
 void FileNetcdf::writeCore(std::vector<Variable> iVariables, std::string iMessage) {
+   defineCore(iVariables, iMessage);
+   for(int v = 0; v < iVariables.size(); v++) {
+      writeVariableCore(iVariables[v]);
+   }
+   finishWriteCore();
+}
+
+bool FileNetcdf::defineCore(std::vector<Variable> iVariables, std::string iMessage) {
    startDefineMode();
 
-   // check if altitudes are valid
-   bool isAltitudeValid = false;
-   vec2 elevs = getElevs();
-   for(int i = 0; i < elevs.size(); i++) {
-      for(int j = 0; j < elevs[i].size(); j++) {
-         isAltitudeValid = isAltitudeValid || Util::isValid(elevs[i][j]);
-      }
-   }
-   if(isAltitudeValid && !hasVar("altitude")) {
+   if(hasValidAltitude() && !hasVar("altitude")) {
       defineAltitude();
    }
 
@@ -412,6 +477,7 @@ void FileNetcdf::writeCore(std::vector<Variable> iVariables, std::string iMessag
          int var = Util::MV;
          int status = nc_def_var(mFile, variableName.c_str(), NC_FLOAT, numDims, dims, &var);
          handleNetcdfError(status, "could not define variable '" + variableName + "'");
+         defineStorage(var, std::vector<int>(dims, dims + numDims));
       }
       int var = getVar(variableName);
       float MV = getMissingValue(var); // The output file's missing value indicator
@@ -430,95 +496,198 @@ void FileNetcdf::writeCore(std::vector<Variable> iVariables, std::string iMessag
 
    writeTimes();
    writeReferenceTime();
-   if(isAltitudeValid) {
-      writeAltitude();
+   return true;
+}
+
+void FileNetcdf::finishWriteCore() {
+   // The altitudes are written last, since calibrators can change them while the variables are
+   // being written
+   if(!hasValidAltitude())
+      return;
+   if(!hasVar("altitude")) {
+      startDefineMode();
+      defineAltitude();
    }
-   for(int v = 0; v < iVariables.size(); v++) {
-      Variable variable = iVariables[v];
-      std::string variableName = variable.name();
-      assert(hasVariableCore(variable));
-      int var = getVar(variableName);
-      float MV = getMissingValue(var); // The output file's missing value indicator
-      size_t size = 1*1*mNEns*getNumY()*getNumX();
-      float* values = new float[size];
+   startDataMode();
+   writeAltitude();
+}
 
-      std::vector<int> dims = getDims(var);
-      size_t count[dims.size()];
-      int ensPos = Util::MV;
-      int yPos = Util::MV;
-      int xPos = Util::MV;
-      int timePos = Util::MV;
-      for(int d = 0; d < dims.size(); d++) {
-         int dim = dims[d];
-         count[d] = 1;
-         if(dim == mTimeDim) {
-            timePos = d;
-         }
-         else if(dim == mEnsDim) {
-            count[d] = getDimSize(dim);
-            ensPos = d;
-         }
-         else if(dim == mYDim) {
-            count[d] = getDimSize(dim);
-            yPos = d;
-         }
-         else if(dim == mXDim) {
-            count[d] = getDimSize(dim);
-            xPos = d;
-         }
+bool FileNetcdf::hasValidAltitude() const {
+   vec2 elevs = getElevs();
+   for(int i = 0; i < elevs.size(); i++) {
+      for(int j = 0; j < elevs[i].size(); j++) {
+         if(Util::isValid(elevs[i][j]))
+            return true;
+      }
+   }
+   return false;
+}
+
+void FileNetcdf::writeVariableCore(const Variable& iVariable) {
+   startDataMode();
+   std::string variableName = iVariable.name();
+   assert(hasVariableCore(iVariable));
+   int var = getVar(variableName);
+   float MV = getMissingValue(var); // The output file's missing value indicator
+   float offset = getOffset(var);
+   float scale = getScale(var);
+
+   std::vector<int> dims = getDims(var);
+   size_t count[dims.size()];
+   size_t start[dims.size()];
+   int ensPos = Util::MV;
+   int yPos = Util::MV;
+   int xPos = Util::MV;
+   int timePos = Util::MV;
+   for(int d = 0; d < dims.size(); d++) {
+      int dim = dims[d];
+      count[d] = 1;
+      start[d] = 0;
+      if(dim == mTimeDim) {
+         timePos = d;
+      }
+      else if(dim == mEnsDim) {
+         count[d] = getDimSize(dim);
+         ensPos = d;
+      }
+      else if(dim == mYDim) {
+         count[d] = getDimSize(dim);
+         yPos = d;
+      }
+      else if(dim == mXDim) {
+         count[d] = getDimSize(dim);
+         xPos = d;
       }
+   }
+   int nEns = 1;
+   if(Util::isValid(ensPos))
+      nEns = count[ensPos];
+   int nY = 1;
+   if(Util::isValid(yPos))
+      nY = count[yPos];
+   int nX = 1;
+   if(Util::isValid(xPos))
+      nX = count[xPos];
+
+   // Write several time steps at a time. Without a time dimension, the same values are
+   // written for each time step, so only write the last one.
+   int timesPerWrite = Util::isValid(timePos) ? mTimesPerWrite : 1;
+   int tFirst = Util::isValid(timePos) ? 0 : getNumTime() - 1;
+   std::vector<float> values;
+   for(int tStart = tFirst; tStart < getNumTime(); tStart += timesPerWrite) {
+      int numTimes = std::min(timesPerWrite, getNumTime() - tStart);
+      if(Util::isValid(timePos)) {
+         start[timePos] = tStart;
+         count[timePos] = numTimes;
+      }
+
+      // Position of each dimension in the buffer
+      long size = 1;
+      long strideTime = 0;
+      long strideEns = 0;
+      long strideY = 0;
+      long strideX = 0;
+      for(int d = dims.size() - 1; d >= 0; d--) {
+         if(d == timePos)
+            strideTime = size;
+         else if(d == ensPos)
+            strideEns = size;
+         else if(d == yPos)
+            strideY = size;
+         else if(d == xPos)
+            strideX = size;
+         size *= count[d];
+      }
+      values.assign(size, MV);
+
+      for(int i = 0; i < numTimes; i++) {
+         FieldPtr field = getField(iVariable, tStart + i);
+         if(field == NULL) // TODO: Can't be null if coming from reference
+            continue;
+         float* output = &values[i * strideTime];
+         const float* data = field->getData();
+         int fieldEns = field->getNumEns();
+         int fieldX = field->getNumX();
+         bool sameLayout = nEns == fieldEns && nX == fieldX && nY == field->getNumY()
+                           && (nEns == 1 || strideEns == 1)
+                           && (nX == 1 || strideX == nEns)
+                           && (nY == 1 || strideY == nX * nEns);
+         if(sameLayout) {
+            #pragma omp parallel for
+            for(int y = 0; y < nY; y++) {
+               long index = (long) y * nX * nEns;
+               pack(data + index, output + index, nX * nEns, MV, scale, offset);
+            }
+            continue;
+         }
 
-      for(int t = 0; t < getNumTime(); t++) {
-         size_t start[dims.size()];
-         for(int d = 0; d < dims.size(); d++)
-            start[d] = 0;
-         if(Util::isValid(timePos))
-            start[timePos] = t;
-
-         float offset = getOffset(var);
-         float scale = getScale(var);
-         FieldPtr field = getField(variable, t);
-         if(field != NULL) { // TODO: Can't be null if coming from reference
-            std::vector<int> countVector(count, count + dims.size());
-
-            int nEns = 1;
-            if(Util::isValid(ensPos))
-               nEns = count[ensPos];
-            int nY = 1;
-            if(Util::isValid(yPos))
-               nY = count[yPos];
-            int nX = 1;
-            if(Util::isValid(xPos))
-               nX = count[xPos];
-            std::vector<int> indices(dims.size(), 0);
-            for(int e = 0; e < nEns; e++) {
-               if(Util::isValid(ensPos))
-                  indices[ensPos] = e;
-               for(int y = 0; y < nY; y++) {
-                  if(Util::isValid(yPos))
-                     indices[yPos] = y;
-                  for(int x = 0; x < nX; x++) {
-                     if(Util::isValid(xPos))
-                        indices[xPos] = x;
-                     int i = getIndex(countVector, indices);
-                     float value = (*field)(y, x, e);
-                     if(Util::isValid(MV) && !Util::isValid(value)) {
-                        // Field has missing value indicator and the value is missing
-                        // Save values using the file's missing indicator value
-                        value = MV;
-                     }
-                     else {
-                        value = (value - offset)/scale;
-                     }
-                     values[i] = value;
+         // Transpose in blocks along x, as when reading
+         const int blockSize = 64;
+         #pragma omp parallel for
+         for(int y = 0; y < nY; y++) {
+            const float* row = data + (long) y * fieldX * fieldEns;
+            std::vector<float> block(blockSize);
+            for(int xStart = 0; xStart < nX; xStart += blockSize) {
+               int numX = std::min(blockSize, nX - xStart);
+               for(int e = 0; e < nEns; e++) {
+                  for(int x = 0; x < numX; x++) {
+                     block[x] = row[(xStart + x) * fieldEns + e];
+                  }
+                  pack(&block[0], &block[0], numX, MV, scale, offset);
+                  float* destination = output + y * strideY + e * strideEns + xStart * strideX;
+                  for(int x = 0; x < numX; x++) {
+                     destination[x * strideX] = block[x];
                   }
                }
             }
-            int status = nc_put_vara_float(mFile, var, start, count, values);
-            handleNetcdfError(status, "could not write variable " + variableName);
          }
       }
-      delete[] values;
+      int status = nc_put_vara_float(mFile, var, start, count, &values[0]);
+      handleNetcdfError(status, "could not write variable " + variableName);
+   }
+}
+void FileNetcdf::defineStorage(int iVar, const std::vector<int>& iDims) const {
+   bool compress = mDeflate > 0 || mShuffle || Util::isValid(mSignificantDigits);
+   if(mChunks.size() == 0 && !compress)
+      return;
+
+   // Use one chunk per time step and member by default, so that single time steps can be read
+   // and written efficiently
+   size_t chunks[iDims.size()];
+   for(int d = 0; d < iDims.size(); d++) {
+      int chunk = 0;
+      if(mChunks.size() > 0) {
+         if(iDims[d] == mTimeDim)
+            chunk = mChunks[0];
+         else if(iDims[d] == mEnsDim)
+            chunk = mChunks[1];
+         else if(iDims[d] == mYDim)
+            chunk = mChunks[2];
+         else if(iDims[d] == mXDim)
+            chunk = mChunks[3];
+      }
+      else if(iDims[d] == mTimeDim || iDims[d] == mEnsDim) {
+         chunk = 1;
+      }
+      int size = getDimSize(iDims[d]);
+      if(chunk == 0 || chunk > size)
+         chunk = size;
+      chunks[d] = std::max(chunk, 1);
+   }
+   int status = nc_def_var_chunking(mFile, iVar, NC_CHUNKED, chunks);
+   handleNetcdfError(status, "could not set chunking");
+
+   if(mDeflate > 0 || mShuffle) {
+      status = nc_def_var_deflate(mFile, iVar, mShuffle, mDeflate > 0, mDeflate);
+      handleNetcdfError(status, "could not set compression");
+   }
+   if(Util::isValid(mSignificantDigits)) {
+#ifdef NC_QUANTIZE_BITGROOM
+      status = nc_def_var_quantize(mFile, iVar, NC_QUANTIZE_BITGROOM, mSignificantDigits);
+      handleNetcdfError(status, "could not set quantization");
+#else
+      Util::warning("Quantization requires NetCDF 4.9 or later. Variables are written without.");
+#endif
    }
 }
 
@@ -1319,5 +1488,10 @@ std::string FileNetcdf::description() {
    ss << Util::formatDescription("   elevVar=undef", "Name of altitude variable. If unspecified, 'altitude' or 'surface_geopotential' is used.") << std::endl;
    ss << Util::formatDescription("   lafVar=undef", "Name of land-area-fraction variable. Auto-detected if unspecified.") << std::endl;
    ss << Util::formatDescription("   variables=undef", "Variable definition file.") << std::endl;
+   ss << Util::formatDescription("   chunks=undef", "Chunk sizes of new variables for the time, ensemble, y, and x dimensions, e.g. 1,1,0,0. 0 uses the whole dimension. If unspecified, one chunk per time step and member when compressing and the library default otherwise. NetCDF-4 files only.") << std::endl;
+   ss << Util::formatDescription("   deflate=0", "Compress new variables with this deflate level (0-9). NetCDF-4 files only.") << std::endl;
+   ss << Util::formatDescription("   shuffle=0", "Apply the shuffle filter to new variables. NetCDF-4 files only.") << std::endl;
+   ss << Util::formatDescription("   significantDigits=undef", "Quantize new variables, keeping this many significant digits (1-7). Improves compression. NetCDF-4 files only.") << std::endl;
+   ss << Util::formatDescription("   timesPerWrite=1", "Write this many time steps at a time. Faster, but uses more memory.") << std::endl;
    return ss.str();
 }
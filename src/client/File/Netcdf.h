@@ -44,17 +44,23 @@ class FileNetcdf : public File {
 
       static std::string description();
       std::string name() const {return "netcdf";};
+      bool isReadOnly() const {return mReadOnly;};
 
    protected:
       float getScale(int iVar) const;
       float getOffset(int iVar) const;
       void writeCore(std::vector<Variable> iVariables, std::string iMessage="");
+      bool defineCore(std::vector<Variable> iVariables, std::string iMessage);
+      void writeVariableCore(const Variable& iVariable);
+      void finishWriteCore();
       FieldPtr getFieldCore(const Variable& iVariable, int iTime) const;
       bool hasVariableCore(const Variable& iVariable) const;
 
       vec2 getGridValues(int iVariable) const;
       void writeAltitude() const;
       void defineAltitude();
+      //! Is at least one of the altitudes valid?
+      bool hasValidAltitude() const;
 
       int mYDim;
       int mXDim;
@@ -89,12 +95,31 @@ class FileNetcdf : public File {
       void startDefineMode() const;
       void startDataMode() const;
       mutable bool mInDataMode;
+      bool mReadOnly;
+
+      // Storage of new variables in NetCDF-4 files
+      //! Chunk sizes for the time, ensemble, y, and x dimensions. Empty for the library default.
+      std::vector<int> mChunks;
+      int mDeflate;
+      bool mShuffle;
+      //! Number of significant digits kept by quantization, Util::MV to keep all
+      int mSignificantDigits;
+      //! Number of time steps written in one call to the NetCDF library
+      int mTimesPerWrite;
+      //! Set chunking, compression, and quantization of a new variable
+      void defineStorage(int iVar, const std::vector<int>& iDims) const;
       float getMissingValue(int iVar) const;
       void  setMissingValue(int iVar, float iValue) const;
       //! Convert linear index 'i' to vector 'iInidices'. 'iCount' specifies the size of the data
       //! Using row-major ordering (last index varies fastest)
       int getIndex(const std::vector<int>& iCount, const std::vector<int>& iIndices) const;
       void getIndices(int i, const std::vector<int>& iCount, std::vector<int>& iIndices) const;
+      //! Convert values read from the file into physical values, where missing values are
+      //! Util::MV. iValues and oValues can be the same array.
+      //! @param iMV Missing value indicator in the file
+      static void unpack(const float* iValues, float* oValues, int iSize, float iMV, float iScale, float iOffset);
+      //! Convert physical values into values stored in the file. The inverse of unpack.
+      static void pack(const float* iValues, float* oValues, int iSize, float iMV, float iScale, float iOffset);
       void setAttribute(int iVar, std::string iName, std::string iValue);
       void defineTimes();
       void defineEns();
@@ -75,6 +75,7 @@ FileNorcomQnh::FileNorcomQnh(std::string iFilename, const Options& iOptions) :
 }
 
 FileNorcomQnh::~FileNorcomQnh() {
+   stopIo();
 }
 
 FieldPtr FileNorcomQnh::getFieldCore(const Variable& iVariable, int iTime) const {
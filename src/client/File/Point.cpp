@@ -90,6 +90,7 @@ FilePoint::FilePoint(std::string iFilename, const Options& iOptions) :
 }
 
 FilePoint::~FilePoint() {
+   stopIo();
 }
 
 FieldPtr FilePoint::getFieldCore(const Variable& iVariable, int iTime) const {
@@ -124,6 +124,10 @@ FileText::FileText(std::string iFilename, const Options& iOptions) :
    }
 }
 
+FileText::~FileText() {
+   stopIo();
+}
+
 FieldPtr FileText::getFieldCore(const Variable& iVariable, int iTime) const {
    return mLocalFields[iTime];
 }
@@ -13,6 +13,7 @@ class Location;
 class FileText : public File {
    public:
       FileText(std::string iFilename, const Options& iOptions);
+      ~FileText();
       static std::string description();
       std::string name() const {return "text";};
    protected:
@@ -0,0 +1,105 @@
+#include "Scheduler.h"
+#include <thread>
+#include <sstream>
+#include "Util.h"
+
+Scheduler::Scheduler(int iNumThreads) :
+      mNumThreads(iNumThreads),
+      mNumStarted(0) {
+   if(mNumThreads < 1) {
+      std::stringstream ss;
+      ss << "Number of threads (" << iNumThreads << ") must be at least 1";
+      Util::error(ss.str());
+   }
+}
+
+int Scheduler::addTask(std::function<void()> iTask, const std::vector<int>& iDependencies) {
+   int index = mTasks.size();
+   mTasks.push_back(iTask);
+   mDependents.push_back(std::vector<int>());
+   mNumWaiting.push_back(0);
+   mStarted.push_back(false);
+   for(int i = 0; i < iDependencies.size(); i++) {
+      int dependency = iDependencies[i];
+      if(dependency < 0 || dependency >= index) {
+         std::stringstream ss;
+         ss << "Task " << index << " cannot depend on task " << dependency;
+         Util::error(ss.str());
+      }
+      mDependents[dependency].push_back(index);
+      mNumWaiting[index]++;
+   }
+   return index;
+}
+
+void Scheduler::run() {
+   int numThreads = std::min(mNumThreads, getNumTasks());
+   if(numThreads <= 1) {
+      // Run in the calling thread, in the order the tasks were added
+      work();
+   }
+   else {
+      std::vector<std::thread> threads;
+      for(int i = 0; i < numThreads; i++) {
+         threads.push_back(std::thread(&Scheduler::work, this));
+      }
+      for(int i = 0; i < threads.size(); i++) {
+         threads[i].join();
+      }
+   }
+   if(mException)
+      std::rethrow_exception(mException);
+}
+
+void Scheduler::work() {
+   std::unique_lock<std::mutex> lock(mMutex);
+   while(true) {
+      // Wait until a task is ready, or there are no more tasks to start
+      int task = -1;
+      mCondition.wait(lock, [&] {
+         task = getReadyTask();
+         return task >= 0 || mNumStarted == getNumTasks() || mException;
+      });
+      if(task < 0)
+         break;
+
+      mStarted[task] = true;
+      mNumStarted++;
+      lock.unlock();
+      try {
+         mTasks[task]();
+      }
+      catch(...) {
+         lock.lock();
+         if(!mException)
+            mException = std::current_exception();
+         lock.unlock();
+      }
+      lock.lock();
+
+      for(int i = 0; i < mDependents[task].size(); i++) {
+         mNumWaiting[mDependents[task][i]]--;
+      }
+      mCondition.notify_all();
+   }
+   // Wake up the other threads, so they can also stop
+   mCondition.notify_all();
+}
+
+int Scheduler::getReadyTask() const {
+   if(mException)
+      return -1;
+   for(int i = 0; i < mTasks.size(); i++) {
+      if(!mStarted[i] && mNumWaiting[i] == 0)
+         return i;
+   }
+   return -1;
+}
+
+int Scheduler::getNumThreads() const {
+   return mNumThreads;
+}
+
+int Scheduler::getNumTasks() const {
+   return mTasks.size();
+}
@@ -0,0 +1,45 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+//! Runs tasks on a pool of threads. A task is started when all tasks it depends on have
+//! finished. Ready tasks are started in the order they were added.
+class Scheduler {
+   public:
+      //! @param iNumThreads Maximum number of tasks running at the same time
+      Scheduler(int iNumThreads);
+
+      //! Add a task to be run
+      //! @param iTask Function to run
+      //! @param iDependencies Indices of previously added tasks that must finish first
+      //! @return Index of the task
+      int addTask(std::function<void()> iTask, const std::vector<int>& iDependencies=std::vector<int>());
+
+      //! Run all tasks and wait for them to finish. If a task throws an exception, no more tasks
+      //! are started, and the exception is rethrown when the running tasks have finished.
+      void run();
+
+      int getNumThreads() const;
+      int getNumTasks() const;
+   private:
+      //! Start ready tasks until there are none left
+      void work();
+      //! Index of the first task that is ready to start, or -1 if there are none
+      int getReadyTask() const;
+      int mNumThreads;
+      std::vector<std::function<void()> > mTasks;
+      //! Tasks that depend on each task
+      std::vector<std::vector<int> > mDependents;
+      //! Number of unfinished tasks that each task depends on
+      std::vector<int> mNumWaiting;
+      std::vector<bool> mStarted;
+      int mNumStarted;
+      std::exception_ptr mException;
+      std::mutex mMutex;
+      std::condition_variable mCondition;
+};
+#endif
@@ -1,4 +1,5 @@
 #include "Setup.h"
+#include <set>
 #include "File/File.h"
 #include "Calibrator/Calibrator.h"
 #include "Downscaler/Downscaler.h"
@@ -775,6 +776,37 @@ std::string Setup::defaultDownscaler() {
    return "nearestNeighbour";
 }
 
+std::vector<std::vector<int> > Setup::getVariableDependencies(int iFile) const {
+   int numVariables = variableConfigurations.size();
+   bool sameFile = inputFiles[iFile] == outputFiles[iFile];
+
+   // Names of variables that each configuration reads from the output file, and whether it
+   // changes state of the file that the other variables use
+   std::vector<std::set<std::string> > reads(numVariables);
+   std::vector<bool> modifiesFile(numVariables, false);
+   for(int v = 0; v < numVariables; v++) {
+      const VariableConfiguration& varconf = variableConfigurations[v];
+      for(int c = 0; c < varconf.calibrators.size(); c++) {
+         std::vector<std::string> names = varconf.calibrators[c]->getDependencies();
+         reads[v].insert(names.begin(), names.end());
+         if(varconf.calibrators[c]->modifiesFile())
+            modifiesFile[v] = true;
+      }
+   }
+
+   std::vector<std::vector<int> > dependencies(numVariables);
+   for(int v = 0; v < numVariables; v++) {
+      std::string name = variableConfigurations[v].outputVariable.name();
+      for(int i = 0; i < v; i++) {
+         std::string otherName = variableConfigurations[i].outputVariable.name();
+         if(sameFile || modifiesFile[v] || modifiesFile[i] || name == otherName || reads[v].count(otherName) > 0 || reads[i].count(name) > 0) {
+            dependencies[v].push_back(i);
+         }
+      }
+   }
+   return dependencies;
+}
+
 bool Setup::hasFile(std::string iFilename) const {
    std::map<std::string, File*>::const_iterator it = mFileMap.find(iFilename);
    return it != mFileMap.end();
@@ -40,6 +40,13 @@ class Setup {
       Setup(const std::vector<std::string>& argv);
       ~Setup();
       static std::string defaultDownscaler();
+      //! Which variable configurations must be processed before each variable configuration, when
+      //! the variables are post-processed concurrently for file iFile. A configuration depends on an
+      //! earlier one if they write to the same output variable, or if one of them reads the output
+      //! of the other. If the input and output file are the same, all configurations are processed
+      //! in order.
+      //! @return One vector of indices into variableConfigurations for each configuration
+      std::vector<std::vector<int> > getVariableDependencies(int iFile) const;
       std::map<std::string, Variable> variableAliases;
    private:
       // In some cases, it is not possible to open the same file first as readonly and then writeable
@@ -0,0 +1,94 @@
+#include "../AsyncQueue.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <atomic>
+
+namespace {
+   class AsyncQueueTest : public ::testing::Test {
+      protected:
+   };
+
+   TEST_F(AsyncQueueTest, default) {
+      AsyncQueue queue(3);
+      EXPECT_EQ(3, queue.getMaxSize());
+      EXPECT_EQ(0, queue.size());
+      // No tasks
+      queue.wait();
+   }
+   TEST_F(AsyncQueueTest, order) {
+      // Tasks are run in the order they are added
+      AsyncQueue queue(2);
+      std::vector<int> order;
+      for(int i = 0; i < 20; i++) {
+         queue.push([&order, i]() { order.push_back(i); });
+      }
+      queue.wait();
+      ASSERT_EQ(20, order.size());
+      for(int i = 0; i < 20; i++) {
+         EXPECT_EQ(i, order[i]);
+      }
+   }
+   TEST_F(AsyncQueueTest, full) {
+      AsyncQueue queue(1);
+      std::atomic<bool> release(false);
+      std::atomic<bool> started(false);
+      std::atomic<int> count(0);
+      // Block the queue with a running task
+      queue.push([&]() {
+         started = true;
+         while(!release)
+            std::this_thread::yield();
+      });
+      while(!started)
+         std::this_thread::yield();
+      EXPECT_TRUE(queue.tryPush([&count]() { count++; }));
+      EXPECT_EQ(1, queue.size());
+      EXPECT_FALSE(queue.tryPush([&count]() { count++; }));
+      release = true;
+      queue.wait();
+      EXPECT_EQ(1, count);
+      EXPECT_EQ(0, queue.size());
+   }
+   TEST_F(AsyncQueueTest, clear) {
+      AsyncQueue queue(5);
+      std::atomic<bool> release(false);
+      std::atomic<bool> started(false);
+      std::atomic<int> count(0);
+      queue.push([&]() {
+         started = true;
+         while(!release)
+            std::this_thread::yield();
+      });
+      while(!started)
+         std::this_thread::yield();
+      for(int i = 0; i < 3; i++) {
+         queue.push([&count]() { count++; });
+      }
+      EXPECT_EQ(3, queue.size());
+      queue.clear();
+      EXPECT_EQ(0, queue.size());
+      release = true;
+      queue.wait();
+      EXPECT_EQ(0, count);
+   }
+   TEST_F(AsyncQueueTest, exception) {
+      // The exception is rethrown by wait, and later tasks still run
+      AsyncQueue queue(2);
+      std::atomic<int> count(0);
+      queue.push([]() { throw std::runtime_error("test"); });
+      queue.push([&count]() { count++; });
+      EXPECT_THROW(queue.wait(), std::runtime_error);
+      EXPECT_EQ(1, count);
+      queue.wait();
+   }
+   TEST_F(AsyncQueueTest, invalid) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(AsyncQueue(0), ".*");
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
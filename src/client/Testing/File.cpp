@@ -1,9 +1,36 @@
 #include "../File/Netcdf.h"
 #include "../Util.h"
 #include "../Downscaler/Downscaler.h"
+#include "../Calibrator/Calibrator.h"
+#include "../Setup.h"
 #include <gtest/gtest.h>
 
 namespace {
+   // Post-process the variables like the driver does, either writing each variable when it is
+   // finished, or writing all variables at the end
+   void postProcess(std::string iCommand, bool iWriteEach) {
+      Setup setup(Util::split(iCommand));
+      File& input = *setup.inputFiles[0];
+      File& output = *setup.outputFiles[0];
+      std::vector<Variable> variables;
+      for(int v = 0; v < setup.variableConfigurations.size(); v++) {
+         variables.push_back(setup.variableConfigurations[v].outputVariable);
+         output.initNewVariable(setup.variableConfigurations[v].outputVariable);
+      }
+      if(iWriteEach)
+         output.startWrite(variables);
+      for(int v = 0; v < setup.variableConfigurations.size(); v++) {
+         const VariableConfiguration& varconf = setup.variableConfigurations[v];
+         varconf.downscaler->downscale(input, output);
+         for(int c = 0; c < varconf.calibrators.size(); c++) {
+            varconf.calibrators[c]->calibrate(output, varconf.parameterFileCalibrators[c]);
+         }
+         if(iWriteEach)
+            output.writeVariable(varconf.outputVariable);
+      }
+      output.write(variables);
+   }
+
    class FileTest : public ::testing::Test {
       protected:
          virtual void SetUp() {
@@ -148,6 +175,199 @@ namespace {
       ASSERT_TRUE(f);
       EXPECT_EQ("norcom", f->name());
    }
+   TEST_F(FileTest, readAhead) {
+      // Reading ahead gives the same fields
+      FileNetcdf f1("tests/files/10x10.nc");
+      FileNetcdf f2("tests/files/10x10.nc");
+      f1.setReadAhead(true);
+      EXPECT_TRUE(f1.getReadAhead());
+      EXPECT_FALSE(f2.getReadAhead());
+      for(int t = 0; t < f1.getNumTime(); t++) {
+         FieldPtr p1 = f1.getField(mVariable, t);
+         FieldPtr p2 = f2.getField(mVariable, t);
+         EXPECT_EQ(*p2, *p1);
+      }
+      // Variables that are not in the file
+      Variable variable("test");
+      FieldPtr field = f1.getField(variable, 0);
+      EXPECT_FLOAT_EQ(Util::MV, (*field)(0,0,0));
+   }
+   TEST_F(FileTest, writeVariable) {
+      Variable var1("test_write1");
+      Variable var2("test_write2");
+      std::vector<Variable> variables;
+      variables.push_back(var1);
+      variables.push_back(var2);
+      {
+         FileNetcdf file("tests/files/10x10_copy.nc");
+         file.initNewVariable(var1);
+         file.initNewVariable(var2);
+         file.startWrite(variables);
+         for(int t = 0; t < file.getNumTime(); t++) {
+            (*file.getField(var1, t))(1,2,0) = t;
+            (*file.getField(var2, t))(1,2,0) = -t;
+         }
+         file.writeVariable(var1);
+         // var2 is written by write
+         file.write(variables);
+      }
+      FileNetcdf file("tests/files/10x10_copy.nc");
+      for(int t = 0; t < file.getNumTime(); t++) {
+         EXPECT_FLOAT_EQ(t, (*file.getField(var1, t))(1,2,0));
+         EXPECT_FLOAT_EQ(-t, (*file.getField(var2, t))(1,2,0));
+         EXPECT_FLOAT_EQ(Util::MV, (*file.getField(var1, t))(0,0,0));
+      }
+   }
+   TEST_F(FileTest, writeVariableNotSupported) {
+      // Files that cannot write one variable at a time write all variables at the end
+      FileFake file(Options("nLat=3 nLon=3 nEns=1 nTime=3"));
+      Variable variable("test");
+      std::vector<Variable> variables(1, variable);
+      file.initNewVariable(variable);
+      file.startWrite(variables);
+      file.writeVariable(variable);
+      file.write(variables);
+   }
+   TEST_F(FileTest, writeVariableAltitude) {
+      // The altitude calibrator changes the altitudes after the variables have been defined. The
+      // new altitudes must be written, just like when all variables are written at the end.
+      std::string command = "tests/files/10x10.nc tests/files/10x10_copy.nc -v air_temperature_2m -c altitude -p tests/files/10x10_param_zero_altitude.nc type=netcdf -v precipitation_amount";
+      vec2 origElevs = FileNetcdf("tests/files/10x10_copy.nc").getElevs();
+      std::vector<Variable> variables;
+      variables.push_back(Variable("air_temperature_2m"));
+      variables.push_back(Variable("precipitation_amount"));
+
+      postProcess(command, true);
+      FileNetcdf* file = new FileNetcdf("tests/files/10x10_copy.nc");
+      vec2 elevs = file->getElevs();
+      std::vector<std::vector<FieldPtr> > fields(variables.size());
+      for(int v = 0; v < variables.size(); v++) {
+         for(int t = 0; t < file->getNumTime(); t++) {
+            fields[v].push_back(file->getField(variables[v], t));
+         }
+      }
+      delete file;
+
+      postProcess(command, false);
+      file = new FileNetcdf("tests/files/10x10_copy.nc");
+      EXPECT_FLOAT_EQ(0, elevs[5][5]);
+      EXPECT_EQ(file->getElevs(), elevs);
+      for(int v = 0; v < variables.size(); v++) {
+         for(int t = 0; t < file->getNumTime(); t++) {
+            EXPECT_EQ(*fields[v][t], *file->getField(variables[v], t));
+         }
+      }
+
+      // Restore the altitudes for other tests
+      file->setElevs(origElevs);
+      file->write(std::vector<Variable>());
+      delete file;
+   }
+   TEST_F(FileTest, cacheLimit) {
+      // Fields are read again after they are removed from the cache
+      FileNetcdf f1("tests/files/10x10.nc", Options(), true);
+      FileNetcdf f2("tests/files/10x10.nc", Options(), true);
+      long fieldSize = f1.getNumY() * f1.getNumX() * f1.getNumEns() * sizeof(float);
+      f1.setCacheLimit(fieldSize);
+      EXPECT_EQ(fieldSize, f1.getCacheLimit());
+      for(int i = 0; i < 2; i++) {
+         for(int t = 0; t < f1.getNumTime(); t++) {
+            FieldPtr p1 = f1.getField(mVariable, t);
+            FieldPtr p2 = f2.getField(mVariable, t);
+            EXPECT_EQ(*p2, *p1);
+            f1.trimCache();
+            f2.trimCache();
+            EXPECT_LE(f1.getCacheSize(), fieldSize);
+         }
+      }
+      EXPECT_GT(f1.getNumCacheEvictions(), 0);
+      EXPECT_EQ(0, f2.getNumCacheEvictions());
+      EXPECT_EQ(2 * f1.getNumTime(), f1.getNumCacheMisses());
+      EXPECT_EQ(f2.getNumTime(), f2.getNumCacheMisses());
+      EXPECT_EQ(f2.getNumTime(), f2.getNumCacheHits());
+   }
+   TEST_F(FileTest, cacheLimitKeepsFields) {
+      // Fields that cannot be read again are kept when spilling is disabled
+      FileNetcdf file("tests/files/10x10.nc", Options(), true);
+      file.setCacheLimit(0);
+      Variable variable("test");
+      for(int t = 0; t < file.getNumTime(); t++) {
+         FieldPtr field = file.getEmptyField(t);
+         file.addField(field, variable, t);
+      }
+      file.trimCache();
+      EXPECT_EQ(0, file.getNumCacheEvictions());
+      for(int t = 0; t < file.getNumTime(); t++) {
+         EXPECT_FLOAT_EQ(t, (*file.getField(variable, t))(0,0,0));
+      }
+   }
+   TEST_F(FileTest, cacheSpill) {
+      // Spilled fields are restored with the same values
+      FileFake file(Options("nLat=3 nLon=2 nEns=2 nTime=3 cacheSize=0 spill=1"));
+      EXPECT_EQ(0, file.getCacheLimit());
+      EXPECT_TRUE(file.getSpill());
+      Variable variable("test");
+      for(int t = 0; t < file.getNumTime(); t++) {
+         FieldPtr field = file.getEmptyField();
+         for(int y = 0; y < file.getNumY(); y++) {
+            for(int x = 0; x < file.getNumX(); x++) {
+               for(int e = 0; e < file.getNumEns(); e++) {
+                  (*field)(y, x, e) = t * 100 + y * 10 + x + e * 0.5;
+               }
+            }
+         }
+         file.addField(field, variable, t);
+      }
+      file.trimCache();
+      EXPECT_EQ(file.getNumTime(), file.getNumCacheEvictions());
+      EXPECT_EQ(0, file.getCacheSize());
+      for(int i = 0; i < 2; i++) {
+         for(int t = 0; t < file.getNumTime(); t++) {
+            FieldPtr field = file.getField(variable, t);
+            for(int y = 0; y < file.getNumY(); y++) {
+               for(int x = 0; x < file.getNumX(); x++) {
+                  for(int e = 0; e < file.getNumEns(); e++) {
+                     EXPECT_FLOAT_EQ(t * 100 + y * 10 + x + e * 0.5, (*field)(y, x, e));
+                  }
+               }
+            }
+            file.trimCache();
+         }
+      }
+      // Clearing the cache also removes spilled fields
+      file.clear();
+      EXPECT_EQ(0, file.getCacheSize());
+   }
+   TEST_F(FileTest, cachePinned) {
+      // Pinned variables are not removed from the cache
+      FileNetcdf file("tests/files/10x10.nc", Options(), true);
+      file.setCacheLimit(0);
+      file.setPinned(mVariable);
+      EXPECT_TRUE(file.isPinned(mVariable));
+      for(int t = 0; t < file.getNumTime(); t++) {
+         file.getField(mVariable, t);
+      }
+      file.trimCache();
+      EXPECT_EQ(0, file.getNumCacheEvictions());
+      EXPECT_GT(file.getCacheSize(), 0);
+
+      // Variables in use are also kept
+      file.setPinned(mVariable, false);
+      EXPECT_FALSE(file.isPinned(mVariable));
+      std::set<std::string> inUse;
+      inUse.insert(mVariable.name());
+      file.trimCache(inUse);
+      EXPECT_EQ(0, file.getNumCacheEvictions());
+
+      file.trimCache();
+      EXPECT_EQ(0, file.getCacheSize());
+      EXPECT_GT(file.getNumCacheEvictions(), 0);
+   }
+   TEST_F(FileTest, cacheSizeInvalid) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(FileFake(Options("nLat=3 nLon=3 nEns=1 nTime=3 cacheSize=-1")), ".*");
+   }
    /* TODO: Not implemented
    TEST_F(FileTest, deaccumulate) {
       // Create accumulation field
@@ -1,6 +1,7 @@
 #include "../File/Netcdf.h"
 #include "../Util.h"
 #include "../Calibrator/Calibrator.h"
+#include <netcdf.h>
 #include <gtest/gtest.h>
 
 // For each test it is safe to assume that 10x10_copy.nc is identical to 10x10.nc
@@ -18,6 +19,31 @@ namespace {
              reset10x10();
          }
          Variable mVariable;
+         //! Create a NetCDF-4 file with 3 times, 2 members, 3 y-points, and 4 x-points
+         void createNetcdf4(std::string iFilename, int iMode=NC_NETCDF4) const {
+            int file, dTime, dEns, dY, dX, vLat, vLon, vTime;
+            ASSERT_EQ(NC_NOERR, nc_create(iFilename.c_str(), iMode | NC_CLOBBER, &file));
+            nc_def_dim(file, "time", 3, &dTime);
+            nc_def_dim(file, "ensemble_member", 2, &dEns);
+            nc_def_dim(file, "y", 3, &dY);
+            nc_def_dim(file, "x", 4, &dX);
+            int dims[2] = {dY, dX};
+            nc_def_var(file, "latitude", NC_FLOAT, 2, dims, &vLat);
+            nc_def_var(file, "longitude", NC_FLOAT, 2, dims, &vLon);
+            nc_def_var(file, "time", NC_DOUBLE, 1, &dTime, &vTime);
+            nc_enddef(file);
+            float lats[12];
+            float lons[12];
+            for(int i = 0; i < 12; i++) {
+               lats[i] = 60 + i / 4;
+               lons[i] = 10 + i % 4;
+            }
+            double times[3] = {1414130400, 1414134000, 1414137600};
+            nc_put_var_float(file, vLat, lats);
+            nc_put_var_float(file, vLon, lons);
+            nc_put_var_double(file, vTime, times);
+            ASSERT_EQ(NC_NOERR, nc_close(file));
+         }
    };
 
    TEST_F(FileNetcdfTest, isValid) {
@@ -123,6 +149,36 @@ namespace {
       EXPECT_FLOAT_EQ(Util::MV, (*field)(0, 0, 1));
    }
 
+   TEST_F(FileNetcdfTest, scaleAndOffset) {
+      // Test that packed values are unpacked
+      {
+         int file, var;
+         ASSERT_EQ(NC_NOERR, nc_open("tests/files/10x10_copy.nc", NC_WRITE, &file));
+         ASSERT_EQ(NC_NOERR, nc_inq_varid(file, "air_temperature_2m", &var));
+         ASSERT_EQ(NC_NOERR, nc_redef(file));
+         float scale = 0.5;
+         float offset = 10;
+         ASSERT_EQ(NC_NOERR, nc_put_att_float(file, var, "scale_factor", NC_FLOAT, 1, &scale));
+         ASSERT_EQ(NC_NOERR, nc_put_att_float(file, var, "add_offset", NC_FLOAT, 1, &offset));
+         ASSERT_EQ(NC_NOERR, nc_close(file));
+      }
+      FileNetcdf packed("tests/files/10x10_copy.nc");
+      FileNetcdf raw("tests/files/10x10.nc");
+      for(int t = 0; t < raw.getNumTime(); t++) {
+         FieldPtr field = packed.getField(mVariable, t);
+         FieldPtr rawField = raw.getField(mVariable, t);
+         for(int y = 0; y < raw.getNumY(); y++) {
+            for(int x = 0; x < raw.getNumX(); x++) {
+               float value = (*rawField)(y, x, 0);
+               if(Util::isValid(value))
+                  EXPECT_FLOAT_EQ(0.5 * value + 10, (*field)(y, x, 0));
+               else
+                  EXPECT_FLOAT_EQ(Util::MV, (*field)(y, x, 0));
+            }
+         }
+      }
+   }
+
    TEST_F(FileNetcdfTest, scalarTime) {
       // Test that an analysis file can use a time variable without a dimension
       FileNetcdf file = FileNetcdf("tests/files/validNetcdfAnalysis2.nc");
@@ -241,6 +297,118 @@ namespace {
       Util::setShowError(false);
       EXPECT_DEATH(FileNetcdf("tests/files/validText1.nc"), ".*");
    }
+   TEST_F(FileNetcdfTest, compression) {
+      // Test that chunking, compression, and quantization are applied to new variables
+      std::string filename = "tests/files/netcdf4.nc";
+      createNetcdf4(filename);
+      Variable var("test");
+      {
+         FileNetcdf file(filename, Options("chunks=1,1,0,0 deflate=4 shuffle=1 significantDigits=3 timesPerWrite=2"));
+         file.initNewVariable(var);
+         for(int t = 0; t < file.getNumTime(); t++) {
+            FieldPtr field = file.getEmptyField();
+            for(int y = 0; y < file.getNumY(); y++) {
+               for(int x = 0; x < file.getNumX(); x++) {
+                  for(int e = 0; e < file.getNumEns(); e++) {
+                     (*field)(y, x, e) = 1000 * t + 100 * y + 10 * x + e + 0.123;
+                  }
+               }
+            }
+            (*field)(1, 2, 1) = Util::MV;
+            file.addField(field, var, t);
+         }
+         file.write(std::vector<Variable>(1, var));
+      }
+
+      int file, id;
+      ASSERT_EQ(NC_NOERR, nc_open(filename.c_str(), NC_NOWRITE, &file));
+      ASSERT_EQ(NC_NOERR, nc_inq_varid(file, "test", &id));
+      int storage, shuffle, deflate, level;
+      size_t chunks[4];
+      nc_inq_var_chunking(file, id, &storage, chunks);
+      EXPECT_EQ(NC_CHUNKED, storage);
+      EXPECT_EQ(1, chunks[0]);
+      EXPECT_EQ(1, chunks[1]);
+      EXPECT_EQ(3, chunks[2]);
+      EXPECT_EQ(4, chunks[3]);
+      nc_inq_var_deflate(file, id, &shuffle, &deflate, &level);
+      EXPECT_EQ(1, shuffle);
+      EXPECT_EQ(1, deflate);
+      EXPECT_EQ(4, level);
+#ifdef NC_QUANTIZE_BITGROOM
+      int quantize, digits;
+      nc_inq_var_quantize(file, id, &quantize, &digits);
+      EXPECT_EQ(NC_QUANTIZE_BITGROOM, quantize);
+      EXPECT_EQ(3, digits);
+#endif
+      nc_close(file);
+
+      // Values are written in the right place, with 3 significant digits
+      FileNetcdf output(filename);
+      for(int t = 0; t < output.getNumTime(); t++) {
+         FieldPtr field = output.getField(var, t);
+         for(int y = 0; y < output.getNumY(); y++) {
+            for(int x = 0; x < output.getNumX(); x++) {
+               for(int e = 0; e < output.getNumEns(); e++) {
+                  float expected = 1000 * t + 100 * y + 10 * x + e + 0.123;
+                  if(y == 1 && x == 2 && e == 1)
+                     EXPECT_FLOAT_EQ(Util::MV, (*field)(y, x, e));
+                  else
+                     EXPECT_NEAR(expected, (*field)(y, x, e), 0.01 * expected);
+               }
+            }
+         }
+      }
+      std::remove(filename.c_str());
+   }
+   TEST_F(FileNetcdfTest, compressionClassic) {
+      // NetCDF-4 files with the classic data model also support compression
+      std::string filename = "tests/files/netcdf4.nc";
+      createNetcdf4(filename, NC_NETCDF4 | NC_CLASSIC_MODEL);
+      Variable var("test");
+      {
+         FileNetcdf file(filename, Options("deflate=4"));
+         file.initNewVariable(var);
+         file.write(std::vector<Variable>(1, var));
+      }
+
+      int file, id, shuffle, deflate, level;
+      ASSERT_EQ(NC_NOERR, nc_open(filename.c_str(), NC_NOWRITE, &file));
+      ASSERT_EQ(NC_NOERR, nc_inq_varid(file, "test", &id));
+      nc_inq_var_deflate(file, id, &shuffle, &deflate, &level);
+      EXPECT_EQ(1, deflate);
+      EXPECT_EQ(4, level);
+      nc_close(file);
+      std::remove(filename.c_str());
+   }
+   TEST_F(FileNetcdfTest, timesPerWrite) {
+      // Test that writing several time steps at a time gives the same file. Compression is not
+      // available for this file.
+      Variable var("test");
+      {
+         FileNetcdf file("tests/files/10x10_copy.nc", Options("timesPerWrite=3 deflate=1"));
+         file.initNewVariable(var);
+         for(int t = 0; t < file.getNumTime(); t++) {
+            file.addField(file.getEmptyField(t + 1), var, t);
+         }
+         file.write(std::vector<Variable>(1, var));
+      }
+
+      FileNetcdf output("tests/files/10x10_copy.nc");
+      for(int t = 0; t < output.getNumTime(); t++) {
+         FieldPtr field = output.getField(var, t);
+         EXPECT_FLOAT_EQ(t + 1, (*field)(0, 0, 0));
+         EXPECT_FLOAT_EQ(t + 1, (*field)(9, 9, 0));
+      }
+   }
+   TEST_F(FileNetcdfTest, invalidCompression) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(FileNetcdf("tests/files/10x10_copy.nc", Options("deflate=10")), ".*");
+      EXPECT_DEATH(FileNetcdf("tests/files/10x10_copy.nc", Options("chunks=1,1")), ".*");
+      EXPECT_DEATH(FileNetcdf("tests/files/10x10_copy.nc", Options("significantDigits=0")), ".*");
+      EXPECT_DEATH(FileNetcdf("tests/files/10x10_copy.nc", Options("timesPerWrite=0")), ".*");
+   }
    TEST_F(FileNetcdfTest, createNewVariable) {
       FileNetcdf file("tests/files/10x10_copy.nc");
       std::vector<Variable> vars;
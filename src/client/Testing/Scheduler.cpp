@@ -0,0 +1,96 @@
+#include "../Scheduler.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <atomic>
+
+namespace {
+   class SchedulerTest : public ::testing::Test {
+      protected:
+   };
+
+   TEST_F(SchedulerTest, default) {
+      Scheduler scheduler(3);
+      EXPECT_EQ(3, scheduler.getNumThreads());
+      EXPECT_EQ(0, scheduler.getNumTasks());
+      // No tasks
+      scheduler.run();
+   }
+   TEST_F(SchedulerTest, singleThread) {
+      // Tasks are run in the order they are added
+      Scheduler scheduler(1);
+      std::vector<int> order;
+      for(int i = 0; i < 5; i++) {
+         EXPECT_EQ(i, scheduler.addTask([&order, i]() { order.push_back(i); }));
+      }
+      EXPECT_EQ(5, scheduler.getNumTasks());
+      scheduler.run();
+      ASSERT_EQ(5, order.size());
+      for(int i = 0; i < 5; i++) {
+         EXPECT_EQ(i, order[i]);
+      }
+   }
+   TEST_F(SchedulerTest, allTasksRun) {
+      Scheduler scheduler(4);
+      std::atomic<int> count(0);
+      for(int i = 0; i < 100; i++) {
+         scheduler.addTask([&count]() { count++; });
+      }
+      scheduler.run();
+      EXPECT_EQ(100, count);
+   }
+   TEST_F(SchedulerTest, dependencies) {
+      // Each task must start after the tasks it depends on have finished
+      Scheduler scheduler(4);
+      int N = 50;
+      std::vector<std::atomic<bool> > finished(N);
+      std::vector<std::atomic<bool> > ok(N);
+      for(int i = 0; i < N; i++) {
+         finished[i] = false;
+         ok[i] = false;
+      }
+      for(int i = 0; i < N; i++) {
+         std::vector<int> dependencies;
+         if(i % 5 != 0)
+            dependencies.push_back(i - 1);
+         if(i >= 10)
+            dependencies.push_back(i - 10);
+         scheduler.addTask([&finished, &ok, dependencies, i]() {
+            bool valid = true;
+            for(int d = 0; d < dependencies.size(); d++) {
+               valid = valid && finished[dependencies[d]];
+            }
+            ok[i] = valid;
+            finished[i] = true;
+         }, dependencies);
+      }
+      scheduler.run();
+      for(int i = 0; i < N; i++) {
+         EXPECT_TRUE(finished[i]);
+         EXPECT_TRUE(ok[i]);
+      }
+   }
+   TEST_F(SchedulerTest, exception) {
+      // Remaining tasks are not started after a task has failed
+      Scheduler scheduler(2);
+      std::atomic<int> count(0);
+      scheduler.addTask([]() { throw std::runtime_error("test"); });
+      scheduler.addTask([&count]() { count++; }, std::vector<int>(1, 0));
+      scheduler.addTask([&count]() { count++; }, std::vector<int>(1, 1));
+      EXPECT_THROW(scheduler.run(), std::runtime_error);
+      EXPECT_EQ(0, count);
+   }
+   TEST_F(SchedulerTest, invalid) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(Scheduler(0), ".*");
+      Scheduler scheduler(2);
+      scheduler.addTask([]() {});
+      EXPECT_DEATH(scheduler.addTask([]() {}, std::vector<int>(1, 1)), ".*");
+      EXPECT_DEATH(scheduler.addTask([]() {}, std::vector<int>(1, -1)), ".*");
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
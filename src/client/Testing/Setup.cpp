@@ -350,6 +350,51 @@ namespace {
       EXPECT_FALSE(setup0.outputOptions.getValue("write", i));
       EXPECT_EQ(2, i);
    }
+   TEST_F(SetupTest, variableDependencies) {
+      // Phase reads the first two variables, and the last variable is independent of the others
+      MetSetup setup(Util::split("tests/files/10x10.nc tests/files/10x10_copy.nc -v air_temperature_2m -v precipitation_amount -v phase -d bypass -c phase temperature=air_temperature_2m precipitation=precipitation_amount -v cloud_area_fraction"));
+      std::vector<std::vector<int> > dependencies = setup.getVariableDependencies(0);
+      ASSERT_EQ(4, dependencies.size());
+      EXPECT_EQ(0, dependencies[0].size());
+      EXPECT_EQ(0, dependencies[1].size());
+      ASSERT_EQ(2, dependencies[2].size());
+      EXPECT_EQ(0, dependencies[2][0]);
+      EXPECT_EQ(1, dependencies[2][1]);
+      EXPECT_EQ(0, dependencies[3].size());
+   }
+   TEST_F(SetupTest, variableDependenciesRegression) {
+      // Multivariate regression reads the variables listed in 'variables', except the constant term
+      MetSetup setup(Util::split("tests/files/10x10.nc tests/files/10x10_copy.nc -v air_temperature_2m -v precipitation_amount -v cloud_area_fraction -d bypass -c regression variables=1,precipitation_amount"));
+      std::vector<std::vector<int> > dependencies = setup.getVariableDependencies(0);
+      ASSERT_EQ(3, dependencies.size());
+      EXPECT_EQ(0, dependencies[0].size());
+      EXPECT_EQ(0, dependencies[1].size());
+      ASSERT_EQ(1, dependencies[2].size());
+      EXPECT_EQ(1, dependencies[2][0]);
+   }
+   TEST_F(SetupTest, variableDependenciesSameFile) {
+      // All variables are processed in order when the input file is also the output file
+      MetSetup setup(Util::split("tests/files/10x10.nc tests/files/10x10.nc -v air_temperature_2m -v precipitation_amount -v cloud_area_fraction"));
+      std::vector<std::vector<int> > dependencies = setup.getVariableDependencies(0);
+      ASSERT_EQ(3, dependencies.size());
+      EXPECT_EQ(0, dependencies[0].size());
+      EXPECT_EQ(1, dependencies[1].size());
+      EXPECT_EQ(2, dependencies[2].size());
+   }
+   TEST_F(SetupTest, variableDependenciesModifiesFile) {
+      // Altitude changes the altitudes of the output file, which all variables use. It is therefore
+      // processed after all earlier variables and before all later ones.
+      MetSetup setup(Util::split("tests/files/10x10.nc tests/files/10x10_copy.nc -v air_temperature_2m -v precipitation_amount -c altitude -p tests/files/10x10_param_zero_altitude.nc type=netcdf -v cloud_area_fraction -v x_wind_10m"));
+      std::vector<std::vector<int> > dependencies = setup.getVariableDependencies(0);
+      ASSERT_EQ(4, dependencies.size());
+      EXPECT_EQ(0, dependencies[0].size());
+      ASSERT_EQ(1, dependencies[1].size());
+      EXPECT_EQ(0, dependencies[1][0]);
+      ASSERT_EQ(1, dependencies[2].size());
+      EXPECT_EQ(1, dependencies[2][0]);
+      ASSERT_EQ(1, dependencies[3].size());
+      EXPECT_EQ(1, dependencies[3][0]);
+   }
    TEST_F(SetupTest, alias) {
       MetSetup setup(Util::split("tests/files/10x10.nc tests/files/10x10_copy.nc -va tlevel1 name=air_temperature_2m level=1 -v air_temperature_2m -d smart numSmart=2"));
       ASSERT_EQ(1, setup.variableAliases.size());
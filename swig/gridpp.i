@@ -47,14 +47,28 @@
 %apply std::vector<float>& OUTPUT { std::vector<float>& standard_error };
 %apply std::vector<float>& OUTPUT { std::vector<float>& analysis_variance };
 %apply std::vector<float>& OUTPUT { std::vector<float>& output_fcst };
+%apply std::vector<float>& OUTPUT { std::vector<float>& output };
 %apply std::vector<std::vector<float> >& OUTPUT { std::vector<std::vector<float> >& analysis_variance };
 %apply std::vector<std::vector<float> >& OUTPUT { std::vector<std::vector<float> >& distances };
+%apply std::vector<int>& OUTPUT { std::vector<int>& output };
+%apply std::vector<int>& OUTPUT { std::vector<int>& offsets };
+%apply std::vector<int>& OUTPUT { std::vector<int>& indices };
+%apply std::vector<int>& OUTPUT { std::vector<int>& y_indices };
+%apply std::vector<int>& OUTPUT { std::vector<int>& x_indices };
 %apply int& OUTPUT { int& X1_out };
 %apply int& OUTPUT { int& Y1_out };
 %apply int& OUTPUT { int& X2_out };
 %apply int& OUTPUT { int& Y2_out };
 %apply std::vector<std::vector<std::vector<float> > >& OUTPUT { std::vector<std::vector<std::vector<float> > >& output };
 
+/* Views and fields are converted to and from numpy arrays by the typemaps in vector.i */
+%ignore gridpp::View2;
+%ignore gridpp::View3;
+%ignore gridpp::Field2D;
+%ignore gridpp::Field3D;
+/* Python callers get a new array anyway, so only expose the version of window that returns it */
+%ignore gridpp::window(const std::vector<std::vector<float> >&, int, gridpp::Statistic, std::vector<std::vector<float> >&, bool, bool, bool);
+
 %{
 #include "gridpp.h"
 %}
@@ -12,6 +12,105 @@
 %}
 #if defined(SWIGPYTHON)
 %include "numpy.i"
+%{
+#include <cstring>
+
+/* Frees a vector that is owned by a numpy array */
+template<class T> void gridpp_delete_vector_capsule(PyObject* capsule) {
+    delete (std::vector<T>*) PyCapsule_GetPointer(capsule, NULL);
+}
+
+/* Creates a numpy array with dimensions dims that takes over the buffer of input, without copying
+ * the values. input is empty afterwards. */
+template<class T> PyObject* gridpp_vector_to_array(std::vector<T>& input, int num_dims, npy_intp* dims, int npy_type) {
+    if(input.size() == 0)
+        return PyArray_ZEROS(num_dims, dims, npy_type, 0);
+    std::vector<T>* data = new std::vector<T>();
+    data->swap(input);
+    PyObject* array = PyArray_SimpleNewFromData(num_dims, dims, npy_type, &(*data)[0]);
+    if(array == NULL) {
+        delete data;
+        return NULL;
+    }
+    PyObject* capsule = PyCapsule_New(data, NULL, gridpp_delete_vector_capsule<T>);
+    PyArray_SetBaseObject((PyArrayObject*) array, capsule);
+    return array;
+}
+
+/* Copies a 2D vector into a new numpy array, one row at a time */
+template<class T> PyObject* gridpp_vector2_to_array(const std::vector<std::vector<T> >& input, int npy_type) {
+    npy_intp s0 = input.size();
+    npy_intp s1 = 0;
+    if(s0 != 0)
+        s1 = input[0].size();
+    npy_intp dims[2] = {s0, s1};
+    PyObject* array = PyArray_EMPTY(2, dims, npy_type, 0);
+    if(array == NULL)
+        return NULL;
+    T* data = (T*) PyArray_DATA((PyArrayObject*) array);
+    for(npy_intp i = 0; i < s0; i++) {
+        if((npy_intp) input[i].size() != s1) {
+            Py_DECREF(array);
+            PyErr_SetString(PyExc_RuntimeError, "Cannot convert ragged 2D vector to array");
+            return NULL;
+        }
+        if(s1 > 0)
+            memcpy(data + i * s1, &input[i][0], s1 * sizeof(T));
+    }
+    return array;
+}
+
+/* Copies a 3D vector into a new numpy array, one row at a time */
+template<class T> PyObject* gridpp_vector3_to_array(const std::vector<std::vector<std::vector<T> > >& input, int npy_type) {
+    npy_intp s0 = input.size();
+    npy_intp s1 = 0;
+    if(s0 != 0)
+        s1 = input[0].size();
+    npy_intp s2 = 0;
+    if(s0 != 0 && s1 != 0)
+        s2 = input[0][0].size();
+    npy_intp dims[3] = {s0, s1, s2};
+    PyObject* array = PyArray_EMPTY(3, dims, npy_type, 0);
+    if(array == NULL)
+        return NULL;
+    T* data = (T*) PyArray_DATA((PyArrayObject*) array);
+    for(npy_intp i = 0; i < s0; i++) {
+        bool ragged = (npy_intp) input[i].size() != s1;
+        for(npy_intp j = 0; j < s1 && !ragged; j++) {
+            ragged = (npy_intp) input[i][j].size() != s2;
+            if(!ragged && s2 > 0)
+                memcpy(data + (i * s1 + j) * s2, &input[i][j][0], s2 * sizeof(T));
+        }
+        if(ragged) {
+            Py_DECREF(array);
+            PyErr_SetString(PyExc_RuntimeError, "Cannot convert ragged 3D vector to array");
+            return NULL;
+        }
+    }
+    return array;
+}
+
+/* Returns a float32 array with num_dims dimensions that a view can point into. Aligned float32
+ * arrays in native byte order are returned as they are. Anything else is converted into a new
+ * array, which is stored in py_obj and must be released by the caller. Returns NULL if the input
+ * cannot be converted. */
+static PyObject* gridpp_array_for_view(PyObject* input, int num_dims, PyObject** py_obj) {
+    if(is_array(input) && array_numdims(input) == num_dims && array_type(input) == NPY_FLOAT &&
+            PyArray_ISALIGNED((PyArrayObject*) input) && PyArray_ISNOTSWAPPED((PyArrayObject*) input)) {
+        bool valid_strides = true;
+        for(int i = 0; i < num_dims; i++) {
+            if(array_stride(input, i) % (npy_intp) sizeof(float) != 0)
+                valid_strides = false;
+        }
+        if(valid_strides)
+            return input;
+    }
+    *py_obj = PyArray_FROM_OTF(input, NPY_FLOAT, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST);
+    if(*py_obj == NULL || array_numdims(*py_obj) != num_dims)
+        return NULL;
+    return *py_obj;
+}
+%}
 #endif
 
 %include "std_vector.i"
@@ -137,14 +236,10 @@ namespace std {
 /* Inputs that are moved to outputs must be appended */
 %typemap(argout) std::vector<DTYPE>& OUTPUT (PyObject* py_obj=NULL) {
     PRINT_DEBUG("Typemap(argout) std::vector<DTYPE>& OUTPUT");
-    const std::vector<DTYPE>& temp = *$1;
-    int s = temp.size();
-    npy_intp dims[1] = {s};
-    py_obj = PyArray_ZEROS(1, dims, NPY_DTYPE, 0);
-    for(long i = 0; i < s; i++) {
-        DTYPE* ref = (DTYPE*) PyArray_GETPTR1((PyArrayObject*) py_obj, i);
-        ref[0] = temp[i];
-    }
+    npy_intp dims[1] = {(npy_intp) $1->size()};
+    py_obj = gridpp_vector_to_array<DTYPE>(*$1, 1, dims, NPY_DTYPE);
+    if(py_obj == NULL)
+        SWIG_fail;
     %append_output(py_obj);
 }
 
@@ -171,12 +266,10 @@ namespace std {
 
 %typemap(out) std::vector<DTYPE> {
     PRINT_DEBUG("Typemap(out) std::vector<DTYPE>");
-    npy_intp dims[1] = {$1.size()};
-    $result = PyArray_ZEROS(1, dims, NPY_DTYPE, 0);
-    for(long i = 0; i < $1.size(); i++) {
-        DTYPE* ref = (DTYPE*) PyArray_GETPTR1((PyArrayObject*) $result, i);
-        ref[0] = $1[i];
-    }
+    npy_intp dims[1] = {(npy_intp) $1.size()};
+    $result = gridpp_vector_to_array<DTYPE>($1, 1, dims, NPY_DTYPE);
+    if($result == NULL)
+        SWIG_fail;
 }
 
 %typecheck(SWIG_TYPECHECK_INTEGER) std::vector<DTYPE>, const std::vector<DTYPE> & {
@@ -313,37 +406,17 @@ namespace std {
 /* Inputs that are moved to outputs must be appended */
 %typemap(argout) std::vector<std::vector<DTYPE> >& OUTPUT (PyObject* py_obj=NULL){
     PRINT_DEBUG("Typemap(argout) std::vector<std::vector<DTYPE> >& OUTPUT");
-    const std::vector<std::vector<DTYPE> >& temp = *$1;
-    int s0 = temp.size();
-    int s1 = 0;
-    if(s0 != 0)
-        s1 = temp[0].size();
-    npy_intp dims[2] = {s0, s1};
-    py_obj = PyArray_ZEROS(2, dims, NPY_DTYPE, 0);
-    for(long i = 0; i < s0; i++) {
-        for(long j = 0; j < s1; j++) {
-            DTYPE* ref = (DTYPE*) PyArray_GETPTR2((PyArrayObject*) py_obj, i, j);
-            ref[0] = temp[i][j];
-        }
-    }
+    py_obj = gridpp_vector2_to_array<DTYPE>(*$1, NPY_DTYPE);
+    if(py_obj == NULL)
+        SWIG_fail;
     %append_output(py_obj);
 }
 
 %typemap(out) std::vector<std::vector<DTYPE> > {
     PRINT_DEBUG("Typemap(out) std::vector<std::vector<DTYPE> >");
-    const std::vector<std::vector<DTYPE> >& temp = $1;
-    int s0 = temp.size();
-    int s1 = 0;
-    if(s0 != 0)
-        s1 = temp[0].size();
-    npy_intp dims[2] = {s0, s1};
-    $result = PyArray_ZEROS(2, dims, NPY_DTYPE, 0);
-    for(long i = 0; i < s0; i++) {
-        for(long j = 0; j < s1; j++) {
-            DTYPE* ref = (DTYPE*) PyArray_GETPTR2((PyArrayObject*) $result, i, j);
-            ref[0] = temp[i][j];
-        }
-    }
+    $result = gridpp_vector2_to_array<DTYPE>($1, NPY_DTYPE);
+    if($result == NULL)
+        SWIG_fail;
 }
 
 %typecheck(SWIG_TYPECHECK_INTEGER) std::vector<std::vector<DTYPE> >, const std::vector<std::vector<DTYPE> > & {
@@ -491,47 +564,17 @@ namespace std {
 /* Inputs that are moved to outputs must be appended */
 %typemap(argout) std::vector<std::vector<std::vector<DTYPE> > > OUTPUT (PyObject* py_obj=NULL){
     PRINT_DEBUG("Typemap(argout) std::vector<std::vector<std::vector<DTYPE> > >");
-    const std::vector<std::vector<std::vector<DTYPE> > >& temp = $1;
-    int s0 = temp.size();
-    int s1 = 0;
-    if(s0 != 0)
-        s1 = temp[0].size();
-    int s2 = 0;
-    if(s0 != 0 && s1 != 0)
-        s2 = temp[0][0].size();
-    npy_intp dims[3] = {s0, s1, s2};
-    py_obj = PyArray_ZEROS(3, dims, NPY_DTYPE, 0);
-    for(long i = 0; i < s0; i++) {
-        for(long j = 0; j < s1; j++) {
-            for(long k = 0; k < s2; k++) {
-                DTYPE* ref = (DTYPE*) PyArray_GETPTR3((PyArrayObject*) py_obj, i, j, k);
-                ref[0] = temp[i][j][k];
-            }
-        }
-    }
+    py_obj = gridpp_vector3_to_array<DTYPE>($1, NPY_DTYPE);
+    if(py_obj == NULL)
+        SWIG_fail;
     %append_output(py_obj);
 }
 
 %typemap(out) std::vector<std::vector<std::vector<DTYPE> > > {
     PRINT_DEBUG("Typemap(out) std::vector<std::vector<std::vector<DTYPE> > >");
-    const std::vector<std::vector<std::vector<DTYPE> > >& temp = $1;
-    int s0 = temp.size();
-    int s1 = 0;
-    if(s0 != 0)
-        s1 = temp[0].size();
-    int s2 = 0;
-    if(s0 != 0 && s1 != 0)
-        s2 = temp[0][0].size();
-    npy_intp dims[3] = {s0, s1, s2};
-    $result = PyArray_ZEROS(3, dims, NPY_DTYPE, 0);
-    for(long i = 0; i < s0; i++) {
-        for(long j = 0; j < s1; j++) {
-            for(long k = 0; k < s2; k++) {
-                DTYPE* ref = (DTYPE*) PyArray_GETPTR3((PyArrayObject*) $result, i, j, k);
-                ref[0] = temp[i][j][k];
-            }
-        }
-    }
+    $result = gridpp_vector3_to_array<DTYPE>($1, NPY_DTYPE);
+    if($result == NULL)
+        SWIG_fail;
 }
 
 %typecheck(SWIG_TYPECHECK_INTEGER) std::vector<std::vector<std::vector<DTYPE> > >, const std::vector<std::vector<std::vector<DTYPE> > > & {
@@ -556,4 +599,101 @@ namespace std {
 %np_vector_typemaps(long, NPY_LONG)
 %np_vector_typemaps(float, NPY_FLOAT)
 %np_vector_typemaps(double, NPY_DOUBLE)
+
+/*
+ * Views into numpy arrays. Aligned float32 arrays are passed to C++ without copying, regardless of
+ * their strides. Other arrays are converted to float32 first.
+ */
+%typemap(in) const gridpp::View2& (gridpp::View2 temp, PyObject* py_obj=NULL) {
+    PRINT_DEBUG("Typemap(in) const gridpp::View2&");
+    PyObject* array = gridpp_array_for_view($input, 2, &py_obj);
+    if(array == NULL) {
+        INVALID_DIMENSIONS_ERROR(2, float);
+    }
+    temp = gridpp::View2((const float*) array_data(array), array_size(array, 0), array_size(array, 1),
+            array_stride(array, 0) / (npy_intp) sizeof(float), array_stride(array, 1) / (npy_intp) sizeof(float));
+    $1 = &temp;
+}
+
+%typemap(in) const gridpp::View3& (gridpp::View3 temp, PyObject* py_obj=NULL) {
+    PRINT_DEBUG("Typemap(in) const gridpp::View3&");
+    PyObject* array = gridpp_array_for_view($input, 3, &py_obj);
+    if(array == NULL) {
+        INVALID_DIMENSIONS_ERROR(3, float);
+    }
+    temp = gridpp::View3((const float*) array_data(array), array_size(array, 0), array_size(array, 1),
+            array_size(array, 2), array_stride(array, 0) / (npy_intp) sizeof(float),
+            array_stride(array, 1) / (npy_intp) sizeof(float), array_stride(array, 2) / (npy_intp) sizeof(float));
+    $1 = &temp;
+}
+
+%typemap(freearg) const gridpp::View2&, const gridpp::View3& {
+    Py_XDECREF(py_obj$argnum);
+}
+
+/* Only numpy arrays are accepted as views, other sequences are handled by the std::vector
+ * typemaps. Use a higher precedence than std::vector, so that overloads taking views are preferred
+ * for numpy arrays. */
+%typecheck(SWIG_TYPECHECK_INT128) const gridpp::View2& {
+    $1 = is_array($input) && array_numdims($input) == 2 ? 1 : 0;
+}
+%typecheck(SWIG_TYPECHECK_INT128) const gridpp::View3& {
+    $1 = is_array($input) && array_numdims($input) == 3 ? 1 : 0;
+}
+
+/*
+ * Contiguous fields. Inputs are copied once into the field. Outputs are handed over to numpy
+ * without copying.
+ */
+%typemap(in) const gridpp::Field2D& (gridpp::Field2D temp, PyObject* py_obj=NULL) {
+    PRINT_DEBUG("Typemap(in) const gridpp::Field2D&");
+    PyObject* array = gridpp_array_for_view($input, 2, &py_obj);
+    if(array == NULL) {
+        INVALID_DIMENSIONS_ERROR(2, float);
+    }
+    temp = gridpp::Field2D(gridpp::View2((const float*) array_data(array), array_size(array, 0), array_size(array, 1),
+            array_stride(array, 0) / (npy_intp) sizeof(float), array_stride(array, 1) / (npy_intp) sizeof(float)));
+    $1 = &temp;
+}
+
+%typemap(in) const gridpp::Field3D& (gridpp::Field3D temp, PyObject* py_obj=NULL) {
+    PRINT_DEBUG("Typemap(in) const gridpp::Field3D&");
+    PyObject* array = gridpp_array_for_view($input, 3, &py_obj);
+    if(array == NULL) {
+        INVALID_DIMENSIONS_ERROR(3, float);
+    }
+    temp = gridpp::Field3D(gridpp::View3((const float*) array_data(array), array_size(array, 0), array_size(array, 1),
+            array_size(array, 2), array_stride(array, 0) / (npy_intp) sizeof(float),
+            array_stride(array, 1) / (npy_intp) sizeof(float), array_stride(array, 2) / (npy_intp) sizeof(float)));
+    $1 = &temp;
+}
+
+%typemap(freearg) const gridpp::Field2D&, const gridpp::Field3D& {
+    Py_XDECREF(py_obj$argnum);
+}
+
+%typemap(out) gridpp::Field2D {
+    PRINT_DEBUG("Typemap(out) gridpp::Field2D");
+    gridpp::Field2D& field = $1;
+    npy_intp dims[2] = {field.size_y(), field.size_x()};
+    $result = gridpp_vector_to_array<float>(field.values(), 2, dims, NPY_FLOAT);
+    if($result == NULL)
+        SWIG_fail;
+}
+
+%typemap(out) gridpp::Field3D {
+    PRINT_DEBUG("Typemap(out) gridpp::Field3D");
+    gridpp::Field3D& field = $1;
+    npy_intp dims[3] = {field.size_y(), field.size_x(), field.size_e()};
+    $result = gridpp_vector_to_array<float>(field.values(), 3, dims, NPY_FLOAT);
+    if($result == NULL)
+        SWIG_fail;
+}
+
+%typecheck(SWIG_TYPECHECK_INT128) const gridpp::Field2D& {
+    $1 = is_array($input) && array_numdims($input) == 2 ? 1 : 0;
+}
+%typecheck(SWIG_TYPECHECK_INT128) const gridpp::Field3D& {
+    $1 = is_array($input) && array_numdims($input) == 3 ? 1 : 0;
+}
 #endif
@@ -53,6 +53,46 @@ class Test(unittest.TestCase):
         with self.assertRaises(ValueError) as e:
             gridpp.calc_gradient(base, values, method, halfwidth, min_num, -1, dg)
 
+    def test_minmax(self):
+        """ Check MinMax against a brute force computation, including ties in base """
+        np.random.seed(1000)
+        base = np.round(np.random.rand(15, 20) * 5)
+        base[np.random.rand(15, 20) < 0.1] = np.nan
+        values = np.random.rand(15, 20)
+        values[np.random.rand(15, 20) < 0.1] = np.nan
+        default_gradient = -11
+        for halfwidth in [1, 3, 30]:
+            with self.subTest(halfwidth=halfwidth):
+                expected = default_gradient * np.ones(base.shape)
+                for y in range(15):
+                    for x in range(20):
+                        curr_base = base[max(0, y - halfwidth):y + halfwidth + 1, max(0, x - halfwidth):x + halfwidth + 1].flatten()
+                        curr_values = values[max(0, y - halfwidth):y + halfwidth + 1, max(0, x - halfwidth):x + halfwidth + 1].flatten()
+                        curr_base[np.isnan(curr_values)] = np.nan
+                        if np.sum(~np.isnan(curr_base)) >= 2 and np.nanmax(curr_base) > np.nanmin(curr_base):
+                            Imax = np.nanargmax(curr_base)
+                            Imin = np.nanargmin(curr_base)
+                            expected[y, x] = (curr_values[Imax] - curr_values[Imin]) / (curr_base[Imax] - curr_base[Imin])
+                gradient = gridpp.calc_gradient(base, values, gridpp.MinMax, halfwidth, 2, 0, default_gradient)
+                np.testing.assert_array_almost_equal(gradient, expected)
+
+    def test_multiple_values(self):
+        """Check that values has dimensions (Y, X, T), using different sizes for each dimension"""
+        np.random.seed(1000)
+        base = np.random.rand(15, 20)
+        values = np.random.rand(15, 20, 3)
+        values[5, 5, 2] = np.nan
+        for method in [gridpp.MinMax, gridpp.LinearRegression]:
+            with self.subTest(method=method):
+                gradient = gridpp.calc_gradient(base, values, method, 2, 2, 0, -11)
+                self.assertEqual(gradient.shape, values.shape)
+                for t in range(3):
+                    np.testing.assert_array_equal(gradient[..., t], gridpp.calc_gradient(base, values[..., t], method, 2, 2, 0, -11))
+
+                # Times first is not accepted
+                with self.assertRaises(ValueError):
+                    gridpp.calc_gradient(base, np.moveaxis(values, 2, 0), method, 2, 2, 0, -11)
+
     def test_nan(self):
         base = np.random.rand(10, 10) # np.zeros([10, 10])
         base[3:8, 3:8] = np.nan
@@ -54,6 +54,52 @@ class Test(unittest.TestCase):
         np.testing.assert_array_equal(grid.get_lafs(), np.zeros([0, 0]))
         np.testing.assert_array_equal(grid.size(), [0, 0])
 
+    def test_rectilinear(self):
+        """Check that lookups on rectilinear grids give the same results as the tree search"""
+        np.random.seed(1000)
+        for lats, lons, type in [(np.linspace(70, 50, 21), np.linspace(0, 30, 31), gridpp.Geodetic),
+                (np.linspace(0, 10000, 11) ** 1.5, np.linspace(0, 5000, 6), gridpp.Cartesian)]:
+            lons2, lats2 = np.meshgrid(lons, lats)
+            grid = gridpp.Grid(lats2, lons2, lats2 * 0, lats2 * 0, type)
+            self.assertTrue(grid.is_rectilinear())
+            qlats = np.min(lats) - 5 + np.random.rand(100) * (np.max(lats) - np.min(lats) + 10)
+            qlons = np.min(lons) - 5 + np.random.rand(100) * (np.max(lons) - np.min(lons) + 10)
+            Y, X = grid.get_nearest_neighbours(qlats, qlons)
+            for i in range(len(qlats)):
+                with self.subTest(type=type, i=i):
+                    I = grid.get_closest_neighbours(qlats[i], qlons[i], 1)[0]
+                    np.testing.assert_array_equal(grid.get_nearest_neighbour(qlats[i], qlons[i]), I)
+                    self.assertEqual(Y[i], I[0])
+                    self.assertEqual(X[i], I[1])
+
+        grid = gridpp.Grid([[0, 0, 0], [1, 1, 1]], [[0, 1, 2], [0, 1, 2]])
+        self.assertTrue(grid.is_rectilinear())
+        np.testing.assert_array_equal(grid.get_box(0.4, 1.25), [True, 0, 1, 1, 2])
+        np.testing.assert_array_equal(grid.get_box(1, 2), [True, 0, 1, 1, 2])
+        self.assertFalse(grid.get_box(1.1, 1.25)[0])
+        self.assertFalse(gridpp.Grid([[0, 0, 0], [1, 1, 1]], [[0, 1, 2], [0.25, 1.25, 2.25]]).is_rectilinear())
+
+    def test_rectilinear_high_latitude(self):
+        """Check nearest neighbours on a grid that is much finer in latitude than in longitude. The
+        closest point on a neighbouring meridian is then several rows poleward of the query point."""
+        for sign in [1, -1]:
+            lons, lats = np.meshgrid(np.linspace(0, 40, 5), sign * np.linspace(80, 81, 101))
+            grid = gridpp.Grid(lats, lons)
+            self.assertTrue(grid.is_rectilinear())
+            qlats = sign * np.array([80.5, 80.5, 80.2, 80.7])
+            qlons = np.array([4.9, 5.1, 14.9, 34])
+            Y, X = grid.get_nearest_neighbours(qlats, qlons)
+            for i in range(len(qlats)):
+                with self.subTest(sign=sign, i=i):
+                    I = grid.get_closest_neighbours(qlats[i], qlons[i], 1)[0]
+                    np.testing.assert_array_equal(grid.get_nearest_neighbour(qlats[i], qlons[i]), I)
+                    self.assertEqual(Y[i], I[0])
+                    self.assertEqual(X[i], I[1])
+            # 4.9 degrees from the nearest meridian at 80.5N, the closest point is 0.035 degrees
+            # poleward, three rows away
+            self.assertEqual(Y[0], 53)
+            self.assertEqual(X[0], 0)
+
 
 if __name__ == '__main__':
     unittest.main()
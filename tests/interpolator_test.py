@@ -0,0 +1,111 @@
+from __future__ import print_function
+import unittest
+import gridpp
+import numpy as np
+import os
+import tempfile
+
+
+class Test(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(1000)
+        lons, lats = np.meshgrid(np.linspace(5, 10, 21), np.linspace(55, 60, 11))
+        self.igrid = gridpp.Grid(lats, lons)
+        olons, olats = np.meshgrid(np.linspace(4.9, 10.1, 31), np.linspace(54.9, 60.1, 17))
+        self.ogrid = gridpp.Grid(olats, olons)
+        self.opoints = gridpp.Points(54 + np.random.rand(20) * 7, 4 + np.random.rand(20) * 7)
+        self.values = np.random.rand(3, 11, 21)
+        self.values[0, 5, 5] = np.nan
+
+    def test_same_as_downscaling(self):
+        """Check that the interpolator gives the same results as gridpp.downscaling"""
+        for downscaler in [gridpp.Nearest, gridpp.Bilinear]:
+            with self.subTest(downscaler=downscaler):
+                interpolator = gridpp.Interpolator(self.igrid, self.ogrid, downscaler)
+                np.testing.assert_array_almost_equal(interpolator.apply(self.values[0, ...]),
+                        gridpp.downscaling(self.igrid, self.ogrid, self.values[0, ...], downscaler))
+                np.testing.assert_array_almost_equal(interpolator.apply(self.values),
+                        gridpp.downscaling(self.igrid, self.ogrid, self.values, downscaler))
+
+                interpolator = gridpp.Interpolator(self.igrid, self.opoints, downscaler)
+                np.testing.assert_array_almost_equal(interpolator.apply_points(self.values[0, ...]),
+                        gridpp.downscaling(self.igrid, self.opoints, self.values[0, ...], downscaler))
+                np.testing.assert_array_almost_equal(interpolator.apply_points(self.values),
+                        gridpp.downscaling(self.igrid, self.opoints, self.values, downscaler))
+
+    def test_same_as_full_gradient(self):
+        """Check that the interpolator gives the same results as gridpp.full_gradient"""
+        lons, lats = np.meshgrid(np.linspace(5, 10, 21), np.linspace(55, 60, 11))
+        igrid = gridpp.Grid(lats, lons, np.random.rand(11, 21) * 1000, np.random.rand(11, 21))
+        olons, olats = np.meshgrid(np.linspace(4.9, 10.1, 31), np.linspace(54.9, 60.1, 17))
+        ogrid = gridpp.Grid(olats, olons, np.random.rand(17, 31) * 1000, np.random.rand(17, 31))
+        opoints = gridpp.Points(54 + np.random.rand(20) * 7, 4 + np.random.rand(20) * 7,
+                np.random.rand(20) * 1000, np.random.rand(20))
+        elev_gradient = -0.0065 * np.random.rand(3, 11, 21)
+        laf_gradient = np.random.rand(3, 11, 21)
+        for downscaler in [gridpp.Nearest, gridpp.Bilinear]:
+            with self.subTest(downscaler=downscaler):
+                interpolator = gridpp.Interpolator(igrid, ogrid, downscaler)
+                np.testing.assert_array_almost_equal(interpolator.apply_full_gradient(self.values[0, ...], elev_gradient[0, ...], laf_gradient[0, ...]),
+                        gridpp.full_gradient(igrid, ogrid, self.values[0, ...], elev_gradient[0, ...], laf_gradient[0, ...], downscaler))
+                np.testing.assert_array_almost_equal(interpolator.apply_full_gradient(self.values, elev_gradient, laf_gradient),
+                        gridpp.full_gradient(igrid, ogrid, self.values, elev_gradient, laf_gradient, downscaler))
+
+                interpolator = gridpp.Interpolator(igrid, opoints, downscaler)
+                np.testing.assert_array_almost_equal(interpolator.apply_full_gradient_points(self.values[0, ...], elev_gradient[0, ...], laf_gradient[0, ...]),
+                        gridpp.full_gradient(igrid, opoints, self.values[0, ...], elev_gradient[0, ...], laf_gradient[0, ...], downscaler))
+                np.testing.assert_array_almost_equal(interpolator.apply_full_gradient_points(self.values, elev_gradient, laf_gradient),
+                        gridpp.full_gradient(igrid, opoints, self.values, elev_gradient, laf_gradient, downscaler))
+
+    def test_write_read(self):
+        interpolator = gridpp.Interpolator(self.igrid, self.ogrid, gridpp.Bilinear)
+        with tempfile.TemporaryDirectory() as dirname:
+            filename = os.path.join(dirname, "interpolator.bin")
+            interpolator.write(filename)
+            interpolator2 = gridpp.Interpolator(filename)
+        self.assertEqual(interpolator2.get_downscaler(), gridpp.Bilinear)
+        np.testing.assert_array_equal(interpolator2.get_input_size(), [11, 21])
+        np.testing.assert_array_equal(interpolator2.get_output_size(), [17, 31])
+        np.testing.assert_array_equal(interpolator.apply(self.values), interpolator2.apply(self.values))
+
+    def test_invalid_file(self):
+        with tempfile.TemporaryDirectory() as dirname:
+            filename = os.path.join(dirname, "interpolator.bin")
+            with self.assertRaises(RuntimeError) as e:
+                gridpp.Interpolator(filename)
+            with open(filename, "w") as file:
+                file.write("test")
+            with self.assertRaises(RuntimeError) as e:
+                gridpp.Interpolator(filename)
+
+            # Change the first input row to one outside the input grid
+            interpolator = gridpp.Interpolator(self.igrid, self.ogrid, gridpp.Nearest)
+            interpolator.write(filename)
+            with open(filename, "rb") as file:
+                data = bytearray(file.read())
+            data[48:52] = np.int32(11).tobytes()
+            with open(filename, "wb") as file:
+                file.write(data)
+            with self.assertRaises(RuntimeError) as e:
+                gridpp.Interpolator(filename)
+
+            # A vector size larger than the file
+            data[40:48] = np.int64(2**40).tobytes()
+            with open(filename, "wb") as file:
+                file.write(data)
+            with self.assertRaises(RuntimeError) as e:
+                gridpp.Interpolator(filename)
+
+    def test_invalid_input(self):
+        interpolator = gridpp.Interpolator(self.igrid, self.ogrid, gridpp.Nearest)
+        with self.assertRaises(ValueError) as e:
+            interpolator.apply(np.zeros([21, 11]))
+        with self.assertRaises(ValueError) as e:
+            interpolator.apply_points(self.values[0, ...])
+        interpolator = gridpp.Interpolator(self.igrid, self.opoints, gridpp.Nearest)
+        with self.assertRaises(ValueError) as e:
+            interpolator.apply(self.values[0, ...])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -89,6 +89,34 @@ class KDTreeTest(unittest.TestCase):
         tree = gridpp.KDTree()
         self.assertEqual(tree.get_coordinate_type(), gridpp.Geodetic)
 
+    def test_batch_queries(self):
+        """Check that the batch queries give the same results as the single-point queries"""
+        np.random.seed(1000)
+        N = 500
+        tree = gridpp.KDTree(np.random.rand(N) * 10000, np.random.rand(N) * 10000, gridpp.Cartesian)
+        lats = np.random.rand(50) * 10000
+        lons = np.random.rand(50) * 10000
+        for include_match in [True, False]:
+            with self.subTest(include_match=include_match):
+                nearest = tree.get_nearest_neighbours(lats, lons, include_match)
+                offsets, indices = tree.get_neighbours(lats, lons, 1000, include_match)
+                self.assertEqual(len(offsets), len(lats) + 1)
+                for i in range(len(lats)):
+                    self.assertEqual(nearest[i], tree.get_nearest_neighbour(lats[i], lons[i], include_match))
+                    np.testing.assert_array_equal(indices[offsets[i]:offsets[i+1]],
+                            tree.get_neighbours(lats[i], lons[i], 1000, include_match))
+
+    def test_batch_queries_grid(self):
+        lons, lats = np.meshgrid([0, 1000, 2000], [0, 1000])
+        grid = gridpp.Grid(lats, lons, lats * 0, lats * 0, gridpp.Cartesian)
+        Y, X = grid.get_nearest_neighbours([0, 900, 100], [1900, 100, 1100])
+        np.testing.assert_array_equal(Y, [0, 1, 0])
+        np.testing.assert_array_equal(X, [2, 0, 1])
+        offsets, Y, X = grid.get_neighbours([0, 900], [0, 2000], 500)
+        np.testing.assert_array_equal(offsets, [0, 1, 2])
+        np.testing.assert_array_equal(Y, [0, 1])
+        np.testing.assert_array_equal(X, [0, 2])
+
 
 if __name__ == '__main__':
     unittest.main()
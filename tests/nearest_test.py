@@ -109,6 +109,18 @@ class Test(unittest.TestCase):
         output = gridpp.nearest(ipoints, points, values)
         np.testing.assert_array_equal(output, [[0, 1]])
 
+    def test_empty_input_points(self):
+        """Check that missing values are returned when there are no input points"""
+        ipoints = gridpp.Points([], [])
+        points = gridpp.Points([-1, 6], [-1, 6])
+        output = gridpp.nearest(ipoints, points, np.zeros(0))
+        np.testing.assert_array_equal(output, [np.nan, np.nan])
+
+        lons, lats = np.meshgrid([0, 10, 20], [30, 40, 50])
+        grid = gridpp.Grid(lats, lons)
+        output = gridpp.nearest(ipoints, grid, np.zeros(0))
+        self.assertTrue(np.isnan(output).all())
+
 
 
 if __name__ == '__main__':
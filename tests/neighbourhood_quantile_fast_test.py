@@ -135,6 +135,19 @@ class Test(unittest.TestCase):
                 output = gridpp.neighbourhood_quantile_fast(field, quantile, 5, thresholds)
                 np.testing.assert_array_almost_equal(output, field)
 
+    def test_many_thresholds(self):
+        """Check that a neighbourhood covering the whole field gives the same value everywhere,
+        also when the field is larger than the bands it is processed in"""
+        np.random.seed(1000)
+        values = np.random.rand(150, 80, 3)
+        values[values < 0.1] = np.nan
+        thresholds = np.linspace(0, 1, 101)
+        for halfwidth in [150, 1000]:
+            with self.subTest(halfwidth=halfwidth):
+                output = gridpp.neighbourhood_quantile_fast(values, 0.3, halfwidth, thresholds)
+                np.testing.assert_array_almost_equal(output, output[0, 0] * np.ones([150, 80]))
+                self.assertAlmostEqual(output[0, 0], np.nanquantile(values, 0.3), 2)
+
 
 if __name__ == '__main__':
     unittest.main()
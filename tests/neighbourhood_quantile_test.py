@@ -50,6 +50,26 @@ class Test(unittest.TestCase):
         self.assertEqual(output[2][3], 13)
         self.assertEqual(output[0][4], 4)
 
+    def test_numpy(self):
+        """Check against numpy for larger neighbourhoods, with and without an ensemble dimension"""
+        np.random.seed(1000)
+        values = np.round(np.random.rand(12, 15, 3) * 20)
+        values[np.random.rand(12, 15, 3) < 0.2] = np.nan
+        for halfwidth in [2, 5, 20]:
+            for quantile in [0, 0.1, 0.5, 0.75, 1]:
+                with self.subTest(halfwidth=halfwidth, quantile=quantile):
+                    expected = np.nan * np.zeros([12, 15])
+                    expected3 = np.nan * np.zeros([12, 15])
+                    for i in range(12):
+                        for j in range(15):
+                            curr = values[max(0, i - halfwidth):i + halfwidth + 1, max(0, j - halfwidth):j + halfwidth + 1, :]
+                            if np.sum(~np.isnan(curr[..., 0])) > 0:
+                                expected[i, j] = np.nanquantile(curr[..., 0], quantile)
+                            if np.sum(~np.isnan(curr)) > 0:
+                                expected3[i, j] = np.nanquantile(curr, quantile)
+                    np.testing.assert_array_almost_equal(gridpp.neighbourhood_quantile(values[..., 0], quantile, halfwidth), expected, 4)
+                    np.testing.assert_array_almost_equal(gridpp.neighbourhood_quantile(values, quantile, halfwidth), expected3, 4)
+
 
 if __name__ == '__main__':
     unittest.main()
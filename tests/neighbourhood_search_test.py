@@ -46,5 +46,37 @@ class Test(unittest.TestCase):
         np.testing.assert_array_equal(output, [[0, 2, 2]])
 
 
+    def test_random(self):
+        """Check against a brute force computation, with and without values inside the target"""
+        np.random.seed(1000)
+        values = np.random.rand(15, 20)
+        values[np.random.rand(15, 20) < 0.1] = np.nan
+        base = np.random.rand(15, 20)
+        base[np.random.rand(15, 20) < 0.1] = np.nan
+        apply_array = np.random.randint(0, 2, [15, 20])
+        for halfwidth in [0, 1, 3]:
+            for target_min, target_max in [[0.9, 1], [0.98, 1]]:
+                with self.subTest(halfwidth=halfwidth, target_min=target_min):
+                    expected = np.array(values)
+                    for y in range(15):
+                        for x in range(20):
+                            if np.isnan(base[y, x]) or apply_array[y, x] == 0:
+                                continue
+                            Y = slice(max(0, y - halfwidth), y + halfwidth + 1)
+                            X = slice(max(0, x - halfwidth), x + halfwidth + 1)
+                            curr_base = base[Y, X].flatten()
+                            curr_values = values[Y, X].flatten()
+                            valid = ~np.isnan(curr_base) & ~np.isnan(curr_values)
+                            inside = valid & (curr_base >= target_min) & (curr_base <= target_max)
+                            candidates = valid & (np.abs(curr_base - base[y, x]) >= 0.1)
+                            if np.sum(inside) > 0:
+                                expected[y, x] = np.mean(curr_values[inside])
+                            elif np.sum(candidates) > 0:
+                                dist = np.minimum(np.abs(curr_base - target_min), np.abs(curr_base - target_max))
+                                dist[~candidates] = np.inf
+                                expected[y, x] = curr_values[np.argmin(dist)]
+                    output = gridpp.neighbourhood_search(values, base, halfwidth, target_min, target_max, 0.1, apply_array)
+                    np.testing.assert_array_almost_equal(output, expected, 5)
+
 if __name__ == '__main__':
     unittest.main()
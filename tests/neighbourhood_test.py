@@ -36,6 +36,11 @@ class Test(unittest.TestCase):
             with self.assertRaises(Exception) as e:
                 gridpp.neighbourhood(field, 1, gridpp.Quantile)
 
+        # Statistics that cannot be computed must be rejected before the computation starts
+        for input in [field, np.ones([5, 5, 3])]:
+            with self.assertRaises(ValueError) as e:
+                gridpp.neighbourhood(input, 1, gridpp.Unknown)
+
     def test_empty(self):
         """Empty input array"""
         for statistic in [gridpp.Mean, gridpp.Min, gridpp.Max, gridpp.Median, gridpp.Std, gridpp.Variance]:
@@ -104,6 +109,20 @@ class Test(unittest.TestCase):
             output = func(values, 100, gridpp.Max)
             self.assertTrue((np.array(output) == 24).all())
 
+    def test_min_max_brute_force(self):
+        """Check that min/max are the same as the brute force method, including missing values and
+        halfwidths larger than the grid"""
+        np.random.seed(1000)
+        input = np.random.rand(37, 51)
+        input[np.random.rand(37, 51) < 0.3] = np.nan
+        input[0:10, 0:10] = np.nan
+        for statistic in [gridpp.Min, gridpp.Max]:
+            for halfwidth in [0, 1, 2, 7, 30, 60]:
+                with self.subTest(statistic=statistic, halfwidth=halfwidth):
+                    output = gridpp.neighbourhood(input, halfwidth, statistic)
+                    expected = gridpp.neighbourhood_brute_force(input, halfwidth, statistic)
+                    np.testing.assert_array_equal(output, expected)
+
     def test_mean0(self):
         for func in [gridpp.neighbourhood, gridpp.neighbourhood_brute_force]:
             input = (np.random.rand(1000, 1000)> 0.5).astype(float)
@@ -123,6 +142,28 @@ class Test(unittest.TestCase):
                 output_3d = func(values3, halfwidth, gridpp.Mean)
                 np.testing.assert_array_almost_equal(output_2d, output_3d, 5)
 
+    def test_array_and_list_input(self):
+        """Check that numpy arrays and lists give the same result"""
+        for statistic in [gridpp.Mean, gridpp.Count, gridpp.Min, gridpp.Std, gridpp.Median]:
+            with self.subTest(statistic=statistic):
+                output = gridpp.neighbourhood(values, 1, statistic)
+                self.assertEqual(output.shape, values.shape)
+                np.testing.assert_array_almost_equal(output, gridpp.neighbourhood(values.tolist(), 1, statistic))
+                np.testing.assert_array_almost_equal(gridpp.neighbourhood(values.T, 1, statistic),
+                        gridpp.neighbourhood(values.T.tolist(), 1, statistic))
+
+    def test_3d_strided(self):
+        """Check that non-contiguous ensemble arrays give the same result as contiguous ones"""
+        np.random.seed(1000)
+        values3 = np.random.rand(5, 50, 40).astype('float32')
+        strided = values3.transpose([1, 2, 0])
+        contiguous = np.ascontiguousarray(strided)
+        for statistic in [gridpp.Mean, gridpp.Max, gridpp.Std]:
+            with self.subTest(statistic=statistic):
+                output = gridpp.neighbourhood(strided, 2, statistic)
+                expected = gridpp.neighbourhood(contiguous.tolist(), 2, statistic)
+                np.testing.assert_array_almost_equal(output, expected)
+
     def test_overflow(self):
         """ Check that mean is not affected by overflow """
         N = int(1e3)
@@ -34,6 +34,30 @@ class Test(unittest.TestCase):
         output0 = gridpp.optimal_interpolation_ensi(grid, background, points, pobs, psigmas, pbackground, structure, max_points)
         np.testing.assert_almost_equal(output0, background)
 
+    def test_num_threads(self):
+        """ Check that the output does not depend on the number of threads """
+        np.random.seed(1000)
+        N = 200
+        S = 50
+        E = 5
+        grid = gridpp.Points(np.random.rand(N) + 60, np.random.rand(N) + 10)
+        points = gridpp.Points(np.random.rand(S) + 60, np.random.rand(S) + 10)
+        psigmas = np.ones(S)
+        structure = gridpp.BarnesStructure(20000)
+        pobs = np.random.rand(S) * 3
+        background = np.random.rand(grid.size(), E)
+        pbackground = np.random.rand(S, E)
+        max_points = 20
+        num_threads = gridpp.get_omp_threads()
+        try:
+            outputs = list()
+            for threads in [1, 4]:
+                gridpp.set_omp_threads(threads)
+                outputs += [gridpp.optimal_interpolation_ensi(grid, background, points, pobs, psigmas, pbackground, structure, max_points)]
+            np.testing.assert_array_equal(outputs[0], outputs[1])
+        finally:
+            gridpp.set_omp_threads(num_threads)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -83,6 +83,50 @@ class Test(unittest.TestCase):
         # np.testing.assert_array_almost_equal(sigma, np.array([[0, np.sqrt(0.1/1.1), 1]]))
         self.assertAlmostEqual(sigma[0, 1], 0.1/1.1)
 
+    def test_point_order(self):
+        """Check that the analysis does not depend on the order of the background points, since
+        consecutive points can reuse the factorization of the previous point"""
+        np.random.seed(1000)
+        N = 200
+        S = 50
+        y = np.random.rand(N) * 10000
+        x = np.random.rand(N) * 10000
+        order = np.argsort(x)
+        reverse = order[::-1]
+        points = gridpp.Points(np.random.rand(S) * 10000, np.random.rand(S) * 10000, np.zeros(S), np.zeros(S), gridpp.Cartesian)
+        pobs = np.random.rand(S)
+        obs_variance = 0.5 * np.ones(S)
+        background_at_points = np.zeros(S)
+        bvariance_at_points = np.ones(S)
+        structure = gridpp.BarnesStructure(2000)
+        for max_points in [0, 10]:
+            with self.subTest(max_points=max_points):
+                outputs = list()
+                variances = list()
+                for I in [order, reverse]:
+                    grid = gridpp.Points(y[I], x[I], np.zeros(N), np.zeros(N), gridpp.Cartesian)
+                    output, variance = gridpp.optimal_interpolation_full(grid, np.zeros(N), np.ones(N),
+                            points, pobs, obs_variance, background_at_points, bvariance_at_points,
+                            structure, max_points)
+                    outputs += [np.zeros(N)]
+                    outputs[-1][I] = output
+                    variances += [np.zeros(N)]
+                    variances[-1][I] = variance
+                np.testing.assert_array_almost_equal(outputs[0], outputs[1])
+                np.testing.assert_array_almost_equal(variances[0], variances[1])
+
+    def test_singular(self):
+        """Check that a singular observation covariance matrix gives the pseudo-inverse solution"""
+        grid = gridpp.Points([0, 1000], [0, 0], [0, 0], [0, 0], gridpp.Cartesian)
+        points = gridpp.Points([500, 500], [0, 0], [0, 0], [0, 0], gridpp.Cartesian)
+        structure = gridpp.BarnesStructure(2000)
+        output, variance = gridpp.optimal_interpolation_full(grid, [0, 0], [1, 1], points, [1, 1],
+                [0, 0], [0, 0], [1, 1], structure, 10)
+        # The two perfect observations are at the same place, so they act as one observation
+        rho = np.exp(-0.5 * (500.0 / 2000) ** 2)
+        np.testing.assert_array_almost_equal(output, [rho, rho], 4)
+        np.testing.assert_array_almost_equal(variance, [1 - rho ** 2, 1 - rho ** 2], 4)
+
     def test_cross_validation(self):
         y = np.array([0, 1000, 2000, 3000])
         N = len(y)
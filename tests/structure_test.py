@@ -107,6 +107,61 @@ class Test(unittest.TestCase):
             with self.assertRaises(Exception) as e:
                 structure = gridpp.CrossValidation(barnes, dist)
 
+    def test_indexed(self):
+        """Check that the indexed functions give the same results as the regular ones"""
+        lons, lats = np.meshgrid([0.0, 10000, 20000], [0.0, 10000, 20000])
+        grid = gridpp.Grid(lats, lons, lats * 0, lats * 0, gridpp.Cartesian)
+        h = np.reshape(np.arange(1, 10) * 1000.0, lats.shape)
+        v = np.full(lats.shape, 100.0)
+        w = np.zeros(lats.shape)
+        spatial = gridpp.BarnesStructure(grid, h, v, w)
+        structures = [spatial, gridpp.BarnesStructure(2000, 100), gridpp.CressmanStructure(2000),
+                gridpp.CrossValidation(spatial, 1000)]
+        points = gridpp.Points([0, 1000, 12000, 19000], [0, 9000, 11000, 21000], [0, 50, 100, 0], [0, 0, 0, 0], gridpp.Cartesian)
+        for structure in structures:
+            with self.subTest(structure=type(structure)):
+                indices = structure.get_parameter_indices(points)
+                self.assertEqual(len(indices), points.size())
+                for i in range(points.size()):
+                    p1 = points.get_point(i)
+                    self.assertAlmostEqual(structure.localization_distance(p1),
+                            structure.localization_distance_indexed(p1, indices[i]))
+                    for j in range(points.size()):
+                        p2 = points.get_point(j)
+                        self.assertAlmostEqual(structure.corr(p1, p2), structure.corr_indexed(p1, p2, indices[i]))
+                        self.assertAlmostEqual(structure.corr_background(p1, p2),
+                                structure.corr_background_indexed(p1, p2, indices[i]))
+
+    def test_corr_matrix(self):
+        """Check that the batched functions give the same results as corr"""
+        lons, lats = np.meshgrid([0.0, 10000, 20000], [0.0, 10000, 20000])
+        grid = gridpp.Grid(lats, lons, lats * 0, lats * 0, gridpp.Cartesian)
+        h = np.reshape(np.arange(1, 10) * 1000.0, lats.shape)
+        v = np.full(lats.shape, 100.0)
+        w = np.zeros(lats.shape)
+        barnes = gridpp.BarnesStructure(2000, 100, 0.5)
+        cressman = gridpp.CressmanStructure(5000, 200)
+        structures = [gridpp.BarnesStructure(grid, h, v, w), barnes, cressman,
+                gridpp.MultipleStructure(barnes, cressman, barnes), gridpp.CrossValidation(barnes, 1000)]
+        plats = [0, 1000, 12000, 19000, 2000]
+        plons = [0, 9000, 11000, 21000, 500]
+        pelevs = [0, 50, 100, np.nan, 10]
+        plafs = [0, 1, 0.5, 0, np.nan]
+        points = gridpp.Points(plats, plons, pelevs, plafs, gridpp.Cartesian)
+        N = points.size()
+        for structure in structures:
+            with self.subTest(structure=type(structure)):
+                indices = structure.get_parameter_indices(points)
+                expected = np.zeros([N, N])
+                for i in range(N):
+                    for j in range(N):
+                        expected[i, j] = structure.corr(points.get_point(i), points.get_point(j))
+                output = structure.corr_matrix(plats, plons, pelevs, plafs, gridpp.Cartesian, indices)
+                np.testing.assert_array_almost_equal(expected, output)
+                for i in range(N):
+                    output = structure.corr_row(points.get_point(i), indices[i], plats, plons, pelevs, plafs)
+                    np.testing.assert_array_almost_equal(expected[i, :], output)
+
 
 if __name__ == '__main__':
     unittest.main()
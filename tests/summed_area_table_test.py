@@ -0,0 +1,46 @@
+from __future__ import print_function
+import unittest
+import gridpp
+import numpy as np
+
+
+class Test(unittest.TestCase):
+    def test_rectangles(self):
+        """Check sums in rectangles against numpy, including rectangles outside the field"""
+        np.random.seed(1000)
+        values = np.random.rand(20, 30)
+        values[values < 0.2] = np.nan
+        table = gridpp.SummedAreaTable(values, True)
+        self.assertEqual(table.size_y(), 20)
+        self.assertEqual(table.size_x(), 30)
+        for y0, x0, y1, x1 in [(0, 0, 19, 29), (3, 4, 3, 4), (5, 2, 12, 25), (-5, -5, 2, 40), (25, 0, 30, 5)]:
+            with self.subTest(rectangle=(y0, x0, y1, x1)):
+                curr = values[max(y0, 0):y1+1, max(x0, 0):x1+1]
+                self.assertAlmostEqual(table.sum(y0, x0, y1, x1), np.nansum(curr), 4)
+                self.assertEqual(table.count(y0, x0, y1, x1), np.sum(~np.isnan(curr)))
+                self.assertAlmostEqual(table.sum_squares(y0, x0, y1, x1), np.nansum(curr**2), 4)
+
+    def test_neighbourhood(self):
+        """Check that the table gives the same results as gridpp.neighbourhood"""
+        np.random.seed(1000)
+        values = np.random.rand(20, 30)
+        values[values < 0.2] = np.nan
+        table = gridpp.SummedAreaTable(values, True)
+        for statistic in [gridpp.Mean, gridpp.Sum, gridpp.Count, gridpp.Std, gridpp.Variance]:
+            for halfwidth in [1, 5]:
+                with self.subTest(statistic=statistic, halfwidth=halfwidth):
+                    np.testing.assert_array_almost_equal(table.neighbourhood(halfwidth, statistic),
+                            gridpp.neighbourhood(values, halfwidth, statistic))
+
+    def test_missing_squares(self):
+        table = gridpp.SummedAreaTable(np.zeros([3, 3]))
+        for statistic in [gridpp.Std, gridpp.Variance, gridpp.Max]:
+            with self.subTest(statistic=statistic):
+                with self.assertRaises(ValueError) as e:
+                    table.neighbourhood(1, statistic)
+        with self.assertRaises(ValueError) as e:
+            table.sum_squares(0, 0, 1, 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
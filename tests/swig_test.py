@@ -50,6 +50,30 @@ class Test(unittest.TestCase):
         self.assertEqual(gridpp.test_vec3_input(np.array(ar).astype('float64')), 36)
         self.assertEqual(gridpp.test_vec3_input(np.array(ar).astype('int32')), 36)
 
+    def test_view_input(self):
+        """ Test that views accept arrays of any type and memory layout"""
+        ar = np.array([[[1,2],[2,3]], [[2,3],[3,4]], [[3,4],[4,5]]])
+        for dtype in ['float32', 'float64', 'int32']:
+            with self.subTest(dtype=dtype):
+                self.assertEqual(gridpp.test_view3_input(ar.astype(dtype)), 36)
+                self.assertEqual(gridpp.test_view2_input(ar[:, :, 0].astype(dtype)), 15)
+        self.assertEqual(gridpp.test_view3_input(ar.tolist()), 36)
+
+        # Non-contiguous float32 arrays are passed without copying
+        ar = np.arange(60).reshape([3, 4, 5]).astype('float32')
+        for sub in [ar[::2, :, :], ar[:, ::-1, 1:], ar.transpose([2, 0, 1]), ar[:, :, 3]]:
+            func = gridpp.test_view3_input if len(sub.shape) == 3 else gridpp.test_view2_input
+            self.assertEqual(func(sub), np.sum(sub))
+
+    def test_output_owns_memory(self):
+        """ Check that 1D outputs stay valid after being returned """
+        output = gridpp.test_vec_output()
+        self.assertFalse(output.flags['OWNDATA'])
+        self.assertIsNotNone(output.base)
+        output2 = output.copy()
+        del output
+        np.testing.assert_array_equal(output2, [-1, -1, -1])
+
     def test_vec_argout(self):
         n, distances = gridpp.test_vec_argout()
         self.assertEqual(len(distances), 10)
@@ -70,6 +94,12 @@ class Test(unittest.TestCase):
         for func in [gridpp.test_vec_input, gridpp.test_vec2_input]:
             with self.assertRaises(Exception) as e:
                 func(np.zeros([5, 2, 3]))
+        for func in [gridpp.test_view2_input]:
+            with self.assertRaises(Exception) as e:
+                func(np.zeros([5, 2, 3]))
+        for func in [gridpp.test_view3_input]:
+            with self.assertRaises(Exception) as e:
+                func(np.zeros([5, 2]))
 
     def test_vec_output(self):
         ar = [-1, -1, -1]
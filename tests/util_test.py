@@ -30,6 +30,8 @@ class Test(unittest.TestCase):
         self.assertTrue(gridpp.is_valid(-1))
         self.assertTrue(gridpp.is_valid(-999))  # Check that the old missing value indicator is valid now
         self.assertFalse(gridpp.is_valid(np.nan))
+        self.assertFalse(gridpp.is_valid(np.inf))
+        self.assertFalse(gridpp.is_valid(-np.inf))
 
     def test_calc_statistic_mean(self):
         self.assertEqual(gridpp.calc_statistic([0, 1, 2], gridpp.Mean), 1)
@@ -83,6 +85,65 @@ class Test(unittest.TestCase):
                 gridpp.calc_quantile([0, 1, 2], quantile)
         self.assertTrue(np.isnan(gridpp.calc_quantile([0, 1, 2], np.nan)))
 
+        # A quantile per gridpoint
+        values = np.random.rand(3, 4, 5)
+        quantiles = 0.5 * np.ones([3, 4])
+        np.testing.assert_array_almost_equal(gridpp.calc_quantile(values, quantiles), np.median(values, axis=2))
+        for quantile in [1.1, -0.1]:
+            quantiles[2, 3] = quantile
+            with self.assertRaises(ValueError) as e:
+                gridpp.calc_quantile(values, quantiles)
+        with self.assertRaises(ValueError) as e:
+            gridpp.calc_quantile(values, np.zeros([3, 3]))
+
+    def test_calc_quantile_large(self):
+        """Check arrays large enough to use selection instead of sorting"""
+        np.random.seed(1000)
+        for size in [17, 51, 1000]:
+            values = np.random.rand(size)
+            values[values < 0.1] = np.nan
+            for quantile in [0, 0.1, 0.5, 0.77, 1]:
+                with self.subTest(size=size, quantile=quantile):
+                    self.assertAlmostEqual(gridpp.calc_quantile(values, quantile), np.nanquantile(values, quantile), 5)
+
+    def test_calc_quantiles(self):
+        np.random.seed(1000)
+        quantiles = [0.1, 0.5, 0.9, 0, 1, np.nan]
+        for size in [1, 10, 51, 1000]:
+            values = np.random.rand(size)
+            values[values < 0.1] = np.nan
+            with self.subTest(size=size):
+                expected = [gridpp.calc_quantile(values, quantile) for quantile in quantiles]
+                np.testing.assert_array_equal(gridpp.calc_quantiles(values, quantiles), expected)
+
+        values = np.random.rand(3, 20)
+        expected = [[gridpp.calc_quantile(values[i, :], quantile) for quantile in quantiles] for i in range(3)]
+        np.testing.assert_array_equal(gridpp.calc_quantiles(values, quantiles), expected)
+        for quantile in [1.1, -0.1]:
+            with self.assertRaises(ValueError) as e:
+                gridpp.calc_quantiles([0, 1, 2], [0.5, quantile])
+
+    def test_calc_statistic_3d(self):
+        """Check that statistics over the last dimension of an array are the same as for each gridpoint"""
+        np.random.seed(1000)
+        values = np.random.rand(5, 6, 20).astype(np.float32)
+        values[values < 0.1] = np.nan
+        for statistic in [gridpp.Mean, gridpp.Count, gridpp.Min, gridpp.Max, gridpp.Std, gridpp.Median]:
+            with self.subTest(statistic=statistic):
+                expected = [[gridpp.calc_statistic(values[y, x, :], statistic) for x in range(6)] for y in range(5)]
+                np.testing.assert_array_equal(gridpp.calc_statistic(values, statistic), expected)
+                # Non-contiguous members
+                strided = np.moveaxis(np.ascontiguousarray(np.moveaxis(values, 2, 0)), 0, 2)
+                np.testing.assert_array_equal(gridpp.calc_statistic(strided, statistic), expected)
+        for quantile in [0, 0.3, 1]:
+            with self.subTest(quantile=quantile):
+                expected = [[gridpp.calc_quantile(values[y, x, :], quantile) for x in range(6)] for y in range(5)]
+                np.testing.assert_array_equal(gridpp.calc_quantile(values, quantile), expected)
+        with self.assertRaises(ValueError) as e:
+            gridpp.calc_statistic(values, gridpp.Quantile)
+        with self.assertRaises(ValueError) as e:
+            gridpp.calc_quantile(values, 1.1)
+
     def test_num_missing_values(self):
         self.assertEqual(gridpp.num_missing_values([[0, np.nan, 1, np.nan]]), 2)
         self.assertEqual(gridpp.num_missing_values([[np.nan, np.nan]]), 2)
@@ -103,6 +103,48 @@ class Test(unittest.TestCase):
         output = gridpp.window(input, 3, gridpp.Sum, False, True, True)
         np.testing.assert_array_equal(output, [[np.nan, 3, np.nan, np.nan, np.nan, 12, np.nan]])
 
+    def test_random(self):
+        """Check statistics against a brute force computation on a longer series"""
+        np.random.seed(1000)
+        input = np.round(np.random.rand(3, 50) * 10)
+        input[np.random.rand(3, 50) < 0.1] = np.nan
+        funcs = {gridpp.Min: np.nanmin, gridpp.Max: np.nanmax, gridpp.Median: np.nanmedian, gridpp.Mean: np.nanmean}
+        for statistic, func in funcs.items():
+            for length in [1, 5, 11]:
+                with self.subTest(statistic=statistic, length=length):
+                    expected = np.nan * np.zeros(input.shape)
+                    for x in range(50):
+                        curr = input[:, max(0, x - length // 2):x + length // 2 + 1]
+                        for y in range(3):
+                            if np.sum(~np.isnan(curr[y, :])) > 0:
+                                expected[y, x] = func(curr[y, :])
+                    output = gridpp.window(input, length, statistic, False, False, False)
+                    np.testing.assert_array_almost_equal(output, expected, 5)
+
+    def test_quantile(self):
+        input = [[0, 1, 2, np.nan, 3, 4, 5]]
+        output = gridpp.window_quantile(input, 3, 0.25, False, False, False)
+        np.testing.assert_array_almost_equal(output, [[0.25, 0.5, 1.25, 2.25, 3.25, 3.5, 4.25]])
+
+        output = gridpp.window_quantile(input, 3, 0.25, True, True, True)
+        np.testing.assert_array_almost_equal(output, [[np.nan, np.nan, 0.5, np.nan, np.nan, np.nan, 3.5]])
+
+        for quantile in [0, 0.5, 1]:
+            np.testing.assert_array_equal(gridpp.window_quantile(input, 5, quantile, False, False, False),
+                    gridpp.window(input, 5, [gridpp.Min, gridpp.Median, gridpp.Max][int(quantile * 2)], False, False, False))
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError) as e:
+            gridpp.window(self.inputs, 2, gridpp.Sum, False)
+        with self.assertRaises(ValueError) as e:
+            gridpp.window(self.inputs, 0, gridpp.Sum, True)
+        with self.assertRaises(ValueError) as e:
+            gridpp.window(self.inputs, 3, gridpp.Quantile)
+        for quantile in [-0.1, 1.1]:
+            with self.assertRaises(ValueError) as e:
+                gridpp.window_quantile(self.inputs, 3, quantile)
+
+
 if __name__ == '__main__':
     unittest.main()
 